@@ -1,6 +1,21 @@
 // let pushbutton = new Pushbutton(25, 50, 'Kick');
 let joystick = new Joystick(75, 50, 'Drive');
 let leftMotorSpeed, rightMotorSpeed;
+let triggerButton = new Pushbutton(25, 20, 'Trigger');
+let abortButton = new Pushbutton(25, 50, 'Abort');
+let volumeSlider = new Slider(25, 80, 'Volume', 0, 30, 5);
+
+triggerButton.onClick = function() {
+  sendCommand(COMMAND_TRIGGER);
+};
+
+abortButton.onClick = function() {
+  sendCommand(COMMAND_ABORT);
+};
+
+volumeSlider.onChange = function() {
+  sendCommand(COMMAND_VOLUME, 0, volumeSlider.value);
+};
 
 // pushbutton.onClick = function() {
 //   console.log("pushbutton clicked at " + pushbutton.x +" , " + pushbutton.y);
@@ -14,8 +29,9 @@ let leftMotorSpeed, rightMotorSpeed;
 joystick.onClick = function() {
   leftMotorSpeed = Math.ceil(twoWheelDriveLeftSpeed(joystick.x, joystick.y) * 2000);  // scale speed
   rightMotorSpeed = Math.ceil(twoWheelDriveRightSpeed(joystick.x, joystick.y) * 2000);  // scale speed
-  send("leftMotorSpeed=" + leftMotorSpeed);
-  send("rightMotorSpeed=" + rightMotorSpeed);
+  let x = Math.max(-1, Math.min(1, joystick.x));
+  let y = Math.max(-1, Math.min(1, joystick.y));
+  sendCommand(COMMAND_JOYSTICK, 0, Math.round(x * JOYSTICK_MAX), Math.round(y * JOYSTICK_MAX));
 
   console.log("leftMotorSpeed=" + leftMotorSpeed);
   console.log("rightMotorSpeed=" + rightMotorSpeed);
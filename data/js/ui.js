@@ -10,6 +10,8 @@ const DEFAULT_FONT_SIZE = 16;
 const PUSHBUTTON_WIDTH = 80;
 const PUSHBUTTON_HEIGHT = 40;
 const JOYSTICK_RADIUS = 80;
+const SLIDER_WIDTH = 200;
+const SLIDER_HEIGHT = 30;
 const FRAME_RATE = 30;
 
 /*
@@ -31,6 +33,7 @@ function mainLoop() {
   context.clearRect(0, 0, canvas.width, canvas.height);     // clear canvas
   performUiActions();                                       // perform UI actions for each UI element
   uiElements.forEach(element => {element.draw(context);});  // draw UI elements
+  drawTelemetry(context);                                   // show state pushed by the prop
   sendCommands();                                           // send out any commands over websocket
 }
 
@@ -435,6 +438,54 @@ class Joystick extends UiElement {
 }
 
 
+/*
+* 
+* USER INTERFACE - SLIDER
+*
+*/
+class Slider extends UiElement {
+  constructor(percentX, percentY, text, min, max, value) {
+    super(percentX, percentY);
+    this.width = SLIDER_WIDTH;
+    this.height = SLIDER_HEIGHT;
+    this.text = text;
+    this.min = min;
+    this.max = max;
+    this.value = value;
+  }
+
+  _onClick() {
+    let value = Math.round(this.min + (this.x + 1) / 2 * (this.max - this.min));
+    value = Math.min(this.max, Math.max(this.min, value));
+    if (value != this.value) {    // only send message if the value changed
+      this.value = value;
+      if (typeof this.onChange === 'function') { this.onChange(); }   // execute onChange method if it exists
+    }
+  }
+
+  draw(context) {
+    let centerX = canvas.width * this.percentX / 100;
+    let centerY = canvas.height * this.percentY / 100;
+    let position = (this.value - this.min) / (this.max - this.min);
+
+    context.strokeStyle = this.clicked ? this.cickColor : this.hovered ? this.hoverColor : this.color;
+    context.fillStyle = context.strokeStyle;
+    context.lineWidth = 2;
+    context.strokeRect(centerX - this.width/2, centerY - this.height/2, this.width, this.height);
+    context.fillRect(centerX - this.width/2 + 4, centerY - this.height/2 + 4, (this.width - 8) * position, this.height - 8);
+
+    // draw text
+    if (this.text) {
+      context.fillStyle = this.color;
+      context.font = this.fontSize + "px sans-serif";
+      context.textAlign = "center";
+      context.textBaseline = "top";
+      context.fillText(this.text + ' ' + this.value, centerX, centerY + this.height/2);
+    }
+  }
+}
+
+
 /*
 * 
 * HELPER FUNCTIONS
@@ -483,6 +534,28 @@ let connection = new WebSocket('ws://'+location.hostname+'/ws', ['arduino']);
 let _messageBuffer=[];
 let _connectionStatus = 'disconnected';
 
+/*
+* Binary commands, see include/ControlProtocol.h. Each command is an 8 byte
+* little endian record: command, channel, sequence, value0, value1. Records
+* are batched per frame; for joystick and volume only the latest value per
+* channel is kept.
+*/
+const COMMAND_TRIGGER = 1;
+const COMMAND_ABORT = 2;
+const COMMAND_SCENE = 3;
+const COMMAND_VOLUME = 4;
+const COMMAND_JOYSTICK = 6;
+const COALESCED_COMMANDS = [COMMAND_VOLUME, COMMAND_JOYSTICK];
+const RECORD_SIZE = 8;
+const MAX_RECORDS = 32;
+const JOYSTICK_MAX = 1000;
+
+let _records = new DataView(new ArrayBuffer(RECORD_SIZE * MAX_RECORDS));   // reused every frame
+let _recordCount = 0;
+let _sequence = 0;
+
+connection.binaryType = 'arraybuffer';
+
 connection.onopen = function () {
   console.log("Websocket connected.")
   connection.send('Connect ' + new Date());
@@ -508,7 +581,9 @@ connection.onerror = function (error) {
 connection.onmessage = function (e) {
   _connectionStatus = 'connected';
   missedHeartbeats = 0;
-  if (e.data == HEARTBEAT_MESSAGE) {
+  if (e.data instanceof ArrayBuffer) {
+    decodeTelemetry(new DataView(e.data));
+  } else if (e.data == HEARTBEAT_MESSAGE) {
     console.log('Heartbeat received.');
   } else {
     console.log('Server: ', e.data);
@@ -525,6 +600,31 @@ function send(message) {
     _messageBuffer.push(message);
 }
 
+// queue a binary command for the next frame, values are integers
+function sendCommand(command, channel = 0, value0 = 0, value1 = 0) {
+    let offset = _recordCount * RECORD_SIZE;
+    if (COALESCED_COMMANDS.includes(command)) {
+        for (let i = 0; i < _recordCount; i++) {    // overwrite a stale value
+            if (_records.getUint8(i * RECORD_SIZE) == command && _records.getUint8(i * RECORD_SIZE + 1) == channel) {
+                offset = i * RECORD_SIZE;
+                break;
+            }
+        }
+    }
+    if (offset == _recordCount * RECORD_SIZE) {
+        if (_recordCount == MAX_RECORDS) {
+            return;
+        }
+        _recordCount++;
+    }
+    _sequence = _sequence % 0xFFFF + 1;     // 1 to 65535, 0 is for text commands
+    _records.setUint8(offset, command);
+    _records.setUint8(offset + 1, channel);
+    _records.setUint16(offset + 2, _sequence, true);
+    _records.setInt16(offset + 4, value0, true);
+    _records.setInt16(offset + 6, value1, true);
+}
+
 function sendCommands() {
     let commandString = '';
     if (_connectionStatus == 'connected' && _messageBuffer.length != 0) {
@@ -533,4 +633,86 @@ function sendCommands() {
         }
         connection.send(commandString);
     }
+    if (_connectionStatus == 'connected' && _recordCount != 0) {
+        connection.send(new Uint8Array(_records.buffer, 0, _recordCount * RECORD_SIZE));
+    }
+    _recordCount = 0;   // commands made while disconnected are stale
+}
+
+
+/*
+*
+* TELEMETRY
+*
+*/
+// show state pushed by the prop, see include/Telemetry.h
+// fields in frame order: name, bytes, signed
+const TELEMETRY_FIELDS = [
+  ['state', 1, false],
+  ['cue', 2, true],
+  ['scene', 1, false],
+  ['sceneElapsed', 4, false],
+  ['outputs', 1, false],
+  ['track', 2, false],
+  ['playing', 1, false],
+  ['volume', 1, false],
+  ['playerTimeouts', 2, false],
+  ['playerBadFrames', 2, false],
+  ['loopRate', 2, false],
+  ['loopGapMax', 4, false],
+  ['sequence', 2, false],
+  ['clients', 1, false],
+  ['playerDropped', 2, false]
+];
+const TELEMETRY_DELTA = 0xD0;
+const TELEMETRY_KEYFRAME = 0xD1;
+const STATE_NAMES = ['Stopped', 'Idling', 'Performing', 'Starting'];
+
+let telemetry = null;   // null until the first keyframe
+
+function decodeTelemetry(view) {
+  let type = view.getUint8(0);
+  if (type == TELEMETRY_KEYFRAME) {
+    telemetry = {};
+  } else if (type != TELEMETRY_DELTA || telemetry == null) {
+    return;
+  }
+  let mask = view.getUint16(1, true);
+  let offset = 3;
+  TELEMETRY_FIELDS.forEach(([name, size, signed], i) => {
+    if (!(mask & (1 << i))) return;
+    if (size == 1) {
+      telemetry[name] = signed ? view.getInt8(offset) : view.getUint8(offset);
+    } else if (size == 2) {
+      telemetry[name] = signed ? view.getInt16(offset, true) : view.getUint16(offset, true);
+    } else {
+      telemetry[name] = signed ? view.getInt32(offset, true) : view.getUint32(offset, true);
+    }
+    offset += size;
+  });
+}
+
+function drawTelemetry(context) {
+  let lines = ['Prop: ' + _connectionStatus];
+  if (telemetry != null) {
+    lines.push(
+      'State: ' + (STATE_NAMES[telemetry.state] || telemetry.state) +
+        (telemetry.cue >= 0 ? ', cue ' + telemetry.cue : ''),
+      'Scene: ' + telemetry.scene + ', ' + (telemetry.sceneElapsed / 1000).toFixed(1) + ' s in',
+      'Relays: ' + telemetry.outputs.toString(2).padStart(2, '0'),
+      'Sound: ' + (telemetry.playing ? 'playing ' : 'stopped, last ') + telemetry.track +
+        ', volume ' + telemetry.volume,
+      'Player: ' + telemetry.playerTimeouts + ' timeouts, ' + telemetry.playerBadFrames + ' bad frames, ' +
+        telemetry.playerDropped + ' dropped',
+      'Loop: ' + (telemetry.loopRate == 0xFFFF ? '65535+' : telemetry.loopRate) + '/s, max gap ' + telemetry.loopGapMax + ' us',
+      'Clients: ' + telemetry.clients + ', last command ' + telemetry.sequence
+    );
+  }
+  context.fillStyle = DEFAULT_COLOR;
+  context.font = DEFAULT_FONT_SIZE + "px sans-serif";
+  context.textAlign = "left";
+  context.textBaseline = "top";
+  lines.forEach((line, i) => {
+    context.fillText(line, canvas.width * 0.55, 10 + i * (DEFAULT_FONT_SIZE + 4));
+  });
 }
@@ -0,0 +1,79 @@
+/*
+ * AudioLayers.h
+ * Background bed plus prioritized one-shot effects on one DFPlayer.
+ *
+ * The DFPlayer plays one track at a time, but advertise() inserts a file
+ * from the ADVERT folder over the playing track, which pauses and resumes
+ * by itself once the insert is over. AudioLayers uses that for two layers:
+ *
+ *   bed      the main track, a loop like the hum or a one-shot like the
+ *            charging sound, from play(), loop() and stop()
+ *   effects  short inserts over the bed, from effect(), each with a length,
+ *            a priority and how long it may wait
+ *
+ * An effect asked for while another plays cuts it off if its priority is
+ * higher, otherwise waits for it in a small queue, highest priority first,
+ * or is dropped once its wait is up. The module sends no event when an
+ * insert ends, so effects are timed by their length. With no bed playing
+ * there is nothing to insert into and effects are dropped, and so is one
+ * the player's full command queue turns away: unlike the bed's commands,
+ * which PlayerState sends again, an insert is only worth it on time.
+ *
+ * Only the commands that change something are sent: one advertise() per
+ * effect, none when an effect ends, none for a loop() of the bed already
+ * looping. Nothing here blocks, update() starts queued effects.
+ */
+
+#ifndef AUDIO_LAYERS_H
+#define AUDIO_LAYERS_H
+
+#include <Arduino.h>
+#include "PlayerState.h"
+
+#define AUDIO_QUEUE_SIZE 4            // effects waiting for the one playing
+
+class AudioLayers {
+  struct Effect {
+    uint16_t file;                // ADVERT folder file, 0 = none
+    uint16_t ms;                  // length
+    uint8_t priority;             // higher cuts off lower
+    unsigned long until;          // millis(), playing: its end, queued: end of its wait
+  };
+
+  PlayerState& _player;
+  Effect _playing = {0, 0, 0, 0};
+  Effect _queue[AUDIO_QUEUE_SIZE];
+  uint8_t _queued = 0;
+
+  unsigned long _effects = 0;     // started
+  unsigned long _preempted = 0;   // cut off by a higher priority
+  unsigned long _dropped = 0;     // no bed, queue full, wait over or the player's queue full
+
+  bool start(const Effect& effect, unsigned long now);
+  void enqueue(const Effect& effect);
+
+  public:
+  AudioLayers(PlayerState& player) : _player(player) {}
+
+  // bed layer; a new bed ends the effect over the old one
+  void play(uint16_t track);
+  void loop(uint16_t track);
+  void playFolder(uint8_t folder, uint16_t file);
+  void stop();                    // bed, effect and queue
+
+  // effect layer: file from the ADVERT folder, its length, priority and
+  // ms it may wait for the effect ahead of it, 0 = now or never; false if
+  // it was dropped
+  bool effect(uint16_t file, uint16_t ms, uint8_t priority, uint16_t maxWaitMs = 0);
+  void clearEffects();            // stop the effect and empty the queue
+
+  // ends effects and starts queued ones, never blocks
+  void update(unsigned long now);
+
+  bool effectPlaying() { return _playing.file != 0; }
+  unsigned long effects() { return _effects; }
+  unsigned long preempted() { return _preempted; }
+  unsigned long dropped() { return _dropped; }
+};
+
+#endif
@@ -0,0 +1,68 @@
+/*
+ * ClockSync.h
+ * Estimates a master prop's micros() clock from its beacons.
+ *
+ * Each beacon carries the master's micros() when it was sent, noted with
+ * the local micros() when it arrived. master - local is the clock offset
+ * plus the one-way delay, so over a window of SYNC_WINDOW beacons the
+ * largest difference, the least delayed beacon, is taken as the offset.
+ * The change of the window offset over SYNC_DRIFT_MIN_MS or more gives the
+ * drift between the two crystals, kept as a running average in parts per
+ * billion and applied between windows.
+ *
+ * The first beacon locks the estimate at once, later windows refine it.
+ * What remains is the shortest one-way delay, which cannot be seen with
+ * one-way beacons; on one WiFi network it is about the same for every
+ * follower, so followers stay together even though all lag the master by
+ * it. Beacons older than SYNC_LOST_MS make the estimate unlocked again.
+ */
+
+#ifndef CLOCK_SYNC_H
+#define CLOCK_SYNC_H
+
+#include <Arduino.h>
+
+#define SYNC_WINDOW 8                 // beacons per offset estimate
+#define SYNC_DRIFT_MAX_PPB 200000L    // crystals are within 100 ppm, anything beyond is a bad window
+#define SYNC_DRIFT_WEIGHT 4           // new drift estimates count 1/weight
+#define SYNC_DRIFT_MIN_MS 10000       // shortest span drift is measured over
+#define SYNC_DRIFT_SPAN_MS 120000     // the span starts over after this
+#define SYNC_LOST_MS 5000
+
+class ClockSync {
+  bool _locked = false;
+  unsigned long _refLocal = 0;    // local micros() the offset was measured at
+  long _offset = 0;               // master - local at _refLocal, us
+  long _driftPpb = 0;             // master gains this much on local
+  unsigned long _lastBeacon = 0;  // local micros()
+
+  uint8_t _samples = 0;           // beacons in the current window
+  long _best = 0;                 // largest master - local in the window
+  unsigned long _bestLocal = 0;
+  bool _havePrevious = false;     // a window has completed before
+  unsigned long _anchorLocal = 0; // window drift is measured from
+  long _anchorOffset = 0;
+  unsigned long _beacons = 0;
+
+  long drifted(unsigned long local);
+
+  public:
+  // a beacon sent at master micros() arrived at local micros()
+  void beacon(uint32_t master, unsigned long local);
+
+  // forget the master, such as when another one takes over
+  void reset();
+
+  // true once a beacon has come in and the last one is recent
+  bool locked(unsigned long now);
+
+  // master micros() at local micros() and back
+  uint32_t toMaster(unsigned long local);
+  unsigned long toLocal(uint32_t master);
+
+  long offset() { return _offset; }
+  long drift() { return _driftPpb; }
+  unsigned long beacons() { return _beacons; }
+};
+
+#endif
@@ -0,0 +1,102 @@
+/*
+ * ControlProtocol.h
+ * Show commands sent by the browser controller.
+ *
+ * ui.js batches its messages into one WebSocket text frame per animation
+ * frame, each message followed by ";". ControlParser walks such a frame in
+ * place and returns the commands it knows, without copying or allocating:
+ *
+ *   trigger         start the show from the beginning
+ *   abort           stop the show, relays off
+ *   scene=<n>       start the show at scene n, see Timeline::start()
+ *   volume=<n>      DFPlayer volume, 0 to 30
+ *   --heartbeat--   keepalive, answered with the same text
+ *
+ * Anything else (such as the "Connect <date>" greeting) is skipped and
+ * counted.
+ *
+ * ui.js sends its commands as binary frames instead, a batch of fixed
+ * CONTROL_RECORD_SIZE byte records, little endian:
+ *
+ *   uint8 command   controlCommand
+ *   uint8 channel   UI element, for CONTROL_JOYSTICK
+ *   uint16 sequence counts up per record from 1 on each connection, 0 is
+ *                   skipped when it wraps
+ *   int16 value0    scene, volume or joystick x
+ *   int16 value1    joystick y
+ *
+ * The browser keeps only the latest joystick or volume value per channel
+ * in each batch. BinaryControlParser reads a batch in place, like
+ * ControlParser; records with an unknown command or bad value are skipped
+ * and counted, a frame that is not a whole number of records is rejected.
+ */
+
+#ifndef CONTROL_PROTOCOL_H
+#define CONTROL_PROTOCOL_H
+
+#include <Arduino.h>
+
+#define CONTROL_HEARTBEAT_TEXT "--heartbeat--"  // HEARTBEAT_MESSAGE in ui.js
+
+enum controlCommand : uint8_t {
+  CONTROL_NONE,
+  CONTROL_TRIGGER,
+  CONTROL_ABORT,
+  CONTROL_SCENE,      // argument: scene
+  CONTROL_VOLUME,     // argument: volume
+  CONTROL_HEARTBEAT,
+  CONTROL_JOYSTICK    // channel: joystick, x and y: position
+};
+
+#define CONTROL_RECORD_SIZE 8
+#define CONTROL_JOYSTICK_MAX 1000   // joystick x and y run from -max to max
+
+struct ControlCommand {
+  uint8_t type;       // controlCommand
+  uint8_t channel;
+  uint16_t sequence;  // binary records only, 0 for text
+  uint16_t argument;  // scene or volume
+  int16_t x;          // joystick position
+  int16_t y;
+};
+
+// true for commands where only the latest value matters
+inline bool controlCoalesces(uint8_t type) {
+  return type == CONTROL_VOLUME || type == CONTROL_JOYSTICK;
+}
+
+class ControlParser {
+  const char* _text;
+  size_t _length;
+  size_t _position = 0;
+  uint8_t _unknown = 0;
+
+  bool parse(const char* message, size_t length, ControlCommand& command);
+
+  public:
+  ControlParser(const char* text, size_t length) : _text(text), _length(length) {}
+
+  // next known command in the frame, false at its end
+  bool next(ControlCommand& command);
+
+  // messages skipped so far
+  uint8_t unknown() { return _unknown; }
+};
+
+class BinaryControlParser {
+  const uint8_t* _data;
+  size_t _length;
+  size_t _position = 0;
+  uint8_t _unknown = 0;
+
+  public:
+  BinaryControlParser(const uint8_t* data, size_t length);
+
+  // next valid record in the frame, false at its end
+  bool next(ControlCommand& command);
+
+  // records skipped so far, a rejected frame counts as one
+  uint8_t unknown() { return _unknown; }
+};
+
+#endif
@@ -0,0 +1,107 @@
+/*
+ * ControlServer.h
+ * Web controller for the prop.
+ *
+ * Serves the browser UI from LittleFS over HTTP and takes show commands
+ * from it over a WebSocket on /ws, both through ESPAsyncWebServer. Requests
+ * are handled in the network stack's callbacks, never in loop(). Incoming
+ * frames, text or binary (see ControlProtocol.h), are only parsed there:
+ * the commands go into a small queue that loop() empties with read(), so a
+ * busy or stuck client cannot hold up the show. A volume or joystick
+ * command replaces one for the same channel still waiting in the queue.
+ * Heartbeats are answered right away.
+ *
+ * push() sends Telemetry frames to every client. Each client gets its own
+ * copy, which the library frees once it is sent; a buffer from makeBuffer()
+ * shared between clients is only freed by textAll() and binaryAll(), which
+ * cannot send a delta to some clients and a keyframe to others, so it would
+ * leak a block per push. A client whose send queue is full
+ * skips the frame and gets a keyframe once it has room again, so a slow
+ * client only ever costs a canSend() check.
+ *
+ * On the ESP8266 the callbacks run between loop() passes, never in the
+ * middle of one, which is what lets them rewrite a queued command.
+ *
+ * Static files are served gzipped when a .gz copy exists next to them (see
+ * tools/gzip_data.py) and may be cached by the browser for
+ * CONTROL_CACHE_CONTROL.
+ */
+
+#ifndef CONTROL_SERVER_H
+#define CONTROL_SERVER_H
+
+#include <Arduino.h>
+#include <FS.h>
+#include <ESPAsyncWebServer.h>
+#include "ControlProtocol.h"
+#include "Telemetry.h"
+
+#define CONTROL_PORT 80
+#define CONTROL_WS_PATH "/ws"
+#define CONTROL_QUEUE_SIZE 8                    // commands waiting for loop()
+#define CONTROL_CACHE_CONTROL "max-age=86400"
+#define CONTROL_CLEANUP_MS 1000                 // how often closed clients are freed
+#define CONTROL_MAX_CLIENTS 8                   // DEFAULT_MAX_WS_CLIENTS of the ESP8266 library
+
+class ControlServer {
+  AsyncWebServer _server;
+  AsyncWebSocket _socket;
+
+  struct Client {
+    AsyncWebSocketClient* client;   // nullptr = free slot
+    bool synced;                    // has every frame since its last keyframe
+  };
+  Client _clients[CONTROL_MAX_CLIENTS] = {};
+
+  // single producer (network callbacks), single consumer (loop)
+  ControlCommand _queue[CONTROL_QUEUE_SIZE];
+  volatile uint8_t _head = 0;   // advanced by read()
+  volatile uint8_t _tail = 0;   // advanced by the network callbacks
+
+  unsigned long _cleanedAt = 0;
+  unsigned long _received = 0;
+  unsigned long _dropped = 0;
+  unsigned long _unknown = 0;
+  unsigned long _coalesced = 0;
+  uint16_t _sequence = 0;       // of the last binary record
+  unsigned long _pushed = 0;
+  unsigned long _pushDropped = 0;
+
+  void onEvent(AsyncWebSocketClient* client, AwsEventType type, void* arg, uint8_t* data, size_t length);
+  template <class Parser>
+  void receive(AsyncWebSocketClient* client, Parser& parser);
+  void queue(const ControlCommand& command);
+
+  public:
+  ControlServer();
+
+  // start serving, WiFi must already be up
+  void begin(FS& fs);
+
+  // next command from a client, false if there is none
+  bool read(ControlCommand& command);
+
+  // housekeeping, call from loop(), never blocks
+  void update(unsigned long now);
+
+  uint32_t clients();
+
+  // send telemetry, the delta only if changed, never blocks
+  void push(Telemetry& telemetry, bool changed);
+
+  // commands taken from clients, lost to a full queue, replaced by a newer
+  // value while queued, and unknown messages
+  unsigned long received() { return _received; }
+  unsigned long dropped() { return _dropped; }
+  unsigned long coalesced() { return _coalesced; }
+  unsigned long unknown() { return _unknown; }
+
+  // sequence number of the last binary record received
+  uint16_t sequence() { return _sequence; }
+
+  // telemetry frames sent, and skipped for clients that fell behind
+  unsigned long pushed() { return _pushed; }
+  unsigned long pushDropped() { return _pushDropped; }
+};
+
+#endif
@@ -0,0 +1,58 @@
+/*
+ * Debouncer.h
+ * Non-blocking debouncer for switch inputs.
+ *
+ * Each attached pin is sampled once per update() call and compared against
+ * millis(). A new level only becomes the stable state after the pin has held
+ * it for the whole debounce time, so update() never waits on a pin.
+ * Edges found along the way are latched as events until read with events().
+ */
+
+#ifndef DEBOUNCER_H
+#define DEBOUNCER_H
+
+#include <Arduino.h>
+
+#define DEBOUNCER_MAX_INPUTS 4    // number of switches that can be attached
+
+// event flags returned by events()
+#define DEBOUNCE_RISING 0x01      // stable state went LOW -> HIGH
+#define DEBOUNCE_FALLING 0x02     // stable state went HIGH -> LOW
+#define DEBOUNCE_LONG_PRESS 0x04  // stable HIGH held for the long press time
+
+class Debouncer {
+  struct Input {
+    uint8_t pin;
+    uint8_t stable;             // debounced level
+    uint8_t raw;                // last sampled level
+    uint8_t events;             // latched event flags
+    bool longPressed;           // long press already reported for this press
+    uint16_t debounceTime;      // ms the raw level must hold
+    uint16_t longPressTime;     // ms HIGH before DEBOUNCE_LONG_PRESS, 0 = off
+    unsigned long changedAt;    // when raw level last changed
+    unsigned long stableAt;     // when stable level last changed
+  };
+
+  Input _inputs[DEBOUNCER_MAX_INPUTS];
+  uint8_t _count = 0;
+  unsigned long _lastSample = 0;
+
+  Input* find(uint8_t pin);
+
+  public:
+
+  // start tracking a pin, its current level becomes the stable state
+  bool attach(uint8_t pin, uint16_t debounceTime, uint16_t longPressTime = 0);
+
+  // sample all pins, call once per loop()
+  void update();
+  void update(unsigned long now);
+
+  // debounced level of a pin, LOW if the pin is not attached
+  uint8_t read(uint8_t pin);
+
+  // returns and clears the latched event flags of a pin
+  uint8_t events(uint8_t pin);
+};
+
+#endif
@@ -0,0 +1,101 @@
+/*
+ * DmxOutput.h
+ * DMX512 transmitter on a TX-only UART through an RS-485 driver (MAX485).
+ *
+ * Frames go out back to back: a break, the mark after break, the start
+ * code 0 and the channel slots at 250 kbaud, 8N2. The break is the byte 0
+ * sent at DMX_BREAK_BAUD, which holds the line low for 9 bits, 108 us, and
+ * its two stop bits make a 24 us mark after break. update() hands the UART
+ * as many bytes as its TX FIFO takes without waiting and switches the baud
+ * rate once the line is idle, worked out from what it wrote, so a frame is
+ * spread over many loop() passes and never holds one up. A full 512
+ * channel frame takes 22.7 ms, 44 frames per second when loop() comes by
+ * at least every 5.6 ms (a FIFO of slots); slower passes stretch the gaps
+ * between slots, which DMX allows, and lower the frame rate. Short frames
+ * are held to DMX_MIN_FRAME_US apart.
+ *
+ * Channels are numbered 1 to 512 like DMX addresses. set() edits a second
+ * buffer, commit() hands it to the next frame as a whole, so a frame never
+ * carries half an update. fade() moves a channel to a level over a time
+ * along an Envelope curve, recomputed at every frame from the frame's
+ * start time; set() on a channel ends its fade.
+ */
+
+#ifndef DMX_OUTPUT_H
+#define DMX_OUTPUT_H
+
+#include <Arduino.h>
+#include "Envelope.h"
+
+#define DMX_CHANNELS 512
+#define DMX_BAUD 250000
+#define DMX_BREAK_BAUD 83333
+#define DMX_FIFO_SIZE 128           // UART TX FIFO
+#define DMX_BYTE_US 44              // 11 bits at DMX_BAUD
+#define DMX_BREAK_BYTE_US 132       // 11 bits at DMX_BREAK_BAUD
+#define DMX_MIN_FRAME_US 1204       // break to break, the least DMX512 allows
+#define DMX_FADES 16                // channels fading at the same time
+
+class DmxOutput {
+  enum dmxState : uint8_t {
+    DMX_OFF,
+    DMX_DATA,         // slots going into the FIFO
+    DMX_DRAIN,        // waiting for the last slot to leave the line
+    DMX_BREAK         // waiting for the break byte to leave the line
+  };
+
+  struct Fade {
+    uint16_t channel;           // 0 = free
+    Envelope envelope;
+  };
+
+  HardwareSerial* _uart = nullptr;
+  uint16_t _channels = DMX_CHANNELS;
+  uint8_t _frame[DMX_CHANNELS + 1];     // start code and slots, as on the wire
+  uint8_t _next[DMX_CHANNELS];          // set() edits, commit() publishes
+  bool _committed = false;
+  Fade _fades[DMX_FADES];
+
+  dmxState _state = DMX_OFF;
+  uint16_t _sent = 0;                   // bytes of _frame in the FIFO
+  unsigned long _idleAt = 0;            // micros() the line goes idle
+
+  unsigned long _frames = 0;
+  unsigned long _frameAt = 0;           // micros() of the last frame start
+  unsigned long _period = 0;            // us, last frame start to frame start
+  unsigned long _maxPeriod = 0;
+
+  void send(const uint8_t* data, uint16_t length, unsigned long byteTime);
+  bool idle(unsigned long now);
+  void startFrame(unsigned long now);
+  void cancelFade(uint16_t channel);
+
+  public:
+  // take over uart, which must not be used for anything else; channels is
+  // the number of slots per frame, fewer make frames shorter and faster
+  void begin(HardwareSerial& uart, uint16_t channels = DMX_CHANNELS);
+
+  // keep the frames going, never blocks; now is micros()
+  void update();
+  void update(unsigned long now);
+
+  // channel 1 to DMX_CHANNELS, takes effect on commit()
+  void set(uint16_t channel, uint8_t level);
+  uint8_t get(uint16_t channel);
+
+  // send the set() levels from the next frame on
+  void commit();
+
+  // move a channel from its current level to level over ms from now along
+  // an envelopeCurve, frames carry it whether committed or not; without a
+  // free fade slot it jumps there with the next commit()
+  void fade(uint16_t channel, uint8_t level, unsigned long ms, uint8_t curve = CURVE_LINEAR);
+  bool fading();
+
+  unsigned long frames() { return _frames; }
+  unsigned long period() { return _period; }
+  unsigned long maxPeriod() { return _maxPeriod; }
+  void resetStats() { _maxPeriod = 0; }
+};
+
+#endif
@@ -0,0 +1,58 @@
+/*
+ * Envelope.h
+ * Fixed-point ramps from one level to another over a time.
+ *
+ * An Envelope runs from a start level to an end level along a curve:
+ * linear, exponential (slow start, fast end, for levels heard or seen on a
+ * log scale) or ease-in/out. Time is counted in 1024 us ticks from
+ * micros() with a shift, progress is 8.24 fixed point from one multiply,
+ * and the curves are 33 point tables in PROGMEM, interpolated, so a value
+ * costs a few integer operations and no division or float.
+ *
+ * Used for DMX fades (DmxOutput) and DFPlayer volume ramps (PlayerState),
+ * which sample their envelopes as often as their output can take it.
+ */
+
+#ifndef ENVELOPE_H
+#define ENVELOPE_H
+
+#include <Arduino.h>
+
+#define ENVELOPE_TICK_SHIFT 10        // 1024 us
+#define ENVELOPE_PROGRESS_BITS 24     // progress 0 to 1 << 24
+#define ENVELOPE_CURVE_POINTS 33      // table entries, 32 segments
+
+enum envelopeCurve : uint8_t {
+  CURVE_LINEAR,
+  CURVE_EXPONENTIAL,
+  CURVE_EASE_IN_OUT,
+  CURVE_COUNT
+};
+
+// curve value 0 to 65535 at progress 0 to 65535
+uint16_t envelopeShape(uint8_t curve, uint16_t progress);
+
+class Envelope {
+  int16_t _from = 0;
+  int16_t _to = 0;
+  uint8_t _curve = CURVE_LINEAR;
+  bool _running = false;
+  unsigned long _startAt = 0;   // micros()
+  uint32_t _rate = 0;           // progress per tick
+  uint32_t _ticks = 0;          // length
+
+  public:
+  // ramp from from to to, levels 0 to 32767, over ms starting at now
+  // (micros); ramps shorter than a tick are at to right away
+  void start(int16_t from, int16_t to, unsigned long ms, uint8_t curve, unsigned long now);
+  void stop() { _running = false; }
+
+  // level at now (micros), the end level once the time is up, which also
+  // stops the envelope
+  int16_t value(unsigned long now);
+
+  bool running() { return _running; }
+  int16_t to() { return _to; }
+};
+
+#endif
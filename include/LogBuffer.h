@@ -0,0 +1,43 @@
+/*
+ * LogBuffer.h
+ * Non-blocking console output.
+ *
+ * Text printed to a LogBuffer is kept in a RAM ring and handed to the
+ * serial port by update(), only as much as the port's TX FIFO takes without
+ * waiting. When the ring is full new text is dropped and counted, so
+ * logging never holds up loop().
+ */
+
+#ifndef LOG_BUFFER_H
+#define LOG_BUFFER_H
+
+#include <Arduino.h>
+
+#define LOG_BUFFER_SIZE 512
+
+class LogBuffer : public Print {
+  Print& _out;
+  uint8_t _buffer[LOG_BUFFER_SIZE];
+  uint16_t _tail = 0;           // oldest byte not yet handed to _out
+  uint16_t _count = 0;
+  unsigned long _dropped = 0;
+
+  public:
+  LogBuffer(Print& out) : _out(out) {}
+
+  size_t write(uint8_t value) override;
+  size_t write(const uint8_t* buffer, size_t size) override;
+  using Print::write;
+  int availableForWrite() override { return LOG_BUFFER_SIZE - _count; }
+
+  // hand buffered text to the port as far as it takes it without waiting
+  void update();
+
+  // wait until all buffered text is out
+  void flush() override;
+
+  // bytes lost to a full buffer
+  unsigned long dropped() { return _dropped; }
+};
+
+#endif
@@ -0,0 +1,48 @@
+/*
+ * PlaybackTracker.h
+ * Follows what the DFPlayer plays from the events it sends back.
+ *
+ * The player reports the end of a track with a 0x3D frame, decoded by the
+ * driver as DFPlayerPlayFinished. PlayerState hands those events to
+ * finishedEvent() as they arrive, so show cues can wait for a sound to end
+ * instead of assuming its length.
+ */
+
+#ifndef PLAYBACK_TRACKER_H
+#define PLAYBACK_TRACKER_H
+
+#include <Arduino.h>
+
+// the module often sends the finished event twice, ignore finished events
+// this soon after starting a track so a repeat cannot end the new one
+#define PLAYBACK_MIN_TRACK_MS 300
+
+class PlaybackTracker {
+  uint16_t _track = 0;            // last track started, 0 = none yet
+  bool _playing = false;
+  bool _looping = false;
+  unsigned long _startedAt = 0;   // millis()
+  unsigned long _length = 0;      // ms the last finished track played
+
+  public:
+  // note the track just sent with play() or loop()
+  void started(uint16_t track, unsigned long now, bool looping = false);
+
+  // note stop(), the current track counts as finished
+  void stopped();
+
+  // a finished event for track arrived, true if it ended the current track
+  bool finishedEvent(uint16_t track, unsigned long now);
+
+  // true once track has been started and is no longer playing
+  bool finished(uint16_t track);
+
+  bool playing() { return _playing; }
+  bool looping() { return _playing && _looping; }
+  uint16_t track() { return _track; }
+
+  // ms the last finished track played, from started() to its finished event
+  unsigned long length() { return _length; }
+};
+
+#endif
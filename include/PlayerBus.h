@@ -0,0 +1,122 @@
+/*
+ * PlayerBus.h
+ * Several DFPlayers, one per speaker, driven from one task.
+ *
+ * Each channel is a DFPlayer on its own serial link with its own driver
+ * and PlayerState, so queues, ACKs, timeouts and the mirrored state are
+ * per channel and one slow or missing player does not hold up the others.
+ * The bus only decides when each of them may send:
+ *
+ *   receive()   events in on every channel, parses what already arrived
+ *   transmit()  at most one frame per pass, the channels taking turns, so
+ *               a busy channel cannot starve the others and a pass never
+ *               holds the CPU for more than one frame (about 10 ms on
+ *               SoftwareSerial at 9600)
+ *
+ * Commands for several channels that have to start together, say the
+ * machine and the monster starting a track on the same cue, are grouped:
+ * hold() the channels, then give the commands to their PlayerStates. hold()
+ * notes each driver's queueSequence(), so a channel's group frame is the
+ * first frame queued after it, whatever was queued before; a channel that
+ * got no frame (a command PlayerState skipped, a player offline) is left
+ * out of the group. The frames ahead of the group go out as usual. Once
+ * every channel in the group has its group frame next and is free to send,
+ * transmit() sends them one per pass on consecutive passes, nothing else in
+ * between. The first and the last start at most skewBoundUs() apart:
+ * (channels - 1) * (PLAYER_BUS_FRAME_US + PLAYER_BUS_PASS_US), a frame and
+ * the rest of a loop() pass for each channel after the first. The skew of
+ * each group is measured and reported against it.
+ */
+
+#ifndef PLAYER_BUS_H
+#define PLAYER_BUS_H
+
+#include <Arduino.h>
+#include "DFRobotDFPlayerMini.h"
+#include "PlayerState.h"
+
+#define PLAYER_BUS_CHANNELS 3
+#define PLAYER_BUS_NONE 0xFF          // from add() when the bus is full
+#define PLAYER_BUS_FRAME_US 10500     // a 10 byte frame at 9600 baud and the call around it
+#define PLAYER_BUS_PASS_US 1000       // the rest of a loop() pass between two frames of a group
+
+class PlayerBus {
+  struct Channel {
+    const char* name;
+    DFRobotDFPlayerMini* driver;
+    PlayerState* state;
+    uint16_t finished;            // track that finished in the last receive()
+    playerLink link;
+    bool linkChanged;
+    uint32_t mark;                // driver's queueSequence() at hold(), its group frame
+    unsigned long dropped;        // driver's queueDropped() as of the last newlyDropped()
+
+    unsigned long sends;          // since resetStats()
+    uint32_t sendUs;
+    uint32_t maxSendUs;
+    unsigned long frames;         // the driver's counts at holdStats()
+    unsigned long ackUs;
+    unsigned long timeouts;
+  };
+
+  Channel _channels[PLAYER_BUS_CHANNELS];
+  uint8_t _count = 0;
+  uint8_t _next = 0;              // first channel asked on the next pass
+  uint8_t _holding = 0;           // bit n = channel n held, not known yet if it got a frame
+  uint8_t _group = 0;             // bit n = channel n has a group frame still to send
+  uint8_t _released = 0;          // group frames sent so far
+  unsigned long _releasedAt = 0;  // micros() the first of them started
+
+  unsigned long _groups = 0;      // since resetStats()
+  uint32_t _lastSkewUs = 0;
+  uint32_t _maxSkewUs = 0;
+  bool _held = false;
+
+  bool send(Channel& channel);
+  void join();
+  bool groupReady();
+  bool releaseNext();
+
+  public:
+  // channels in the order they are added, 0 first; the driver's queue has
+  // to be enabled
+  uint8_t add(const char* name, DFRobotDFPlayerMini& driver, PlayerState& state);
+
+  void receive(unsigned long now);
+  // true if a frame went out
+  bool transmit();
+
+  // channels is a bit mask, bit n = channel n; the first command given to
+  // each of their PlayerStates until the next transmit() starts together
+  void hold(uint8_t channels);
+
+  uint8_t channels() { return _count; }
+  const char* name(uint8_t channel) { return _channels[channel].name; }
+  PlayerState& player(uint8_t channel) { return *_channels[channel].state; }
+  DFRobotDFPlayerMini& driver(uint8_t channel) { return *_channels[channel].driver; }
+  uint16_t finished(uint8_t channel) { return _channels[channel].finished; }
+  // true once per change of the channel's startup handshake
+  bool linkChanged(uint8_t channel);
+  // frames the channel's full queue turned away since the last call
+  unsigned long newlyDropped(uint8_t channel);
+
+  void resetStats();
+  // stop counting until resetStats(), so a report printed a line at a time
+  // covers what came before it
+  void holdStats();
+  unsigned long sends();          // all channels
+  uint32_t meanSendUs();
+  uint32_t maxSendUs();
+  unsigned long groups() { return _groups; }
+  uint32_t lastSkewUs() { return _lastSkewUs; }
+  uint32_t maxSkewUs() { return _maxSkewUs; }
+  uint32_t skewBoundUs() { return _count > 1 ? (_count - 1) * (PLAYER_BUS_FRAME_US + PLAYER_BUS_PASS_US) : 0; }
+  // one line per channel: frames, sends, ACK round trip and timeouts, then
+  // the groups and their skew
+  void report(Print& out);
+  // the same, one line at a time, 0 to reportLines() - 1
+  uint8_t reportLines() { return _count + 1; }
+  void reportLine(Print& out, uint8_t line);
+};
+
+#endif
@@ -0,0 +1,56 @@
+/*
+ * PlayerFrames.h
+ * DFPlayer command frames built by the compiler, for PlayerState.
+ *
+ * The commands PlayerState sends most are constants or take a small
+ * argument: stop, reset, the background queries, volume 0 to 30 for every
+ * ramp step, play, loop and advertise of the first few tracks. Their frames
+ * are built here with dfPlayerFrame(), checksums included, and kept in
+ * PROGMEM, so sending one is a copy and a write instead of filling in the
+ * driver's frame and adding up its checksum. Other arguments go the usual
+ * way through the driver's API.
+ *
+ * The frames ask for an ACK, as the driver does after begin() with isACK.
+ * test/test_frames checks that they match what the driver builds.
+ * Only include where the frames are used, each file gets its own copy.
+ */
+
+#ifndef PLAYER_FRAMES_H
+#define PLAYER_FRAMES_H
+
+#include <Arduino.h>
+#include "DFRobotDFPlayerMini.h"
+
+#define PLAYER_FRAME_TRACKS 8     // play, loop and advertise frames for tracks 1 to 8
+#define PLAYER_FRAME_VOLUMES 31   // volume 0 to 30
+
+// the example frame from the DFPlayer manual, play track 1 without ACK
+static_assert(dfPlayerFrame(0x03, 1, false).bytes[7] == 0xFE && dfPlayerFrame(0x03, 1, false).bytes[8] == 0xF7,
+              "dfPlayerFrame() checksum");
+
+static const DFPlayerFrame stopFrame PROGMEM = dfPlayerFrame(0x16);
+static const DFPlayerFrame stopAdvertiseFrame PROGMEM = dfPlayerFrame(0x15);
+static const DFPlayerFrame resetFrame PROGMEM = dfPlayerFrame(0x0C);
+
+#define TRACK_FRAMES(command) \
+  {dfPlayerFrame(command, 1), dfPlayerFrame(command, 2), dfPlayerFrame(command, 3), dfPlayerFrame(command, 4), \
+   dfPlayerFrame(command, 5), dfPlayerFrame(command, 6), dfPlayerFrame(command, 7), dfPlayerFrame(command, 8)}
+static const DFPlayerFrame playFrames[PLAYER_FRAME_TRACKS] PROGMEM = TRACK_FRAMES(0x03);
+static const DFPlayerFrame loopFrames[PLAYER_FRAME_TRACKS] PROGMEM = TRACK_FRAMES(0x08);
+static const DFPlayerFrame advertiseFrames[PLAYER_FRAME_TRACKS] PROGMEM = TRACK_FRAMES(0x13);
+#undef TRACK_FRAMES
+
+#define VOLUME_FRAMES(volume) \
+  dfPlayerFrame(0x06, volume), dfPlayerFrame(0x06, volume + 1), dfPlayerFrame(0x06, volume + 2), \
+  dfPlayerFrame(0x06, volume + 3), dfPlayerFrame(0x06, volume + 4), dfPlayerFrame(0x06, volume + 5)
+static const DFPlayerFrame volumeFrames[PLAYER_FRAME_VOLUMES] PROGMEM = {
+  VOLUME_FRAMES(0), VOLUME_FRAMES(6), VOLUME_FRAMES(12), VOLUME_FRAMES(18), VOLUME_FRAMES(24), dfPlayerFrame(0x06, 30)
+};
+#undef VOLUME_FRAMES
+
+// background queries, in the order of playerQueries in src/PlayerState.cpp
+static const DFPlayerFrame queryFrames[] PROGMEM = {
+  dfPlayerFrame(0x42), dfPlayerFrame(0x43), dfPlayerFrame(0x44), dfPlayerFrame(0x48)
+};
+
+#endif
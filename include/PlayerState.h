@@ -0,0 +1,191 @@
+/*
+ * PlayerState.h
+ * Cached mirror of the DFPlayer's settings and play state.
+ *
+ * The driver's readVolume(), readState() etc. send a query and block until
+ * the answer arrives, tens of ms or more at 9600 baud. PlayerState keeps
+ * the values instead, taken from the commands sent through it and from the
+ * events the player sends back, and answers from the cache right away.
+ * Values that are not known, after begin(), a player reset or a lost frame,
+ * are queried in the background, one at a time, whenever the link is idle.
+ *
+ * Commands that would not change anything, such as setting the volume it
+ * already has, are not sent at all.
+ *
+ * ramp() moves the volume along an Envelope. A step is only sent while the
+ * driver's command queue is empty and at most every PLAYER_RAMP_INTERVAL_MS,
+ * so a ramp takes what the 9600 baud link has to spare and never backs up
+ * the commands of the show.
+ *
+ * The driver drops a frame its full queue has no room for. The cache only
+ * takes a command the driver accepted, and the ones that matter, the play
+ * state, volume and EQ, are sent again from update() once the queue has
+ * room, the latest of each kind; a newer command of the same kind replaces
+ * one still waiting. Queries are simply asked again, advertise() reports a
+ * drop to its caller. A show's cues are sized to fit (PLAYER_CUE_FRAMES),
+ * so this is for bursts from the controller page or a slow player.
+ *
+ * begin() starts the player in the background instead of the driver's
+ * blocking begin(): it queues a reset and waits in update() for the module
+ * to report its card online. Without that in PLAYER_BOOT_TIMEOUT_MS it
+ * tries again after a backoff that doubles from PLAYER_RETRY_MS up to
+ * PLAYER_RETRY_MAX_MS. A card removed takes it back there. Until ready()
+ * commands are dropped, so the show runs without sound rather than not at
+ * all, and readyAt() keeps the millis() from boot it took.
+ *
+ * PlayerState consumes every player event, so all commands and reads go
+ * through it rather than the driver.
+ */
+
+#ifndef PLAYER_STATE_H
+#define PLAYER_STATE_H
+
+#include <Arduino.h>
+#include "DFRobotDFPlayerMini.h"
+#include "PlaybackTracker.h"
+#include "Envelope.h"
+
+// values held by the mirror, for known() and refresh()
+#define PLAYER_VOLUME 0x01
+#define PLAYER_EQ 0x02
+#define PLAYER_PLAY_STATE 0x04
+#define PLAYER_FILE_COUNT 0x08
+#define PLAYER_ALL 0x0F
+
+#define PLAYER_QUERY_TIMEOUT_MS 1000  // ask again if an answer has not come by then
+#define PLAYER_RAMP_INTERVAL_MS 50    // a volume frame and its ACK take about 25 ms
+#define PLAYER_BOOT_TIMEOUT_MS 3000   // reset to card online, 1.5 s or so with a good card
+#define PLAYER_RETRY_MS 1000          // first wait before another reset, doubles
+#define PLAYER_RETRY_MAX_MS 16000
+
+// frames a show's cues may queue at the same time, leaving room in the
+// driver's queue for a background query and the frame on the line
+#define PLAYER_CUE_FRAMES (DFPLAYER_QUEUE_SIZE - 2)
+
+// startup handshake, see begin()
+enum playerLink : uint8_t {
+  PLAYER_OFFLINE,   // waiting to retry
+  PLAYER_BOOTING,   // reset sent, waiting for card online
+  PLAYER_READY
+};
+
+class PlayerState {
+  DFRobotDFPlayerMini& _player;
+  PlaybackTracker _playback;
+
+  uint8_t _known = 0;           // values set by a command or a query answer
+  uint8_t _stale = 0;           // values to query once the link is idle
+  uint8_t _volume = 0;
+  uint8_t _eq = 0;
+  uint16_t _fileCount = 0;
+  uint8_t _wanted = 0;          // PLAYER_VOLUME, PLAYER_EQ asked for, for restore()
+  uint8_t _wantedVolume = 0;    // last volume() or ramp() target
+  uint8_t _wantedEq = 0;
+
+  uint8_t _query = 0;           // command of the query in flight, 0 = none
+  unsigned long _queriedAt = 0;
+  uint8_t _answered = 0;        // command of an ask() answer not taken yet
+  uint16_t _answer = 0;
+  unsigned long _skipped = 0;
+
+  uint8_t _retry = 0;           // PLAYER_PLAY_STATE, PLAYER_VOLUME, PLAYER_EQ to send again
+  uint8_t _retryCommand = 0;    // play state command dropped: 0x03 play, 0x08 loop, 0x0F folder, 0x16 stop
+  uint8_t _retryFolder = 0;
+  uint16_t _retryFile = 0;
+  unsigned long _retried = 0;
+
+  Envelope _ramp;
+  unsigned long _rampSentAt = 0;  // millis()
+  unsigned long _rampSteps = 0;
+
+  playerLink _link = PLAYER_OFFLINE;
+  unsigned long _linkAt = 0;      // millis() of the last reset or timeout
+  unsigned long _backoff = PLAYER_RETRY_MS;
+  unsigned long _readyAt = 0;     // millis()
+  unsigned long _bootFailures = 0;
+
+  void answer(uint8_t command, uint16_t value);
+  void forget(uint8_t values);
+  void playStateSent();
+  void refresh(unsigned long now);
+  void rampStep(unsigned long now);
+  void sendVolume(uint8_t volume);
+  void retry();
+  void playDropped(uint8_t command, uint8_t folder, uint16_t file);
+  void boot(unsigned long now);
+  void linkStep(unsigned long now);
+
+  public:
+  PlayerState(DFRobotDFPlayerMini& player) : _player(player) {}
+
+  // after the driver's begin() without reset and enableQueue(), nothing is
+  // known yet; starts the handshake, never blocks
+  void begin();
+
+  // take player events and send the next background query, never blocks
+  // returns the track that just finished or 0
+  uint16_t update(unsigned long now);
+
+  void play(uint16_t track);
+  void loop(uint16_t track);      // not sent if it already loops that track
+  void stop();
+
+  // file 1 to 3000 of folder 1 to 99 on the SD card, above file 255 only in
+  // folders 1 to 15
+  void playFolder(uint8_t folder, uint16_t file);
+
+  // insert file from the ADVERT folder over the playing track, which
+  // resumes after it; again while one plays replaces it; false if not
+  // sent, offline or the queue full
+  bool advertise(uint16_t file);
+  bool stopAdvertise();
+  void volume(uint8_t volume);    // 0 to 30, ends a ramp
+
+  // move the volume to volume over ms along an envelopeCurve
+  void ramp(uint8_t volume, unsigned long ms, uint8_t curve = CURVE_EASE_IN_OUT);
+  bool ramping() { return _ramp.running(); }
+  void EQ(uint8_t eq);
+
+  // send the volume and EQ last asked for again, even if asked for while
+  // the player was offline; for a player that came back from a reset in the
+  // middle of a show, a ramp still running carries on by itself
+  void restore();
+
+  // cached values, only meaningful once known()
+  uint8_t volume() { return _volume; }
+  uint8_t eq() { return _eq; }
+  uint16_t fileCount() { return _fileCount; }
+  bool known(uint8_t values) { return (_known & values) == values; }
+
+  // query values again in the background
+  void refresh(uint8_t values) { _stale |= values; }
+
+  // one-off 0x42..0x4F query for values not cached here, false if another
+  // query is in flight or the link is busy; the answer comes from answered()
+  // once, or never if it is lost (PLAYER_QUERY_TIMEOUT_MS)
+  bool ask(uint8_t command, uint16_t parameter = 0);
+  bool answered(uint8_t command, uint16_t& value);
+
+  PlaybackTracker& playback() { return _playback; }
+
+  // commands not sent because they would not change anything
+  unsigned long skipped() { return _skipped; }
+
+  // volume frames sent by ramps
+  unsigned long rampSteps() { return _rampSteps; }
+
+  // commands sent again after the driver's queue was full
+  unsigned long retried() { return _retried; }
+
+  // card online, commands go out
+  bool ready() { return _link == PLAYER_READY; }
+  playerLink link() { return _link; }
+  // millis() the player first came online, 0 = not yet
+  unsigned long readyAt() { return _readyAt; }
+  // resets without card online in time
+  unsigned long bootFailures() { return _bootFailures; }
+  // ms until the next reset while PLAYER_OFFLINE
+  unsigned long retryIn(unsigned long now) { return _backoff - (now - _linkAt); }
+};
+
+#endif
@@ -0,0 +1,126 @@
+/*
+ * Profiler.h
+ * Loop timing and hot path instrumentation.
+ *
+ * Build with -DPROFILER to enable. PROFILE_SCOPE(section) times the rest of
+ * the enclosing block with the CPU cycle counter and files the result in a
+ * fixed-bucket histogram for that section, PROFILE_COUNT(counter) and
+ * PROFILE_SET(counter, value) keep event counters. Without PROFILER the
+ * macros expand to nothing and no profiler object exists.
+ *
+ * A probe is two cycle counter reads, a count-leading-zeros and a handful
+ * of adds, no division and no lookup, so it can be used in ISRs. Sections
+ * recorded from an ISR must not also be recorded from loop().
+ *
+ * Bucket 0 holds runs under PROFILE_BUCKET_CYCLES, bucket n runs from
+ * PROFILE_BUCKET_CYCLES << (n - 1) up to twice that, the last bucket is
+ * open ended.
+ */
+
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#include <Arduino.h>
+
+#define PROFILE_BUCKETS 16
+#define PROFILE_BUCKET_SHIFT 7                        // 128 cycles, 1.6 us at 80 MHz
+#define PROFILE_BUCKET_CYCLES (1UL << PROFILE_BUCKET_SHIFT)
+
+// timed sections, keep in step with sectionNames in Profiler.cpp
+enum profileSection : uint8_t {
+  PROFILE_LOOP,           // one whole loop() pass
+  PROFILE_CONSOLE,        // LogBuffer::update()
+  PROFILE_SWITCHES,       // Debouncer::update()
+  PROFILE_PLAYER_EVENTS,  // PlayerState::update(), the driver's available()
+  PROFILE_PLAYER_SEND,    // DFRobotDFPlayerMini::poll(), sendStack()
+  PROFILE_TIMELINE,       // Timeline::update()
+  PROFILE_RELAY_WRITE,    // digitalWrite() of relay pins, in the timer ISR
+  PROFILE_FADES,          // DmxOutput fades, all DMX_FADES slots per frame
+  PROFILE_RAMPS,          // PlayerState volume ramp step
+  PROFILE_SECTION_COUNT
+};
+
+// counters, keep in step with counterNames in Profiler.cpp
+enum profileCounter : uint8_t {
+  PROFILE_PLAYER_TIMEOUTS,      // no answer from the DFPlayer in time
+  PROFILE_PLAYER_WRONG_STACK,   // bad frames from the DFPlayer
+  PROFILE_LOG_DROPPED,          // console bytes lost to a full LogBuffer
+  PROFILE_COUNTER_COUNT
+};
+
+#ifdef PROFILER
+
+#define PROFILE_CONCAT_(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_(a, b)
+#define PROFILE_SCOPE(section) ProfileScope PROFILE_CONCAT(profileScope, __LINE__)(section)
+#define PROFILE_COUNT(counter) profiler.count(counter)
+#define PROFILE_SET(counter, value) profiler.set(counter, value)
+
+class Profiler {
+  struct Section {
+    uint32_t count;
+    uint32_t maxCycles;
+    uint64_t totalCycles;
+    uint32_t buckets[PROFILE_BUCKETS];
+  };
+
+  Section _sections[PROFILE_SECTION_COUNT];
+  uint32_t _counters[PROFILE_COUNTER_COUNT];
+
+  public:
+  Profiler() { reset(); }
+
+  static inline uint32_t cycles() { return ESP.getCycleCount(); }
+
+  inline void record(uint8_t section, uint32_t cycles) {
+    Section& s = _sections[section];
+    uint32_t scaled = cycles >> PROFILE_BUCKET_SHIFT;
+    uint8_t bucket = scaled ? 32 - __builtin_clz(scaled) : 0;
+    s.buckets[bucket < PROFILE_BUCKETS ? bucket : PROFILE_BUCKETS - 1]++;
+    s.count++;
+    s.totalCycles += cycles;
+    if (cycles > s.maxCycles) {
+      s.maxCycles = cycles;
+    }
+  }
+
+  inline void count(uint8_t counter) { _counters[counter]++; }
+  inline void set(uint8_t counter, uint32_t value) { _counters[counter] = value; }
+
+  void reset();
+
+  // header line, one line per section: name, count, mean us, max us, then
+  // the buckets, followed by one name,value line per counter
+  void dumpCsv(Print& out);
+
+  // "PRF1", section count, bucket count, bucket shift, counter count, CPU
+  // MHz (one byte each), then per section count, mean cycles, max cycles
+  // and the buckets, then the counters, all uint32 little endian
+  void dumpBinary(Print& out);
+};
+
+// times its own lifetime
+class ProfileScope {
+  uint32_t _start;
+  uint8_t _section;
+
+  public:
+  inline explicit ProfileScope(uint8_t section) : _start(Profiler::cycles()), _section(section) {}
+  inline ~ProfileScope();
+};
+
+extern Profiler profiler;
+
+inline ProfileScope::~ProfileScope() {
+  profiler.record(_section, Profiler::cycles() - _start);
+}
+
+#else
+
+#define PROFILE_SCOPE(section)
+#define PROFILE_COUNT(counter)
+#define PROFILE_SET(counter, value)
+
+#endif
+
+#endif
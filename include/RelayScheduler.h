@@ -0,0 +1,91 @@
+/*
+ * RelayScheduler.h
+ * Hardware timer driven relay outputs.
+ *
+ * Relay edges are queued ahead of time with the micros() they are due at.
+ * The ESP8266 timer1 is armed one-shot for the earliest edge and its ISR
+ * writes the pins, so an edge lands on time whatever loop() is busy with.
+ * The ISR also records how late each edge was against its schedule.
+ *
+ * An edge can select a StrobePatterns pattern for the relays it turns on.
+ * While a pattern runs the timer also fires every PATTERN_TICK_US to clock
+ * the pattern out.
+ *
+ * The edge queue has a single producer (loop) and a single consumer (the
+ * timer ISR). Edges must be scheduled in time order.
+ */
+
+#ifndef RELAY_SCHEDULER_H
+#define RELAY_SCHEDULER_H
+
+#include <Arduino.h>
+#include "StrobePatterns.h"
+
+#define RELAY_SCHEDULER_OUTPUTS 8             // one bit per relay in an edge
+#define RELAY_SCHEDULER_EDGES 8               // edges queued ahead of the timer
+#define RELAY_SCHEDULER_HORIZON_US 1000000UL  // how far ahead edges are queued
+#define RELAY_TIMER_TICKS_PER_US 5            // TIM_DIV16 at 80 MHz
+#define RELAY_TIMER_MAX_TICKS 0x7FFFFFUL      // timer1 is 23 bits
+
+class RelayScheduler {
+  struct Edge {
+    unsigned long due;    // micros()
+    uint8_t outputs;
+    uint8_t pattern;
+  };
+
+  const uint8_t* _pins;
+  uint8_t _pinCount;
+  StrobePatterns* _patterns = nullptr;
+  volatile uint8_t _outputs = 0;    // relays switched on
+  volatile uint8_t _pattern = PATTERN_STEADY;
+  volatile uint8_t _written = 0;    // pin states after the pattern
+  volatile uint8_t _step = 0;
+  volatile unsigned long _nextTick = 0;
+
+  Edge _edges[RELAY_SCHEDULER_EDGES];
+  volatile uint8_t _head = 0;   // advanced by the ISR
+  volatile uint8_t _tail = 0;   // advanced by loop()
+
+  // lateness of fired edges, actual - scheduled
+  volatile uint32_t _edgeCount;
+  volatile long _minLate;
+  volatile long _maxLate;
+  volatile uint32_t _totalLate;   // sum of |late|
+
+  static RelayScheduler* _instance;
+  static void onTimer();
+
+  void apply(uint8_t outputs, uint8_t pattern, unsigned long at);
+  void writePins();
+  void fire();
+
+  public:
+
+  RelayScheduler(const uint8_t* pins, uint8_t pinCount);
+
+  // attach the timer1 interrupt, patterns must already be expanded
+  void begin(StrobePatterns& patterns);
+
+  // queue an edge, applied at once if already due, false if the queue is full
+  bool schedule(unsigned long due, uint8_t outputs, uint8_t pattern = PATTERN_STEADY);
+
+  // set the relays now, pending edges still fire afterwards
+  void write(uint8_t outputs, uint8_t pattern = PATTERN_STEADY);
+
+  // drop all pending edges
+  void cancel();
+
+  uint8_t outputs();
+
+  uint8_t pattern();
+
+  uint8_t pending();
+
+  void resetJitter();
+
+  // prints edge count and min/max/mean lateness in us
+  void reportJitter(Print& out);
+};
+
+#endif
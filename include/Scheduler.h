@@ -0,0 +1,105 @@
+/*
+ * Scheduler.h
+ * Cooperative task scheduler for loop().
+ *
+ * Tasks are plain functions that do a bit of work and return, they are
+ * never preempted. run() is one loop() pass: it runs every task that is
+ * due, highest priority first, and among equal priorities the one whose
+ * deadline comes first, picking again after each task so that a task
+ * released while another ran does not wait behind lower priorities.
+ *
+ *   every()  a periodic task, released every period us, or on every pass
+ *            with a period of TASK_EVERY_PASS; a late run counts as a
+ *            missed deadline once it starts more than deadline us after
+ *            its release, the period by default
+ *   once()   a deadline task, asleep until wake() releases it for a time;
+ *            it runs once, at that time or as soon after as the tasks
+ *            ahead of it allow, and counts as missed if it starts more
+ *            than deadline us late
+ *
+ * Each task keeps runs, run time, worst run, worst start latency and missed
+ * deadlines since resetStats(); report() prints them with the share of the
+ * CPU each task took, and what was left over, so it is easy to see what a
+ * new feature can still have. holdStats() stops the counts where they are
+ * while the report goes out a line at a time. Time is micros() on both ends of every run,
+ * a handful of us of overhead per task per pass.
+ */
+
+#ifndef SCHEDULER_H
+#define SCHEDULER_H
+
+#include <Arduino.h>
+
+#define SCHEDULER_TASKS 12
+#define TASK_EVERY_PASS 0         // period of a task that runs on every pass
+#define TASK_NONE 0xFF            // from every() and once() when the table is full
+
+enum taskPriority : uint8_t {
+  TASK_HIGH,
+  TASK_NORMAL,
+  TASK_LOW
+};
+
+// now and nowMs are micros() and millis() read when the task was picked,
+// one reading for everything the task does in that run
+typedef void (*TaskFunction)(unsigned long now, unsigned long nowMs);
+
+class Scheduler {
+  struct Task {
+    const char* name;
+    TaskFunction run;
+    uint32_t period;              // us, TASK_EVERY_PASS or a period
+    uint32_t deadline;            // us after release a run must start by, 0 = none
+    uint32_t releaseAt;           // micros() of the next release
+    uint8_t priority;             // taskPriority
+    bool once;
+    bool ready;                   // released, for once() tasks
+    uint32_t pass;                // last pass it ran in
+
+    uint32_t runs;
+    uint32_t missed;
+    uint32_t busyUs;              // run time since resetStats()
+    uint32_t maxRunUs;
+    uint32_t maxLateUs;
+  };
+
+  Task _tasks[SCHEDULER_TASKS];
+  uint8_t _count = 0;
+  uint32_t _pass = 0;
+  uint32_t _passes = 0;           // since resetStats()
+  unsigned long _statsAt = 0;     // micros() of resetStats()
+  unsigned long _heldAt = 0;      // micros() of holdStats()
+  bool _held = false;
+
+  uint8_t add(const char* name, TaskFunction run, uint32_t period, uint8_t priority, uint32_t deadline, bool once);
+  bool due(Task& task, unsigned long now);
+  void account(Task& task, unsigned long started, unsigned long ended);
+
+  public:
+  uint8_t every(const char* name, TaskFunction run, uint32_t periodUs, uint8_t priority,
+                uint32_t deadlineUs = 0);
+  uint8_t once(const char* name, TaskFunction run, uint8_t priority, uint32_t deadlineUs);
+
+  // release a once() task for at (micros()); again before it ran moves it
+  void wake(uint8_t task, unsigned long at);
+  void cancel(uint8_t task);
+
+  // one loop() pass: every due task, at most once each
+  void run();
+
+  void resetStats();
+  // stop counting until resetStats(), so a report printed a line at a time
+  // covers what came before it
+  void holdStats();
+  // one line per task: name, priority, period, runs, mean and worst run,
+  // worst start latency, missed deadlines and CPU share, then the total
+  void report(Print& out);
+  // the same, one line at a time, 0 to reportLines() - 1
+  uint8_t reportLines() { return _count + 3; }
+  void reportLine(Print& out, uint8_t line);
+
+  uint32_t missed();              // all tasks, since resetStats()
+  uint8_t utilisation();          // percent of the time in tasks, since resetStats()
+};
+
+#endif
@@ -0,0 +1,57 @@
+/*
+ * ShowFile.h
+ * Streams show cues from a precompiled binary file on LittleFS.
+ *
+ * Show scripts are written as text and compiled on the host with
+ * tools/compile_show.py. The binary file is a ShowFileHeader followed by
+ * cueCount packed Cue records, all little endian. The checksum is the
+ * CRC-32 (IEEE) of the cue records.
+ *
+ * open() validates the header, the file size, the checksum and the cue
+ * order once at startup. During the show the cues are read a few at a time
+ * through a small buffer, the file is never loaded whole.
+ */
+
+#ifndef SHOW_FILE_H
+#define SHOW_FILE_H
+
+#include <Arduino.h>
+#include <FS.h>
+#include "Timeline.h"
+
+#define SHOW_FILE_MAGIC 0x57485346UL  // "FSHW"
+#define SHOW_FILE_VERSION 2
+#define SHOW_FILE_BUFFER_CUES 8       // cues read from flash at a time
+
+struct __attribute__((packed)) ShowFileHeader {
+  uint32_t magic;
+  uint8_t version;
+  uint8_t cueSize;      // sizeof(Cue) the file was compiled for
+  uint16_t cueCount;
+  uint32_t checksum;
+};
+
+class ShowFile : public CueSource {
+  fs::File _file;
+  uint16_t _count = 0;
+  uint16_t _index = 0;        // next cue to hand out
+  uint8_t _buffered = 0;      // cues in _buffer
+  uint8_t _position = 0;      // next cue in _buffer
+  Cue _buffer[SHOW_FILE_BUFFER_CUES];
+
+  bool validate(const ShowFileHeader& header, uint8_t outputs);
+
+  public:
+
+  // open and validate a show file, outputs is the mask of relays it may drive
+  bool open(fs::FS& fs, const char* path, uint8_t outputs);
+
+  void close();
+
+  uint16_t count();
+
+  bool rewind() override;
+  bool next(Cue& cue) override;
+};
+
+#endif
@@ -0,0 +1,108 @@
+/*
+ * ShowSync.h
+ * Runs several props off one show clock over UDP.
+ *
+ * The master broadcasts a beacon with its micros() every SYNC_BEACON_MS
+ * and, when its show starts, a trigger with the master micros() the show
+ * starts at, SYNC_LEAD_MS ahead so every prop can be ready for it. Triggers
+ * and aborts are sent SYNC_REPEATS times, SYNC_REPEAT_MS apart, followers
+ * act on the first copy they get: a copy is one with the event number and
+ * the boot nonce of the last event acted on, so the first events of a
+ * master that rebooted are never taken for copies. Followers feed every packet to a
+ * ClockSync and hand out the start time in their own micros() and, while
+ * the show runs, how far the master's show has got.
+ *
+ * Packets are SyncPacket, little endian, broadcast to SYNC_PORT.
+ */
+
+#ifndef SHOW_SYNC_H
+#define SHOW_SYNC_H
+
+#include <Arduino.h>
+#include <WiFiUdp.h>
+#include "ClockSync.h"
+
+#define SYNC_PORT 4210
+#define SYNC_MAGIC 0x4E595346UL   // "FSYN"
+#define SYNC_BEACON_MS 250
+#define SYNC_LEAD_MS 100          // trigger to show start
+#define SYNC_REPEATS 3            // copies of each trigger and abort
+#define SYNC_REPEAT_MS 20         // between the copies
+
+enum syncType : uint8_t {
+  SYNC_BEACON,
+  SYNC_TRIGGER,
+  SYNC_ABORT
+};
+
+struct __attribute__((packed)) SyncPacket {
+  uint32_t magic;
+  uint8_t type;         // syncType
+  uint8_t scene;        // SYNC_TRIGGER
+  uint16_t event;       // counts up per trigger or abort, copies share it
+  uint32_t sentAt;      // master micros()
+  uint32_t startAt;     // SYNC_TRIGGER: master micros() the show starts at
+  uint32_t boot;        // random per master boot, its event count starts over with it
+};
+
+// what update() found
+enum syncEvent : uint8_t {
+  SYNC_NONE,
+  SYNC_START,           // see startAt() and scene()
+  SYNC_STOP
+};
+
+class ShowSync {
+  WiFiUDP _udp;
+  bool _master = false;
+  ClockSync _clock;
+  uint16_t _event = 0;            // master: last sent, follower: last acted on
+  uint32_t _boot = 0;             // master: this boot's nonce, follower: of the last event
+  bool _eventSeen = false;
+  unsigned long _beaconAt = 0;    // master: millis() of the last beacon
+
+  SyncPacket _repeat;             // master: trigger or abort still to repeat
+  uint8_t _repeats = 0;
+  unsigned long _repeatAt = 0;    // millis() of the last copy
+
+  uint32_t _startAt = 0;          // follower: master micros()
+  uint8_t _scene = 0;
+  unsigned long _received = 0;
+  unsigned long _rejected = 0;
+
+  void send(SyncPacket& packet);
+  uint8_t receive(const SyncPacket& packet, unsigned long now);
+
+  public:
+  // open the UDP port, WiFi must already be up
+  void begin(bool master);
+
+  // master: send beacons and repeats, follower: read packets
+  // returns a syncEvent, never blocks
+  uint8_t update(unsigned long now);
+
+  // master: start all props at scene, returns the local micros() the show
+  // starts at, SYNC_LEAD_MS from now
+  unsigned long trigger(uint8_t scene);
+
+  // master: stop all props
+  void abort();
+
+  bool master() { return _master; }
+
+  // follower: local micros() and scene of the last SYNC_START
+  unsigned long startAt() { return _clock.toLocal(_startAt); }
+  uint8_t scene() { return _scene; }
+
+  // follower: us the master's show has run at local micros() now, on the
+  // master's crystal
+  long elapsed(unsigned long now) { return (int32_t)(_clock.toMaster(now) - _startAt); }
+
+  ClockSync& clock() { return _clock; }
+
+  // packets taken, and dropped for a bad size or magic
+  unsigned long received() { return _received; }
+  unsigned long rejected() { return _rejected; }
+};
+
+#endif
@@ -0,0 +1,118 @@
+/*
+ * SoundCatalog.h
+ * Index of the numbered folders on the DFPlayer's SD card, and random picks
+ * from them that do not repeat.
+ *
+ * Sound variations live in folders 01 to 15 of the SD card, one folder per
+ * kind of sound (screams, slams), files 001.mp3 on in each. Cues ask for a
+ * folder and get one of its files at random: every file of the folder once,
+ * in a new order each round, never the same file twice in a row across
+ * rounds. A round is an affine permutation (step * i + offset) % files with
+ * step coprime to files, so a pick is O(1) and needs no table per file.
+ *
+ * The index is how many files each folder holds. Counting them takes one
+ * query per folder, each a round trip to the module, so the counts are kept
+ * in CATALOG_FILE on LittleFS. The stored per-folder counts are the key: a
+ * card whose total file count, which PlayerState asks for anyway, matches
+ * the stored one is served from them at once, and each folder is asked for
+ * again in the background, so a card with as many files in other folders
+ * is caught. A folder whose count differs is taken from the card, with a
+ * new round of picks. A card with another total is scanned before any pick.
+ * Scans go through PlayerState::ask() one query at a time, nothing here
+ * blocks. Counts that differ from the file are only marked unsaved:
+ * writing the file erases a flash sector, tens of ms with the flash cache
+ * off, so the firmware calls save() between shows.
+ */
+
+#ifndef SOUND_CATALOG_H
+#define SOUND_CATALOG_H
+
+#include <Arduino.h>
+#include <FS.h>
+#include "PlayerState.h"
+
+#define CATALOG_FILE "/catalog.bin"
+#define CATALOG_MAGIC 0x54414346UL    // "FCAT"
+#define CATALOG_VERSION 1
+#define CATALOG_FOLDERS 15            // the folders playLargeFolder() reaches
+#define CATALOG_MAX_FILES 3000        // per folder
+#define CATALOG_QUERY_TRIES 2         // per count, then it is taken as 0
+
+enum catalogState : uint8_t {
+  CATALOG_WAITING,    // for the player and its total file count
+  CATALOG_SCANNING,
+  CATALOG_READY
+};
+
+struct __attribute__((packed)) CatalogFileHeader {
+  uint32_t magic;         // CATALOG_MAGIC
+  uint8_t version;        // CATALOG_VERSION
+  uint8_t folders;        // file counts that follow, uint16_t each
+  uint16_t fingerprint;   // total file count of the card they were read from
+};
+
+class SoundCatalog {
+  struct Folder {
+    uint16_t files;
+    uint16_t step;        // of this round, coprime to files
+    uint16_t offset;
+    uint16_t drawn;       // picks of this round, files = round over
+    uint16_t last;        // file picked last, 0 = none
+  };
+
+  PlayerState& _player;
+  fs::FS* _fs = nullptr;
+  catalogState _state = CATALOG_WAITING;
+  Folder _folders[CATALOG_FOLDERS];
+  uint8_t _folderCount = 0;
+  uint16_t _fingerprint = 0;
+  bool _cached = false;           // counts loaded from CATALOG_FILE
+  bool _fromCache = false;        // and every folder checked so far matched the card
+  bool _verifying = false;        // READY on the loaded counts, checking them folder by folder
+
+  uint8_t _scanning = 0;          // folder asked for, 0 = the folder count
+  uint8_t _tries = 0;
+  bool _asked = false;
+  bool _complete = true;          // no count given up on, the scan is stored
+  bool _unsaved = false;          // scanned counts not in CATALOG_FILE yet
+  unsigned long _askedAt = 0;
+  unsigned long _scanStartedAt = 0;
+  unsigned long _scanMs = 0;
+
+  void load();
+  void startScan(unsigned long now);
+  void scan(unsigned long now);
+  void scanned(uint16_t value, unsigned long now);
+  void clear();
+  void shuffle(Folder& folder);
+
+  public:
+  SoundCatalog(PlayerState& player) : _player(player) {}
+
+  // fs may be null when LittleFS did not mount, counts are then scanned on
+  // every boot
+  void begin(fs::FS* fs);
+  // checks the stored counts against the card once it is online, scans when
+  // they do not match, never blocks
+  void update(unsigned long now);
+
+  // counts from a scan that save() has not written yet
+  bool unsaved() { return _unsaved; }
+  // write them to CATALOG_FILE; blocks for the flash writes and erase, call
+  // only while no show runs
+  void save();
+
+  // file 1 to files(folder) of folder 1 to CATALOG_FOLDERS, 0 if the folder
+  // is unknown or empty
+  uint16_t pick(uint8_t folder);
+
+  bool ready() { return _state == CATALOG_READY; }
+  bool verifying() { return _verifying; }
+  catalogState state() { return _state; }
+  uint8_t folders() { return _folderCount; }
+  uint16_t files(uint8_t folder);
+  bool fromCache() { return _fromCache; }
+  unsigned long scanMs() { return _scanMs; }    // last scan, 0 = none this boot
+};
+
+#endif
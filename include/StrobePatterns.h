@@ -0,0 +1,55 @@
+/*
+ * StrobePatterns.h
+ * Flash patterns for the relays.
+ *
+ * Each pattern is described by a few parameters in PROGMEM and expanded
+ * into a bit sequence in RAM by begin(), one bit per PATTERN_TICK_US. The
+ * RelayScheduler ISR clocks the sequence out, so a flashing relay costs the
+ * main loop nothing. The tables live in RAM because the ISR may run while
+ * the flash cache is off.
+ *
+ * Pattern IDs are used by show cues, keep them in step with PATTERNS in
+ * tools/compile_show.py.
+ */
+
+#ifndef STROBE_PATTERNS_H
+#define STROBE_PATTERNS_H
+
+#include <Arduino.h>
+
+#define PATTERN_TICK_US 10000UL   // one step of a pattern
+#define PATTERN_MAX_STEPS 128     // steps per pattern before it repeats
+
+// pattern IDs, 0 means steady on
+enum strobePattern : uint8_t {
+  PATTERN_STEADY,
+  PATTERN_FLASH_SLOW,   // 2 Hz, 50% duty
+  PATTERN_FLASH_FAST,   // 10 Hz, 30% duty
+  PATTERN_THRASH,       // random bursts
+  PATTERN_RAMP,         // flash rate speeding up
+  STROBE_PATTERN_COUNT
+};
+
+class StrobePatterns {
+  struct Sequence {
+    uint8_t bits[PATTERN_MAX_STEPS / 8];
+    uint8_t length;     // steps
+  };
+
+  Sequence _sequences[STROBE_PATTERN_COUNT] = {};
+
+  static void set(Sequence& sequence, uint8_t step, bool on);
+
+  public:
+
+  // expand the pattern descriptions into bit sequences
+  void begin();
+
+  // on/off state of a pattern at a step, steps wrap at the pattern length;
+  // bit() and length() are called from the ISR and live in IRAM
+  bool bit(uint8_t pattern, uint16_t step);
+
+  uint8_t length(uint8_t pattern);
+};
+
+#endif
@@ -0,0 +1,73 @@
+/*
+ * Telemetry.h
+ * Show state pushed to the web controller.
+ *
+ * update() is given the current TelemetryState and encodes what changed
+ * since the last frame into a delta frame, a binary WebSocket message:
+ *
+ *   uint8 TELEMETRY_DELTA or TELEMETRY_KEYFRAME
+ *   uint16 mask       bit n set = field n follows
+ *   fields            in field order, each its own size, little endian
+ *
+ * A keyframe holds every field. Clients that just connected or missed a
+ * frame get keyframe() instead of the delta, so they never apply a delta
+ * to the wrong base. Both frames are built in buffers inside the object,
+ * ControlServer::push() hands each client its own copy. Field order and sizes must match
+ * TELEMETRY_FIELDS in data/js/ui.js.
+ */
+
+#ifndef TELEMETRY_H
+#define TELEMETRY_H
+
+#include <Arduino.h>
+
+#define TELEMETRY_DELTA 0xD0
+#define TELEMETRY_KEYFRAME 0xD1
+#define TELEMETRY_INTERVAL_MS 100     // at most one push per interval
+#define TELEMETRY_FIELD_COUNT 15
+#define TELEMETRY_FRAME_MAX (3 + sizeof(TelemetryState))
+
+struct __attribute__((packed)) TelemetryState {
+  uint8_t state;            // stateMachine
+  int16_t cue;              // last cue applied, -1 before the first
+  uint8_t scene;            // Timeline::scene()
+  uint32_t sceneElapsed;    // ms since the scene started
+  uint8_t outputs;          // relays on
+  uint16_t track;           // DFPlayer track last started
+  uint8_t playing;
+  uint8_t volume;
+  uint16_t playerTimeouts;
+  uint16_t playerBadFrames;
+  uint16_t loopRate;        // loop() passes per second, 0xFFFF for that many or more
+  uint32_t loopGapMax;      // us, longest gap between loop() passes since the last push
+  uint16_t sequence;        // last control record received, see ControlServer
+  uint8_t clients;
+  uint16_t playerDropped;   // DFPlayer commands lost to a full queue
+};
+
+class Telemetry {
+  TelemetryState _sent = {};    // as of the last frame
+  uint8_t _delta[TELEMETRY_FRAME_MAX];
+  uint8_t _keyframe[TELEMETRY_FRAME_MAX];
+  size_t _deltaLength = 0;
+  size_t _keyframeLength = 0;
+  unsigned long _pushedAt = 0;
+
+  size_t encode(uint8_t* frame, uint8_t type, const TelemetryState& state, uint16_t mask);
+
+  public:
+  // true once TELEMETRY_INTERVAL_MS has passed since the last update()
+  bool due(unsigned long now) { return now - _pushedAt >= TELEMETRY_INTERVAL_MS; }
+
+  // encode a delta against the last state, false if nothing changed
+  bool update(const TelemetryState& state, unsigned long now);
+
+  const uint8_t* delta() { return _delta; }
+  size_t deltaLength() { return _deltaLength; }
+
+  // all fields of the last state
+  const uint8_t* keyframe();
+  size_t keyframeLength() { keyframe(); return _keyframeLength; }
+};
+
+#endif
@@ -0,0 +1,176 @@
+/*
+ * Timeline.h
+ * Table-driven show sequencer.
+ *
+ * A show is a sequence of packed cues read in order from a CueSource, either
+ * a constexpr array kept in flash (ProgmemCues) or a show file (ShowFile).
+ * Each cue holds its offset from the start of the show, the full state of
+ * the relay outputs, the flash pattern of those outputs and one sound or
+ * light action.
+ *
+ * Cues are read a few ahead of time. Their relay states are handed to the
+ * RelayScheduler as soon as they fall inside its horizon, so relay edges are
+ * timed by the hardware timer. Sound and light actions run from update() in
+ * loop().
+ *
+ * A CUE_SOUND_AWAIT cue waits for a track to finish. Its offset is the
+ * timeout: it fires at that time at the latest, or as soon as the track is
+ * over, and every later cue moves up with it. Cues from an await cue on are
+ * only handed to the RelayScheduler once it has fired.
+ */
+
+#ifndef TIMELINE_H
+#define TIMELINE_H
+
+#include <Arduino.h>
+#include "RelayScheduler.h"
+#include "StrobePatterns.h"
+
+#define TIMELINE_LOOKAHEAD 4      // cues read ahead of the cursor
+#define CUE_RAMP_STEP_MS 100      // unit of a CUE_SOUND_RAMP time
+
+// sound and light actions a cue can trigger
+enum cueSound : uint8_t {
+  CUE_SOUND_NONE,
+  CUE_SOUND_PLAY,     // play track <argument> once
+  CUE_SOUND_LOOP,     // loop track <argument>
+  CUE_SOUND_STOP,
+  CUE_SOUND_VOLUME,   // set volume to <argument>, 0 to 30
+  CUE_SOUND_AWAIT,    // wait for track <argument> to finish, at most until the cue's offset
+  CUE_LIGHT_LOOK,     // fade the DMX lights to look <argument>
+  CUE_SOUND_RAMP,     // ramp the volume, see rampArgument()
+  CUE_SOUND_EFFECT,   // insert effect <argument> of soundEffects in src/main.cpp over the track
+  CUE_SOUND_RANDOM,   // play a file of SD card folder <argument> at random, see SoundCatalog
+  CUE_SOUND_CHANNELS  // later sound actions go to DFPlayer channels <argument>, bit n = channel n
+};
+
+// CUE_SOUND_RAMP argument: volume 0 to 30 in the low byte, ramp time in
+// CUE_RAMP_STEP_MS in the high byte, up to 25.5 s
+constexpr uint16_t rampArgument(uint8_t volume, uint16_t ms) {
+  return volume | (ms / CUE_RAMP_STEP_MS) << 8;
+}
+
+struct __attribute__((packed)) Cue {
+  uint16_t at;        // ms from the start of the show
+  uint8_t outputs;    // bit n set = relay n on
+  uint8_t pattern;    // strobePattern the relays that are on flash with
+  uint8_t sound;      // cueSound
+  uint16_t argument;  // track, volume, look, effect, folder, channels or rampArgument() for the action
+};
+
+// compile time checks for show tables, use with static_assert
+constexpr bool cuesInOrder(const Cue* cues, size_t count, size_t i = 1) {
+  return i >= count || (cues[i - 1].at <= cues[i].at && cuesInOrder(cues, count, i + 1));
+}
+
+constexpr bool cuesUseOutputs(const Cue* cues, size_t count, uint8_t outputs, size_t i = 0) {
+  return i >= count || (!(cues[i].outputs & ~outputs) && cuesUseOutputs(cues, count, outputs, i + 1));
+}
+
+// DFPlayer frames a cue's action queues on each player it goes to; a ramp
+// counts its first step, an effect its advertise()
+constexpr size_t cueFrames(const Cue& cue) {
+  return cue.sound == CUE_SOUND_PLAY || cue.sound == CUE_SOUND_LOOP || cue.sound == CUE_SOUND_STOP ||
+         cue.sound == CUE_SOUND_VOLUME || cue.sound == CUE_SOUND_RAMP || cue.sound == CUE_SOUND_EFFECT ||
+         cue.sound == CUE_SOUND_RANDOM;
+}
+
+// frames queued by the cues from i on that share cues[i]'s offset
+constexpr size_t cuesFramesAt(const Cue* cues, size_t count, size_t i, size_t first) {
+  return i >= count || cues[i].at != cues[first].at ? 0 : cueFrames(cues[i]) + cuesFramesAt(cues, count, i + 1, first);
+}
+
+// most frames the cues of one offset queue at once, for cues in time order;
+// a player's command queue has to hold them all
+constexpr size_t cuesSoundBurst(const Cue* cues, size_t count, size_t i = 0) {
+  return i >= count ? 0
+                    : cuesFramesAt(cues, count, i, i) > cuesSoundBurst(cues, count, i + 1)
+                          ? cuesFramesAt(cues, count, i, i)
+                          : cuesSoundBurst(cues, count, i + 1);
+}
+
+// sequential reader for the cues of a show
+class CueSource {
+  public:
+  virtual bool rewind() = 0;          // back to the first cue
+  virtual bool next(Cue& cue) = 0;    // false once the show has no more cues
+};
+
+// show table stored as a constexpr array in PROGMEM
+class ProgmemCues : public CueSource {
+  const Cue* _cues;
+  uint16_t _count;
+  uint16_t _index = 0;
+
+  public:
+  ProgmemCues(const Cue* cues, uint16_t count) : _cues(cues), _count(count) {}
+  bool rewind() override;
+  bool next(Cue& cue) override;
+};
+
+constexpr bool cuesUsePatterns(const Cue* cues, size_t count, size_t i = 0) {
+  return i >= count || (cues[i].pattern < STROBE_PATTERN_COUNT && cuesUsePatterns(cues, count, i + 1));
+}
+
+typedef void (*SoundHandler)(uint8_t sound, uint16_t argument);
+typedef bool (*SoundFinished)(uint16_t track);
+
+class Timeline {
+  RelayScheduler& _relays;
+  SoundHandler _sound;
+  SoundFinished _soundFinished;
+
+  CueSource* _source = nullptr;
+  bool _sourceDone = true;
+  uint16_t _cursor = 0;         // index of the next cue to apply
+  Cue _ahead[TIMELINE_LOOKAHEAD];
+  uint8_t _aheadHead = 0;
+  uint8_t _aheadCount = 0;
+  uint8_t _scheduled = 0;       // cues from _aheadHead handed to _relays
+  unsigned long _start = 0;     // micros()
+  uint8_t _scene = 0;           // distinct cue times reached, as for start(now, scene)
+  uint16_t _sceneAt = 0;        // cue time the current scene started at
+
+  void fill();
+  void schedule(unsigned long now);
+
+  public:
+
+  Timeline(RelayScheduler& relays, SoundHandler sound, SoundFinished soundFinished = nullptr);
+
+  // select the show to run
+  void begin(CueSource* source);
+
+  // rewind to the first cue, offsets count from now (micros)
+  void start(unsigned long now);
+
+  // start at a scene, the group of cues at the scene-th distinct cue time
+  // (scene 0 is the start of the show), as if the show had run up to it:
+  // the relay state, sound channels, volume and light look of the earlier cues are applied
+  // at once, their other sound actions and waits are skipped
+  void start(unsigned long now, uint8_t scene);
+
+  // apply all cues that are due, returns index of the last one applied or -1
+  int update(unsigned long now);
+
+  bool finished();
+
+  // move the start of the show by us, later cues with it; relay edges
+  // already handed to the timer keep their times
+  void shift(long us);
+
+  // ms since start()
+  unsigned long elapsed(unsigned long now);
+
+  // the scene running, numbered as for start(now, scene), and ms since it
+  // started; an await cue that fires early starts its scene early
+  uint8_t scene() { return _scene; }
+  unsigned long sceneElapsed(unsigned long now);
+
+  // drop scheduled relay edges and set all relays at once
+  void writeOutputs(uint8_t outputs);
+
+  uint8_t outputs();
+};
+
+#endif
@@ -13,10 +13,109 @@
 
 #include "DFRobotDFPlayerMini.h"
 
+static_assert((DFPLAYER_RX_RING_SIZE & (DFPLAYER_RX_RING_SIZE - 1)) == 0 && DFPLAYER_RX_RING_SIZE <= 128,
+  "DFPLAYER_RX_RING_SIZE must be a power of two up to 128");
+
 void DFRobotDFPlayerMini::setTimeOut(unsigned long timeOutDuration){
   _timeOutDuration = timeOutDuration;
 }
 
+void DFRobotDFPlayerMini::enableQueue(){
+  _isQueued = true;
+}
+
+void DFRobotDFPlayerMini::disableQueue(){
+  while (_queueCount) {   //drain what is already queued before going back to blocking sends
+    delay(0);
+    poll();
+  }
+  _isQueued = false;
+}
+
+bool DFRobotDFPlayerMini::poll(){
+  if (_isSending) {   //the last frame is waiting for its ack, pick it up even with nothing queued
+    pump();
+    if (_isSending) {
+      return false;
+    }
+  }
+  if (!_queueCount) {
+    return false;
+  }
+  if (millis() - _sentTimer < DFPLAYER_FRAME_GAP) {  //keep the inter-frame gap
+    return false;
+  }
+
+  QueuedFrame &entry = _queue[_queueHead];
+  transmit(entry.frame);
+  _queueLatency = micros() - entry.queuedAt;
+  if (_queueLatency > _maxQueueLatency) {
+    _maxQueueLatency = _queueLatency;
+  }
+  _queueHead = (_queueHead + 1) % DFPLAYER_QUEUE_SIZE;
+  _queueCount--;
+  return true;
+}
+
+bool DFRobotDFPlayerMini::canSend(){
+  if (_isSending) {
+    pump();
+  }
+  return !_isSending && _queueCount && millis() - _sentTimer >= DFPLAYER_FRAME_GAP;
+}
+
+uint8_t DFRobotDFPlayerMini::queued(){
+  return _queueCount;
+}
+
+uint32_t DFRobotDFPlayerMini::queueSequence(){
+  return _queueSequence;
+}
+
+uint32_t DFRobotDFPlayerMini::sendSequence(){
+  return _queueSequence - _queueCount;
+}
+
+unsigned long DFRobotDFPlayerMini::queueLatency(){
+  return _queueLatency;
+}
+
+unsigned long DFRobotDFPlayerMini::maxQueueLatency(){
+  return _maxQueueLatency;
+}
+
+unsigned long DFRobotDFPlayerMini::queueDropped(){
+  return _queueDropped;
+}
+
+unsigned long DFRobotDFPlayerMini::framesSent(){
+  return _framesSent;
+}
+
+unsigned long DFRobotDFPlayerMini::timeOutCount(){
+  return _timeOutCount;
+}
+
+unsigned long DFRobotDFPlayerMini::wrongStackCount(){
+  return _wrongStackCount;
+}
+
+unsigned long DFRobotDFPlayerMini::ackLatency(){
+  return _ackLatency;
+}
+
+unsigned long DFRobotDFPlayerMini::maxAckLatency(){
+  return _maxAckLatency;
+}
+
+bool DFRobotDFPlayerMini::query(uint8_t command, uint16_t parameter){
+  return sendStack(command, parameter);
+}
+
+bool DFRobotDFPlayerMini::busy(){ //a frame waits for its ack or in the queue
+  return _isSending || _queueCount;
+}
+
 void DFRobotDFPlayerMini::uint16ToArray(uint16_t value, uint8_t *array){
   *array = (uint8_t)(value>>8);
   *(array+1) = (uint8_t)(value);
@@ -30,47 +129,78 @@ uint16_t DFRobotDFPlayerMini::calculateCheckSum(uint8_t *buffer){
   return -sum;
 }
 
-void DFRobotDFPlayerMini::sendStack(){
-  if (_sending[Stack_ACK]) {  //if the ack mode is on wait until the last transmition
-    while (_isSending) {
-      delay(0);
-      available();
-    }
-  }
-
+void DFRobotDFPlayerMini::transmit(const uint8_t *frame){
 #ifdef _DEBUG
   Serial.println();
   Serial.print(F("sending:"));
   for (int i=0; i<DFPLAYER_SEND_LENGTH; i++) {
-    Serial.print(_sending[i],HEX);
+    Serial.print(frame[i],HEX);
     Serial.print(F(" "));
   }
   Serial.println();
 #endif
-  _serial->write(_sending, DFPLAYER_SEND_LENGTH);
+  _serial->write(frame, DFPLAYER_SEND_LENGTH);
   _timeOutTimer = millis();
-  _isSending = _sending[Stack_ACK];
+  _sentTimer = _timeOutTimer;
+  _ackSentAt = micros();
+  _framesSent++;
+  _isSending = frame[Stack_ACK];
+}
+
+bool DFRobotDFPlayerMini::sendFrame(const DFPlayerFrame *frame){
+  uint8_t bytes[DFPLAYER_SEND_LENGTH];
+  memcpy_P(bytes, frame->bytes, DFPLAYER_SEND_LENGTH);
+  return send(bytes);
+}
+
+bool DFRobotDFPlayerMini::sendStack(){
+  return send(_sending);
+}
+
+bool DFRobotDFPlayerMini::send(const uint8_t *frame){
+  if (_isQueued) {
+    if (_queueCount == DFPLAYER_QUEUE_SIZE) {  //queue full, dropped rather than waiting for the link
+      _queueDropped++;
+      return false;
+    }
+    QueuedFrame &entry = _queue[(_queueHead + _queueCount) % DFPLAYER_QUEUE_SIZE];
+    memcpy(entry.frame, frame, DFPLAYER_SEND_LENGTH);
+    entry.queuedAt = micros();
+    _queueCount++;
+    _queueSequence++;
+    return true;
+  }
+
+  if (frame[Stack_ACK]) {  //if the ack mode is on wait until the last transmition
+    while (_isSending) {
+      delay(0);
+      pump();
+    }
+  }
+
+  transmit(frame);
   
-  if (!_sending[Stack_ACK]) { //if the ack mode is off wait 10 ms after one transmition.
-    delay(10);
+  if (!frame[Stack_ACK]) { //if the ack mode is off wait 10 ms after one transmition.
+    delay(DFPLAYER_FRAME_GAP);
   }
+  return true;
 }
 
-void DFRobotDFPlayerMini::sendStack(uint8_t command){
-  sendStack(command, 0);
+bool DFRobotDFPlayerMini::sendStack(uint8_t command){
+  return sendStack(command, 0);
 }
 
-void DFRobotDFPlayerMini::sendStack(uint8_t command, uint16_t argument){
+bool DFRobotDFPlayerMini::sendStack(uint8_t command, uint16_t argument){
   _sending[Stack_Command] = command;
   uint16ToArray(argument, _sending+Stack_Parameter);
   uint16ToArray(calculateCheckSum(_sending), _sending+Stack_CheckSum);
-  sendStack();
+  return sendStack();
 }
 
-void DFRobotDFPlayerMini::sendStack(uint8_t command, uint8_t argumentHigh, uint8_t argumentLow){
+bool DFRobotDFPlayerMini::sendStack(uint8_t command, uint8_t argumentHigh, uint8_t argumentLow){
   uint16_t buffer = argumentHigh;
   buffer <<= 8;
-  sendStack(command, buffer | argumentLow);
+  return sendStack(command, buffer | argumentLow);
 }
 
 void DFRobotDFPlayerMini::enableACK(){
@@ -87,6 +217,7 @@ bool DFRobotDFPlayerMini::waitAvailable(unsigned long duration){
     duration = _timeOutDuration;
   }
   while (!available()){
+    poll();
     if (millis() - timer > duration) {
       return false;
     }
@@ -128,16 +259,31 @@ uint16_t DFRobotDFPlayerMini::read(){
   return _handleParameter;
 }
 
+void DFRobotDFPlayerMini::queueEvent(uint8_t type, uint8_t command, uint16_t parameter){
+  if (_eventCount == DFPLAYER_EVENT_QUEUE_SIZE) { //nobody reads events, keep the older ones
+    _eventOverflowCount++;
+    return;
+  }
+  DFPlayerEvent &event = _events[(_eventHead + _eventCount) % DFPLAYER_EVENT_QUEUE_SIZE];
+  event.type = type;
+  event.command = command;
+  event.parameter = parameter;
+  _eventCount++;
+}
+
 bool DFRobotDFPlayerMini::handleMessage(uint8_t type, uint16_t parameter){
-  _receivedIndex = 0;
-  _handleType = type;
-  _handleParameter = parameter;
-  _isAvailable = true;
-  return _isAvailable;
+  queueEvent(type, 0, parameter);
+  return true;
 }
 
 bool DFRobotDFPlayerMini::handleError(uint8_t type, uint16_t parameter){
-  handleMessage(type, parameter);
+  if (type == TimeOut) {
+    _timeOutCount++;
+  }
+  else if (type == WrongStack) {
+    _wrongStackCount++;
+  }
+  queueEvent(type, 0, parameter);
   _isSending = false;
   return false;
 }
@@ -147,49 +293,51 @@ uint8_t DFRobotDFPlayerMini::readCommand(){
   return _handleCommand;
 }
 
-void DFRobotDFPlayerMini::parseStack(){
-  uint8_t handleCommand = *(_received + Stack_Command);
-  if (handleCommand == 0x41) { //handle the 0x41 ack feedback as a spcecial case, in case the pollusion of _handleCommand, _handleParameter, and _handleType.
+void DFRobotDFPlayerMini::parseStack(uint8_t command, uint16_t parameter){
+  if (command == 0x41) { //handle the 0x41 ack feedback as a spcecial case, it is not an event
+    if (_isSending) { //command round trip, frame out to ack back
+      _ackLatency = micros() - _ackSentAt;
+      if (_ackLatency > _maxAckLatency) {
+        _maxAckLatency = _ackLatency;
+      }
+    }
     _isSending = false;
     return;
   }
-  
-  _handleCommand = handleCommand;
-  _handleParameter =  arrayToUint16(_received + Stack_Parameter);
 
-  switch (_handleCommand) {
+  switch (command) {
     case 0x3D:
-      handleMessage(DFPlayerPlayFinished, _handleParameter);
+      queueEvent(DFPlayerPlayFinished, command, parameter);
       break;
     case 0x3F:
-      if (_handleParameter & 0x01) {
-        handleMessage(DFPlayerUSBOnline, _handleParameter);
+      if (parameter & 0x01) {
+        queueEvent(DFPlayerUSBOnline, command, parameter);
       }
-      else if (_handleParameter & 0x02) {
-        handleMessage(DFPlayerCardOnline, _handleParameter);
+      else if (parameter & 0x02) {
+        queueEvent(DFPlayerCardOnline, command, parameter);
       }
-      else if (_handleParameter & 0x03) {
-        handleMessage(DFPlayerCardUSBOnline, _handleParameter);
+      else if (parameter & 0x03) {
+        queueEvent(DFPlayerCardUSBOnline, command, parameter);
       }
       break;
     case 0x3A:
-      if (_handleParameter & 0x01) {
-        handleMessage(DFPlayerUSBInserted, _handleParameter);
+      if (parameter & 0x01) {
+        queueEvent(DFPlayerUSBInserted, command, parameter);
       }
-      else if (_handleParameter & 0x02) {
-        handleMessage(DFPlayerCardInserted, _handleParameter);
+      else if (parameter & 0x02) {
+        queueEvent(DFPlayerCardInserted, command, parameter);
       }
       break;
     case 0x3B:
-      if (_handleParameter & 0x01) {
-        handleMessage(DFPlayerUSBRemoved, _handleParameter);
+      if (parameter & 0x01) {
+        queueEvent(DFPlayerUSBRemoved, command, parameter);
       }
-      else if (_handleParameter & 0x02) {
-        handleMessage(DFPlayerCardRemoved, _handleParameter);
+      else if (parameter & 0x02) {
+        queueEvent(DFPlayerCardRemoved, command, parameter);
       }
       break;
     case 0x40:
-      handleMessage(DFPlayerError, _handleParameter);
+      queueEvent(DFPlayerError, command, parameter);
       break;
     case 0x3C:
     case 0x3E:
@@ -206,7 +354,7 @@ void DFRobotDFPlayerMini::parseStack(){
     case 0x4D:
     case 0x4E:
     case 0x4F:
-      handleMessage(DFPlayerFeedBack, _handleParameter);
+      queueEvent(DFPlayerFeedBack, command, parameter);
       break;
     default:
       handleError(WrongStack);
@@ -221,73 +369,134 @@ uint16_t DFRobotDFPlayerMini::arrayToUint16(uint8_t *array){
   return value;
 }
 
+uint8_t DFRobotDFPlayerMini::received(uint8_t offset){ //byte of the frame starting at _rxTail
+  return _rxRing[(uint8_t)(_rxTail + offset) & (DFPLAYER_RX_RING_SIZE - 1)];
+}
+
 bool DFRobotDFPlayerMini::validateStack(){
-  return calculateCheckSum(_received) == arrayToUint16(_received+Stack_CheckSum);
+  uint16_t sum = 0;
+  for (int i=Stack_Version; i<Stack_CheckSum; i++) {
+    sum += received(i);
+  }
+  return (uint16_t)-sum == ((received(Stack_CheckSum) << 8) | received(Stack_CheckSum + 1));
 }
 
-bool DFRobotDFPlayerMini::available(){
-  while (_serial->available()) {
-    delay(0);
-    if (_receivedIndex == 0) {
-      _received[Stack_Header] = _serial->read();
-#ifdef _DEBUG
-      Serial.print(F("received:"));
-      Serial.print(_received[_receivedIndex],HEX);
-      Serial.print(F(" "));
-#endif
-      if (_received[Stack_Header] == 0x7E) {
-        _receivedIndex ++;
-      }
+size_t IRAM_ATTR DFRobotDFPlayerMini::feed(const uint8_t *data, size_t length){
+  _isFed = true;
+  size_t fed = 0;
+  while (fed < length && (uint8_t)(_rxHead - _rxTail) < DFPLAYER_RX_RING_SIZE) {
+    _rxRing[_rxHead & (DFPLAYER_RX_RING_SIZE - 1)] = data[fed++];
+    _rxHead = _rxHead + 1;  //publish the byte only once it is written
+  }
+  _rxOverflowCount += length - fed;
+  return fed;
+}
+
+void DFRobotDFPlayerMini::receive(){ //bulk read whatever the stream holds into the ring
+  int count = _serial->available();
+  while (count > 0) {
+    uint8_t space = DFPLAYER_RX_RING_SIZE - (uint8_t)(_rxHead - _rxTail);
+    uint8_t index = _rxHead & (DFPLAYER_RX_RING_SIZE - 1);
+    size_t chunk = DFPLAYER_RX_RING_SIZE - index;  //up to the end of the ring
+    if (chunk > space) {
+      chunk = space;
+    }
+    if ((int)chunk > count) {
+      chunk = count;
+    }
+    if (!chunk) {
+      return;   //ring full, the rest stays in the stream until parse() makes room
+    }
+    chunk = _serial->readBytes(_rxRing + index, chunk);
+    if (!chunk) {
+      return;
+    }
+    _rxHead = _rxHead + chunk;
+    count -= chunk;
+  }
+}
+
+void DFRobotDFPlayerMini::parse(){
+  uint8_t head = _rxHead;
+  while (head != _rxTail) {
+    if (received(Stack_Header) != 0x7E) {  //resync on the start byte
+      _rxTail = _rxTail + 1;
+      continue;
+    }
+    uint8_t count = head - _rxTail;
+    bool isBroken = (count > Stack_Version && received(Stack_Version) != 0xFF)
+        || (count > Stack_Length && received(Stack_Length) != 0x06);
+    if (!isBroken && count < DFPLAYER_RECEIVED_LENGTH) {
+      break;    //rest of the frame not here yet
+    }
+    if (isBroken || received(Stack_End) != 0xEF || !validateStack()) {
+      _rxTail = _rxTail + 1;  //not a frame after all, look for the next start byte
+      handleError(WrongStack);
+      continue;
     }
-    else{
-      _received[_receivedIndex] = _serial->read();
 #ifdef _DEBUG
-      Serial.print(_received[_receivedIndex],HEX);
+    Serial.print(F("received:"));
+    for (int i=0; i<DFPLAYER_RECEIVED_LENGTH; i++) {
+      Serial.print(received(i),HEX);
       Serial.print(F(" "));
-#endif
-      switch (_receivedIndex) {
-        case Stack_Version:
-          if (_received[_receivedIndex] != 0xFF) {
-            return handleError(WrongStack);
-          }
-          break;
-        case Stack_Length:
-          if (_received[_receivedIndex] != 0x06) {
-            return handleError(WrongStack);
-          }
-          break;
-        case Stack_End:
-#ifdef _DEBUG
-          Serial.println();
-#endif
-          if (_received[_receivedIndex] != 0xEF) {
-            return handleError(WrongStack);
-          }
-          else{
-            if (validateStack()) {
-              _receivedIndex = 0;
-              parseStack();
-              return _isAvailable;
-            }
-            else{
-              return handleError(WrongStack);
-            }
-          }
-          break;
-        default:
-          break;
-      }
-      _receivedIndex++;
     }
+    Serial.println();
+#endif
+    parseStack(received(Stack_Command), (received(Stack_Parameter) << 8) | received(Stack_Parameter + 1));
+    _rxTail = _rxTail + DFPLAYER_RECEIVED_LENGTH;
   }
-  
+}
+
+void DFRobotDFPlayerMini::pump(){
+  if (!_isFed) {
+    receive();
+  }
+  parse();
   if (_isSending && (millis()-_timeOutTimer>=_timeOutDuration)) {
-    return handleError(TimeOut);
+    handleError(TimeOut);
+  }
+}
+
+bool DFRobotDFPlayerMini::available(){
+  pump();
+  if (!_isAvailable && _eventCount) {
+    const DFPlayerEvent &event = _events[_eventHead];
+    _handleType = event.type;
+    _handleCommand = event.command;
+    _handleParameter = event.parameter;
+    _eventHead = (_eventHead + 1) % DFPLAYER_EVENT_QUEUE_SIZE;
+    _eventCount--;
+    _isAvailable = true;
   }
-  
   return _isAvailable;
 }
 
+const DFPlayerEvent *DFRobotDFPlayerMini::readEvent(){
+  pump();
+  if (_isAvailable) { //taken by available() but not read yet, it comes first
+    _isAvailable = false;
+    _current.type = _handleType;
+    _current.command = _handleCommand;
+    _current.parameter = _handleParameter;
+    return &_current;
+  }
+  if (!_eventCount) {
+    return nullptr;
+  }
+  const DFPlayerEvent *event = &_events[_eventHead];
+  _eventHead = (_eventHead + 1) % DFPLAYER_EVENT_QUEUE_SIZE;
+  _eventCount--;
+  return event;
+}
+
+unsigned long DFRobotDFPlayerMini::rxOverflowCount(){
+  return _rxOverflowCount;
+}
+
+unsigned long DFRobotDFPlayerMini::eventOverflowCount(){
+  return _eventOverflowCount;
+}
+
 void DFRobotDFPlayerMini::next(){
   sendStack(0x01);
 }
@@ -296,8 +505,8 @@ void DFRobotDFPlayerMini::previous(){
   sendStack(0x02);
 }
 
-void DFRobotDFPlayerMini::play(int fileNumber){
-  sendStack(0x03, fileNumber);
+bool DFRobotDFPlayerMini::play(int fileNumber){
+  return sendStack(0x03, fileNumber);
 }
 
 void DFRobotDFPlayerMini::volumeUp(){
@@ -312,12 +521,12 @@ void DFRobotDFPlayerMini::volume(uint8_t volume){
   sendStack(0x06, volume);
 }
 
-void DFRobotDFPlayerMini::EQ(uint8_t eq) {
-  sendStack(0x07, eq);
+bool DFRobotDFPlayerMini::EQ(uint8_t eq) {
+  return sendStack(0x07, eq);
 }
 
-void DFRobotDFPlayerMini::loop(int fileNumber) {
-  sendStack(0x08, fileNumber);
+bool DFRobotDFPlayerMini::loop(int fileNumber) {
+  return sendStack(0x08, fileNumber);
 }
 
 void DFRobotDFPlayerMini::outputDevice(uint8_t device) {
@@ -341,8 +550,8 @@ void DFRobotDFPlayerMini::pause(){
   sendStack(0x0E);
 }
 
-void DFRobotDFPlayerMini::playFolder(uint8_t folderNumber, uint8_t fileNumber){
-  sendStack(0x0F, folderNumber, fileNumber);
+bool DFRobotDFPlayerMini::playFolder(uint8_t folderNumber, uint8_t fileNumber){
+  return sendStack(0x0F, folderNumber, fileNumber);
 }
 
 void DFRobotDFPlayerMini::outputSetting(bool enable, uint8_t gain){
@@ -361,12 +570,12 @@ void DFRobotDFPlayerMini::playMp3Folder(int fileNumber){
   sendStack(0x12, fileNumber);
 }
 
-void DFRobotDFPlayerMini::advertise(int fileNumber){
-  sendStack(0x13, fileNumber);
+bool DFRobotDFPlayerMini::advertise(int fileNumber){
+  return sendStack(0x13, fileNumber);
 }
 
-void DFRobotDFPlayerMini::playLargeFolder(uint8_t folderNumber, uint16_t fileNumber){
-  sendStack(0x14, (((uint16_t)folderNumber) << 12) | fileNumber);
+bool DFRobotDFPlayerMini::playLargeFolder(uint8_t folderNumber, uint16_t fileNumber){
+  return sendStack(0x14, (((uint16_t)folderNumber) << 12) | fileNumber);
 }
 
 void DFRobotDFPlayerMini::stopAdvertise(){
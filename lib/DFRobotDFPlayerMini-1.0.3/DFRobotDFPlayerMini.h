@@ -33,6 +33,11 @@
 #define DFPLAYER_RECEIVED_LENGTH 10
 #define DFPLAYER_SEND_LENGTH 10
 
+#define DFPLAYER_QUEUE_SIZE 8   //number of frames the command queue can hold, a frame sent to a full one is dropped and the command returns false
+#define DFPLAYER_FRAME_GAP 10   //ms between frames when the ack mode is off
+#define DFPLAYER_RX_RING_SIZE 64  //received bytes not yet parsed, a power of two up to 128
+#define DFPLAYER_EVENT_QUEUE_SIZE 8 //decoded frames not yet read
+
 //#define _DEBUG
 
 #define TimeOut 0
@@ -65,21 +70,84 @@
 #define Stack_CheckSum 7
 #define Stack_End 9
 
+#ifndef IRAM_ATTR
+#define IRAM_ATTR
+#endif
+
+struct DFPlayerEvent {
+  uint8_t type;       //DFPlayerPlayFinished, DFPlayerFeedBack, TimeOut, ...
+  uint8_t command;    //command byte of the frame, 0 for TimeOut and WrongStack
+  uint16_t parameter;
+};
+
+//a complete command frame, checksum included, for sendFrame()
+struct DFPlayerFrame {
+  uint8_t bytes[DFPLAYER_SEND_LENGTH];
+};
+
+constexpr uint16_t dfPlayerCheckSum(uint8_t command, uint8_t ack, uint16_t parameter){
+  return (uint16_t)(0U - (0xFFU + 0x06U + command + ack + (parameter >> 8) + (parameter & 0xFF)));
+}
+
+//the frame sendStack() builds at run time, built by the compiler instead:
+//static const DFPlayerFrame stopFrame PROGMEM = dfPlayerFrame(0x16);
+constexpr DFPlayerFrame dfPlayerFrame(uint8_t command, uint16_t parameter = 0, bool ack = true){
+  return {{0x7E, 0xFF, 0x06, command, (uint8_t)ack, (uint8_t)(parameter >> 8), (uint8_t)parameter,
+           (uint8_t)(dfPlayerCheckSum(command, ack, parameter) >> 8), (uint8_t)dfPlayerCheckSum(command, ack, parameter),
+           0xEF}};
+}
+
 class DFRobotDFPlayerMini {
   Stream* _serial;
   
   unsigned long _timeOutTimer;
   unsigned long _timeOutDuration = 500;
   
-  uint8_t _received[DFPLAYER_RECEIVED_LENGTH];
   uint8_t _sending[DFPLAYER_SEND_LENGTH] = {0x7E, 0xFF, 06, 00, 01, 00, 00, 00, 00, 0xEF};
   
-  uint8_t _receivedIndex=0;
+  //single producer (feed() or receive()), single consumer (parse()) byte ring,
+  //indices run freely and wrap at 256
+  uint8_t _rxRing[DFPLAYER_RX_RING_SIZE];
+  volatile uint8_t _rxHead = 0;
+  volatile uint8_t _rxTail = 0;
+  bool _isFed = false;
+  unsigned long _rxOverflowCount = 0;
+
+  DFPlayerEvent _events[DFPLAYER_EVENT_QUEUE_SIZE];
+  DFPlayerEvent _current;
+  uint8_t _eventHead = 0;
+  uint8_t _eventCount = 0;
+  unsigned long _eventOverflowCount = 0;
 
-  void sendStack();
-  void sendStack(uint8_t command);
-  void sendStack(uint8_t command, uint16_t argument);
-  void sendStack(uint8_t command, uint8_t argumentHigh, uint8_t argumentLow);
+  struct QueuedFrame {
+    uint8_t frame[DFPLAYER_SEND_LENGTH];
+    unsigned long queuedAt;   //micros() when the frame was queued
+  };
+
+  QueuedFrame _queue[DFPLAYER_QUEUE_SIZE];
+  uint8_t _queueHead = 0;
+  uint8_t _queueCount = 0;
+  uint32_t _queueSequence = 0;   //frames queued so far
+  bool _isQueued = false;
+  unsigned long _sentTimer = 0;
+  unsigned long _queueLatency = 0;
+  unsigned long _maxQueueLatency = 0;
+  unsigned long _queueDropped = 0;
+
+  unsigned long _framesSent = 0;
+  unsigned long _timeOutCount = 0;
+  unsigned long _wrongStackCount = 0;
+  unsigned long _ackSentAt = 0;   //micros() when the frame awaiting an ack went out
+  unsigned long _ackLatency = 0;
+  unsigned long _maxAckLatency = 0;
+
+  void transmit(const uint8_t *frame);
+
+  bool send(const uint8_t *frame);
+  bool sendStack();
+  bool sendStack(uint8_t command);
+  bool sendStack(uint8_t command, uint16_t argument);
+  bool sendStack(uint8_t command, uint8_t argumentHigh, uint8_t argumentLow);
 
   void enableACK();
   void disableACK();
@@ -92,7 +160,13 @@ class DFRobotDFPlayerMini {
   
 
 
-  void parseStack();
+  void receive();
+  void parse();
+  void pump();
+  uint8_t received(uint8_t offset);
+  void queueEvent(uint8_t type, uint8_t command, uint16_t parameter);
+
+  void parseStack(uint8_t command, uint16_t parameter);
   bool validateStack();
   
   uint8_t device = DFPLAYER_DEVICE_SD;
@@ -121,12 +195,56 @@ class DFRobotDFPlayerMini {
   uint16_t read();
   
   void setTimeOut(unsigned long timeOutDuration);
+
+  void enableQueue();
+
+  void disableQueue();
+
+  bool poll();
+
+  bool canSend();   //poll() would send the next queued frame right now
+
+  uint8_t queued();
+
+  uint32_t queueSequence();   //frames are numbered in queue order from 0, the number the next one queued gets
+
+  uint32_t sendSequence();    //number of the frame poll() sends next, queueSequence() when nothing is queued
+
+  unsigned long queueLatency();
+
+  unsigned long maxQueueLatency();
+
+  unsigned long queueDropped();   //frames dropped because the queue was full
+
+  unsigned long framesSent();
+
+  unsigned long timeOutCount();
+
+  unsigned long wrongStackCount();
+
+  unsigned long ackLatency();
+
+  unsigned long maxAckLatency();
+
+  bool sendFrame(const DFPlayerFrame *frame);  //a dfPlayerFrame() from PROGMEM, sent or queued like the command it holds, its ack byte included; false if the queue was full
+
+  bool query(uint8_t command, uint16_t parameter = 0);  //send a 0x42..0x4F query without waiting, the answer comes as DFPlayerFeedBack
+
+  bool busy();
+
+  size_t feed(const uint8_t *data, size_t length);  //producer for a receive interrupt, the driver then stops reading the stream itself
+
+  const DFPlayerEvent *readEvent(); //next decoded frame or nullptr, valid until the next call into the driver
+
+  unsigned long rxOverflowCount();
+
+  unsigned long eventOverflowCount();
   
   void next();
   
   void previous();
   
-  void play(int fileNumber=1);
+  bool play(int fileNumber=1);
   
   void volumeUp();
   
@@ -134,9 +252,9 @@ class DFRobotDFPlayerMini {
   
   void volume(uint8_t volume);
   
-  void EQ(uint8_t eq);
+  bool EQ(uint8_t eq);
   
-  void loop(int fileNumber);
+  bool loop(int fileNumber);
   
   void outputDevice(uint8_t device);
   
@@ -148,7 +266,7 @@ class DFRobotDFPlayerMini {
   
   void pause();
   
-  void playFolder(uint8_t folderNumber, uint8_t fileNumber);
+  bool playFolder(uint8_t folderNumber, uint8_t fileNumber);
   
   void outputSetting(bool enable, uint8_t gain);
   
@@ -158,9 +276,9 @@ class DFRobotDFPlayerMini {
   
   void playMp3Folder(int fileNumber);
   
-  void advertise(int fileNumber);
+  bool advertise(int fileNumber);
   
-  void playLargeFolder(uint8_t folderNumber, uint16_t fileNumber);
+  bool playLargeFolder(uint8_t folderNumber, uint16_t fileNumber);
   
   void stopAdvertise();
   
@@ -0,0 +1,255 @@
+#include "DFPlayerEmulator.h"
+#include "NativeHal.h"
+
+// error codes carried by 0x40 frames, as in DFRobotDFPlayerMini.h
+#define EMULATOR_ERROR_CHECKSUM 4
+#define EMULATOR_ERROR_FILE_INDEX 5
+#define EMULATOR_ERROR_ADVERTISE 7
+
+void DFPlayerEmulator::frame(uint8_t command, uint16_t parameter, bool ack, uint8_t* frame) {
+  frame[0] = 0x7E;
+  frame[1] = 0xFF;
+  frame[2] = 0x06;
+  frame[3] = command;
+  frame[4] = ack ? 0x01 : 0x00;
+  frame[5] = parameter >> 8;
+  frame[6] = parameter & 0xFF;
+  uint16_t sum = 0;
+  for (uint8_t i = 1; i < 7; i++) {
+    sum += frame[i];
+  }
+  sum = -sum;
+  frame[7] = sum >> 8;
+  frame[8] = sum & 0xFF;
+  frame[9] = 0xEF;
+}
+
+void DFPlayerEmulator::attach(SimStream& stream, const Settings& settings) {
+  _stream = &stream;
+  _settings = settings;
+  _random = settings.seed ? settings.seed : 1;
+  _stream->onWrite([this](uint8_t value) { receive(value); });
+}
+
+void DFPlayerEmulator::setTrackLength(uint16_t track, unsigned long ms) {
+  _trackMs[track] = ms;
+}
+
+unsigned long DFPlayerEmulator::trackLength(uint16_t track) {
+  auto length = _trackMs.find(track);
+  return length != _trackMs.end() ? length->second : _settings.trackMs;
+}
+
+unsigned long DFPlayerEmulator::nextRandom() {
+  _random = _random * 1103515245UL + 12345UL;
+  return (_random >> 16) & 0x7FFF;
+}
+
+void DFPlayerEmulator::receive(uint8_t value) {
+  if (hal::now() < _settings.bootMs * 1000ULL) {
+    return;
+  }
+  if (_index == 0 && value != 0x7E) {   // resync on the start byte
+    return;
+  }
+  _frame[_index++] = value;
+  if (_index < EMULATOR_FRAME_LENGTH) {
+    return;
+  }
+  _index = 0;
+
+  uint16_t sum = 0;
+  for (uint8_t i = 1; i < 7; i++) {
+    sum += _frame[i];
+  }
+  uint16_t checksum = (_frame[7] << 8) | _frame[8];
+  if (_frame[1] != 0xFF || _frame[2] != 0x06 || _frame[9] != 0xEF || (uint16_t)-sum != checksum) {
+    _stats.badFrames++;
+    reply(0x40, EMULATOR_ERROR_CHECKSUM, _settings.replyDelayUs);
+    return;
+  }
+  handle(_frame[3], (_frame[5] << 8) | _frame[6], _frame[4]);
+}
+
+void DFPlayerEmulator::play(uint16_t track, bool loop) {
+  if (track == 0 || track > _settings.fileCount) {
+    reply(0x40, EMULATOR_ERROR_FILE_INDEX, _settings.replyDelayUs);
+    return;
+  }
+  _track = track;
+  _playing = true;
+  _paused = false;
+  _looping = loop;
+  _advertising = false;
+  _trackEndsAt = hal::now() + trackLength(track) * 1000ULL;
+}
+
+void DFPlayerEmulator::handle(uint8_t command, uint16_t parameter, bool ack) {
+  uint64_t now = hal::now();
+  if (!_stats.framesReceived) {
+    _stats.firstFrameAt = now;
+  }
+  _stats.framesReceived++;
+  _stats.lastFrameAt = now;
+
+  if (ack) {
+    reply(0x41, 0, _settings.replyDelayUs);
+  }
+
+  switch (command) {
+    case 0x01:    // next
+      play(_track % _settings.fileCount + 1, false);
+      break;
+    case 0x02:    // previous
+      play(_track > 1 ? _track - 1 : _settings.fileCount, false);
+      break;
+    case 0x03:    // play
+    case 0x12:    // play from mp3 folder
+      play(parameter, false);
+      break;
+    case 0x04:
+      _volume = _volume < 30 ? _volume + 1 : 30;
+      break;
+    case 0x05:
+      _volume = _volume ? _volume - 1 : 0;
+      break;
+    case 0x06:
+      _volume = parameter > 30 ? 30 : parameter;
+      break;
+    case 0x07:
+      _eq = parameter;
+      break;
+    case 0x08:    // loop
+      play(parameter, true);
+      break;
+    case 0x0C:    // reset
+      _playing = false;
+      _advertising = false;
+      reply(0x3F, 0x02, _settings.resetDelayUs);
+      break;
+    case 0x0D:    // start
+      if (_playing && _paused) {
+        _paused = false;
+        _trackEndsAt = now + _remainingMs * 1000ULL;
+      }
+      break;
+    case 0x0E:    // pause
+      if (_playing && !_paused) {
+        _paused = true;
+        _remainingMs = _trackEndsAt > now ? (_trackEndsAt - now) / 1000 : 0;
+      }
+      break;
+    case 0x0F:    // play folder, finished events carry the file number
+      play(parameter & 0xFF, false);
+      break;
+    case 0x13:    // advertise, only while a track plays
+      if (_playing && !_paused) {
+        if (!_advertising) {
+          _remainingMs = _trackEndsAt > now ? (_trackEndsAt - now) / 1000 : 0;
+        }
+        _advertising = true;
+        _advertEndsAt = now + _settings.advertMs * 1000ULL;
+      } else {
+        reply(0x40, EMULATOR_ERROR_ADVERTISE, _settings.replyDelayUs);
+      }
+      break;
+    case 0x14:    // play large folder
+      play(parameter & 0x0FFF, false);
+      break;
+    case 0x15:    // stop advertise
+      _advertEndsAt = now;
+      break;
+    case 0x16:    // stop
+      _playing = false;
+      _advertising = false;
+      break;
+    case 0x17:    // loop folder
+    case 0x18:    // random all
+      play(1, false);
+      break;
+    case 0x19:    // single track loop, 0 = on
+      _looping = parameter == 0;
+      break;
+    case 0x42:
+      reply(0x42, _playing ? (_paused ? 2 : 1) : 0, _settings.replyDelayUs);
+      break;
+    case 0x43:
+      reply(0x43, _volume, _settings.replyDelayUs);
+      break;
+    case 0x44:
+      reply(0x44, _eq, _settings.replyDelayUs);
+      break;
+    case 0x47:
+    case 0x48:
+    case 0x49:
+      reply(command, _settings.fileCount, _settings.replyDelayUs);
+      break;
+    case 0x4B:
+    case 0x4C:
+    case 0x4D:
+      reply(command, _track, _settings.replyDelayUs);
+      break;
+    case 0x4E:
+      if (parameter >= 1 && parameter <= _settings.folderCount) {
+        reply(0x4E, _settings.filesPerFolder, _settings.replyDelayUs);
+      } else {
+        reply(0x40, EMULATOR_ERROR_FILE_INDEX, _settings.replyDelayUs);
+      }
+      break;
+    case 0x4F:
+      reply(0x4F, _settings.folderCount, _settings.replyDelayUs);
+      break;
+    default:
+      break;
+  }
+}
+
+void DFPlayerEmulator::reply(uint8_t command, uint16_t parameter, unsigned long delayUs) {
+  uint8_t data[EMULATOR_FRAME_LENGTH];
+  frame(command, parameter, false, data);
+
+  if (nextRandom() % 100 < _settings.dropPercent) {
+    _stats.dropped++;
+    return;
+  }
+  if (nextRandom() % 100 < _settings.corruptPercent) {
+    data[1 + nextRandom() % (EMULATOR_FRAME_LENGTH - 1)] ^= 1 << (nextRandom() % 8);
+    _stats.corrupted++;
+  }
+  _stream->inject(data, EMULATOR_FRAME_LENGTH, delayUs);
+  _stats.replies++;
+  if (command == 0x41) {
+    _stats.acks++;
+  }
+}
+
+void DFPlayerEmulator::update() {
+  uint64_t now = hal::now();
+  if (!_booted && _settings.bootMs && now >= _settings.bootMs * 1000ULL) {
+    _booted = true;
+    reply(0x3F, 0x02, 0);
+  }
+  if (_advertising) {
+    if (now >= _advertEndsAt) {   // back to the interrupted track
+      _advertising = false;
+      _trackEndsAt = now + _remainingMs * 1000ULL;
+    }
+    return;
+  }
+  if (_playing && !_paused && now >= _trackEndsAt) {
+    if (_looping) {
+      _trackEndsAt += trackLength(_track) * 1000ULL;
+    } else {
+      _playing = false;
+      reply(0x3D, _track, 0);
+    }
+  }
+}
+
+void DFPlayerEmulator::report(Print& out) {
+  uint64_t span = _stats.lastFrameAt - _stats.firstFrameAt;
+  out.printf("DFPlayer emulator: %lu frames in, %.1f frames/s, %lu replies (%lu acks), "
+             "%lu dropped, %lu corrupted, %lu bad frames received\n",
+             _stats.framesReceived, span ? _stats.framesReceived * 1e6 / span : 0.0,
+             _stats.replies, _stats.acks, _stats.dropped, _stats.corrupted, _stats.badFrames);
+}
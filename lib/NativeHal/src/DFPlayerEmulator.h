@@ -0,0 +1,101 @@
+/*
+ * DFPlayerEmulator.h
+ * Software DFPlayer Mini on the far end of a SimStream, part of NativeHal.
+ *
+ * Parses the 10 byte 0x7E ... 0xEF frames the firmware sends and answers
+ * like the module does: 0x41 ACKs when the ACK flag is set, 0x3F online
+ * after a reset, 0x3D when a track finishes, 0x40 errors and answers to
+ * the 0x42..0x4F queries. Replies can be delayed, dropped or have a byte
+ * corrupted, to see how the driver copes with a bad line. With a boot time
+ * the module ignores everything until then and announces itself online,
+ * like one whose SD card is slow to mount or that powered up late.
+ *
+ * Call update() once per simulated loop pass so track ends are reported.
+ */
+
+#ifndef NATIVE_HAL_DFPLAYER_EMULATOR_H
+#define NATIVE_HAL_DFPLAYER_EMULATOR_H
+
+#include <map>
+#include <Arduino.h>
+#include "SimStream.h"
+
+#define EMULATOR_FRAME_LENGTH 10
+
+class DFPlayerEmulator {
+  public:
+  struct Settings {
+    unsigned long replyDelayUs = 2000;      // command received to reply
+    unsigned long resetDelayUs = 1500000;   // reset to 0x3F online
+    unsigned long bootMs = 0;               // deaf until then, then 0x3F online
+    unsigned long trackMs = 5000;           // length of tracks without setTrackLength()
+    unsigned long advertMs = 1500;          // length of advertise() inserts
+    uint16_t fileCount = 3;                 // tracks on the SD card
+    uint16_t folderCount = 2;
+    uint16_t filesPerFolder = 3;
+    uint8_t dropPercent = 0;                // replies lost
+    uint8_t corruptPercent = 0;             // replies with one byte flipped
+    unsigned long seed = 1;
+  };
+
+  struct Stats {
+    unsigned long framesReceived = 0;
+    unsigned long badFrames = 0;            // checksum or framing errors
+    unsigned long acks = 0;
+    unsigned long replies = 0;              // everything sent, acks included
+    unsigned long dropped = 0;
+    unsigned long corrupted = 0;
+    uint64_t firstFrameAt = 0;
+    uint64_t lastFrameAt = 0;
+  };
+
+  private:
+  SimStream* _stream = nullptr;
+  Settings _settings;
+  Stats _stats;
+  std::map<uint16_t, unsigned long> _trackMs;
+
+  uint8_t _frame[EMULATOR_FRAME_LENGTH];
+  uint8_t _index = 0;
+  unsigned long _random;
+
+  uint8_t _volume = 30;
+  uint8_t _eq = 0;
+  uint16_t _track = 0;
+  bool _playing = false;
+  bool _paused = false;
+  bool _looping = false;
+  uint64_t _trackEndsAt = 0;
+  unsigned long _remainingMs = 0;   // left of the track when paused or advertising
+  bool _advertising = false;
+  uint64_t _advertEndsAt = 0;
+  bool _booted = false;
+
+  void receive(uint8_t value);
+  void handle(uint8_t command, uint16_t parameter, bool ack);
+  void play(uint16_t track, bool loop);
+  void reply(uint8_t command, uint16_t parameter, unsigned long delayUs);
+  unsigned long trackLength(uint16_t track);
+  unsigned long nextRandom();
+
+  public:
+  // listen on a stream, the firmware's end of the DFPlayer link
+  void attach(SimStream& stream, const Settings& settings);
+
+  void setTrackLength(uint16_t track, unsigned long ms);
+
+  // report finished tracks and adverts, call once per loop pass
+  void update();
+
+  uint16_t track() { return _track; }
+  bool playing() { return _playing && !_paused; }
+  uint8_t volume() { return _volume; }
+  const Stats& stats() { return _stats; }
+
+  // frames per second, acks, errors
+  void report(Print& out);
+
+  static void frame(uint8_t command, uint16_t parameter, bool ack, uint8_t* frame);
+};
+
+#endif
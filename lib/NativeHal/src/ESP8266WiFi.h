@@ -0,0 +1,53 @@
+/*
+ * ESP8266WiFi.h
+ * Host stand-in for the ESP8266 WiFi stack, part of NativeHal.
+ */
+
+#ifndef NATIVE_HAL_ESP8266_WIFI_H
+#define NATIVE_HAL_ESP8266_WIFI_H
+
+#include <Arduino.h>
+#include "IPAddress.h"
+
+enum wl_status_t {
+  WL_IDLE_STATUS = 0,
+  WL_CONNECTED = 3,
+  WL_DISCONNECTED = 6
+};
+
+enum WiFiMode {
+  WIFI_OFF = 0,
+  WIFI_STA = 1,
+  WIFI_AP = 2,
+  WIFI_AP_STA = 3
+};
+
+class ESP8266WiFiClass {
+  WiFiMode _mode = WIFI_OFF;
+  const char* _ssid = "";
+
+  public:
+  bool mode(WiFiMode mode) { _mode = mode; return true; }
+  WiFiMode getMode() { return _mode; }
+
+  // access point at once, clients are simulated, see ESPAsyncWebServer.h
+  bool softAP(const char* ssid, const char* password = nullptr) {
+    (void)password;
+    _ssid = ssid;
+    return password == nullptr || strlen(password) >= 8;
+  }
+  const char* softAPSSID() { return _ssid; }
+
+  // joins at once, the network is the WiFiUDP loopback, see WiFiUdp.h
+  wl_status_t begin(const char* ssid, const char* password = nullptr) {
+    (void)password;
+    _ssid = ssid;
+    return WL_CONNECTED;
+  }
+  wl_status_t status() { return _mode & WIFI_STA ? WL_CONNECTED : WL_DISCONNECTED; }
+  IPAddress localIP() { return IPAddress(192, 168, 4, 2); }
+};
+
+extern ESP8266WiFiClass WiFi;
+
+#endif
@@ -0,0 +1,223 @@
+#include <algorithm>
+#include "ESPAsyncWebServer.h"
+
+static std::vector<AsyncWebServer*>& webServers() {
+  static std::vector<AsyncWebServer*> instances;
+  return instances;
+}
+
+AsyncWebServer* hal::webServer(uint8_t index) {
+  return index < webServers().size() ? webServers()[index] : nullptr;
+}
+
+void AsyncWebSocketClient::send(const uint8_t* message, size_t length, bool binary) {
+  if (_stalled) {
+    if (canSend()) {
+      _queue.push_back(std::make_pair(std::string((const char*)message, length), binary));
+    }
+    return;
+  }
+  if (_server->_onSend) {
+    _server->_onSend(_id, message, length, binary);
+  }
+}
+
+AsyncWebSocket::~AsyncWebSocket() {
+  for (AsyncWebSocketClient* client : _clients) {
+    delete client;
+  }
+  for (AsyncWebSocketMessageBuffer* buffer : _buffers) {
+    delete buffer;
+  }
+}
+
+AsyncWebSocketMessageBuffer* AsyncWebSocket::makeBuffer(size_t size) {
+  _buffers.push_back(new AsyncWebSocketMessageBuffer(size));
+  _buffersMade++;
+  return _buffers.back();
+}
+
+// the library's _cleanBuffers(), only textAll() and binaryAll() call it
+void AsyncWebSocket::cleanBuffers() {
+  for (auto it = _buffers.begin(); it != _buffers.end();) {
+    if ((*it)->canDelete()) {
+      delete *it;
+      it = _buffers.erase(it);
+    } else {
+      ++it;
+    }
+  }
+}
+
+AsyncWebSocketClient* AsyncWebSocket::client(uint32_t id) {
+  for (AsyncWebSocketClient* client : _clients) {
+    if (client->id() == id) {
+      return client;
+    }
+  }
+  return nullptr;
+}
+
+void AsyncWebSocket::textAll(const char* message, size_t length) {
+  for (AsyncWebSocketClient* client : _clients) {
+    client->text(message, length);
+  }
+  cleanBuffers();
+}
+
+void AsyncWebSocket::binaryAll(const char* message, size_t length) {
+  for (AsyncWebSocketClient* client : _clients) {
+    client->binary(message, length);
+  }
+  cleanBuffers();
+}
+
+void AsyncWebSocket::binaryAll(AsyncWebSocketMessageBuffer* buffer) {
+  if (!buffer) {
+    return;
+  }
+  buffer->lock();
+  for (AsyncWebSocketClient* client : _clients) {
+    client->binary(buffer);
+  }
+  buffer->unlock();
+  cleanBuffers();
+}
+
+uint32_t AsyncWebSocket::connect() {
+  AsyncWebSocketClient* client = new AsyncWebSocketClient(this, _nextId++);
+  _clients.push_back(client);
+  if (_handler) {
+    _handler(this, client, WS_EVT_CONNECT, nullptr, nullptr, 0);
+  }
+  return client->id();
+}
+
+void AsyncWebSocket::disconnect(uint32_t id) {
+  AsyncWebSocketClient* gone = client(id);
+  if (!gone) {
+    return;
+  }
+  if (_handler) {
+    _handler(this, gone, WS_EVT_DISCONNECT, nullptr, nullptr, 0);
+  }
+  _clients.erase(std::find(_clients.begin(), _clients.end(), gone));
+  delete gone;
+}
+
+void AsyncWebSocket::receive(uint32_t id, const uint8_t* data, size_t length, bool binary) {
+  AsyncWebSocketClient* from = client(id);
+  if (!from || !_handler) {
+    return;
+  }
+  AwsFrameInfo info = {};
+  info.message_opcode = info.opcode = binary ? WS_BINARY : WS_TEXT;
+  info.final = 1;
+  info.len = length;
+  std::vector<uint8_t> frame(data, data + length);
+  frame.push_back(0);   // the ESP library terminates text frames as well
+  _handler(this, from, WS_EVT_DATA, &info, frame.data(), length);
+}
+
+void AsyncWebSocket::stall(uint32_t id, bool stalled) {
+  AsyncWebSocketClient* target = client(id);
+  if (!target) {
+    return;
+  }
+  target->_stalled = stalled;
+  if (!stalled) {
+    std::vector<std::pair<std::string, bool>> held;
+    held.swap(target->_queue);
+    for (const auto& message : held) {
+      target->send((const uint8_t*)message.first.data(), message.first.size(), message.second);
+    }
+  }
+}
+
+AsyncWebServer::AsyncWebServer(uint16_t port) {
+  (void)port;
+  webServers().push_back(this);
+}
+
+AsyncWebServer::~AsyncWebServer() {
+  for (AsyncStaticWebHandler* handler : _statics) {
+    delete handler;
+  }
+  webServers().erase(std::find(webServers().begin(), webServers().end(), this));
+}
+
+AsyncStaticWebHandler& AsyncWebServer::serveStatic(const char* uri, fs::FS& fs, const char* path, const char* cacheControl) {
+  _statics.push_back(new AsyncStaticWebHandler(uri, fs, path, cacheControl));
+  return *_statics.back();
+}
+
+AsyncWebSocket* AsyncWebServer::webSocket(const char* url) {
+  for (AsyncWebSocket* socket : _sockets) {
+    if (strcmp(socket->url(), url) == 0) {
+      return socket;
+    }
+  }
+  return nullptr;
+}
+
+static const char* contentType(const std::string& path) {
+  static const char* const types[][2] = {
+    {".html", "text/html"}, {".htm", "text/html"}, {".js", "application/javascript"},
+    {".css", "text/css"}, {".ico", "image/x-icon"}, {".png", "image/png"}, {".json", "application/json"}
+  };
+  for (const auto& type : types) {
+    size_t length = strlen(type[0]);
+    if (path.size() >= length && path.compare(path.size() - length, length, type[0]) == 0) {
+      return type[1];
+    }
+  }
+  return "text/plain";
+}
+
+int AsyncWebServer::get(const char* url, Print& out) {
+  for (AsyncWebSocket* socket : _sockets) {
+    if (strcmp(socket->url(), url) == 0) {
+      out.println("HTTP/1.1 101 Switching Protocols");
+      return 101;
+    }
+  }
+  for (AsyncStaticWebHandler* handler : _statics) {
+    if (strncmp(url, handler->_uri.c_str(), handler->_uri.size()) != 0) {
+      continue;
+    }
+    std::string path = handler->_path + (url + handler->_uri.size());
+    if (path.empty() || path.back() == '/') {
+      path += handler->_defaultFile;
+    }
+    File file = handler->_fs.open(path.c_str(), "r");
+    bool gzip = false;
+    if (!file) {
+      file = handler->_fs.open((path + ".gz").c_str(), "r");
+      gzip = (bool)file;
+    }
+    if (!file) {
+      continue;
+    }
+    out.println("HTTP/1.1 200 OK");
+    out.printf("Content-Type: %s\n", contentType(path));
+    out.printf("Content-Length: %u\n", (unsigned)file.size());
+    if (gzip) {
+      out.println("Content-Encoding: gzip");
+    }
+    if (!handler->_cacheControl.empty()) {
+      out.printf("Cache-Control: %s\n", handler->_cacheControl.c_str());
+    }
+    return 200;
+  }
+  AsyncWebServerRequest request(url);
+  if (_notFound) {
+    _notFound(&request);
+  }
+  int status = request._status ? request._status : 404;
+  out.printf("HTTP/1.1 %d\n", status);
+  if (request._status) {
+    out.printf("Content-Type: %s\n", request._type.c_str());
+    out.printf("Content-Length: %u\n", (unsigned)request._length);
+  }
+  return status;
+}
@@ -0,0 +1,230 @@
+/*
+ * ESPAsyncWebServer.h
+ * Host stand-in for ESPAsyncWebServer, part of NativeHal.
+ *
+ * Only what the controller firmware uses is provided: static files from an
+ * FS, a not-found handler and WebSockets. There is no network; simulated
+ * clients are driven from the simulation side. get() answers a GET like the
+ * static handler does on the ESP (plain file first, then a .gz copy with
+ * Content-Encoding: gzip). WebSocket clients are opened with connect() and
+ * send with receive(); every message the firmware sends them goes to the
+ * onSend() handler. Simulated clients never fall behind unless stalled with
+ * stall(), then their messages pile up to WS_MAX_QUEUED_MESSAGES.
+ */
+
+#ifndef NATIVE_HAL_ESP_ASYNC_WEB_SERVER_H
+#define NATIVE_HAL_ESP_ASYNC_WEB_SERVER_H
+
+#include <functional>
+#include <string>
+#include <vector>
+#include <Arduino.h>
+#include "FS.h"
+
+#define WS_MAX_QUEUED_MESSAGES 8
+
+enum AwsEventType {
+  WS_EVT_CONNECT,
+  WS_EVT_DISCONNECT,
+  WS_EVT_PONG,
+  WS_EVT_ERROR,
+  WS_EVT_DATA
+};
+
+enum AwsFrameType {
+  WS_CONTINUATION = 0x00,
+  WS_TEXT = 0x01,
+  WS_BINARY = 0x02,
+  WS_DISCONNECT = 0x08,
+  WS_PING = 0x09,
+  WS_PONG = 0x0A
+};
+
+struct AwsFrameInfo {
+  uint8_t message_opcode;
+  uint32_t num;
+  uint8_t final;
+  uint8_t masked;
+  uint8_t opcode;
+  uint64_t len;
+  uint8_t mask[4];
+  uint64_t index;
+};
+
+class AsyncWebSocket;
+class AsyncWebServerRequest;
+
+// a message filled in once and sent to several clients; as in the library,
+// the AsyncWebSocket that made it only frees it, once unlocked, in
+// textAll() and binaryAll(), a buffer only sent with client->binary() stays
+class AsyncWebSocketMessageBuffer {
+  std::vector<uint8_t> _data;
+  bool _lock = false;
+
+  public:
+  explicit AsyncWebSocketMessageBuffer(size_t size) : _data(size) {}
+
+  uint8_t* get() { return _data.data(); }
+  size_t length() { return _data.size(); }
+  void lock() { _lock = true; }
+  void unlock() { _lock = false; }
+  bool canDelete() { return !_lock; }
+};
+
+class AsyncWebSocketClient {
+  AsyncWebSocket* _server;
+  uint32_t _id;
+  bool _stalled = false;
+  std::vector<std::pair<std::string, bool>> _queue;   // held while stalled
+
+  friend class AsyncWebSocket;
+  void send(const uint8_t* message, size_t length, bool binary);
+
+  public:
+  AsyncWebSocketClient(AsyncWebSocket* server, uint32_t id) : _server(server), _id(id) {}
+
+  uint32_t id() { return _id; }
+  AsyncWebSocket* server() { return _server; }
+  bool canSend() { return _queue.size() < WS_MAX_QUEUED_MESSAGES; }
+  size_t queueLength() { return _queue.size(); }
+
+  void text(const char* message, size_t length) { send((const uint8_t*)message, length, false); }
+  void text(const char* message) { text(message, strlen(message)); }
+  void text(uint8_t* message, size_t length) { send(message, length, false); }
+  void binary(const char* message, size_t length) { send((const uint8_t*)message, length, true); }
+  void binary(uint8_t* message, size_t length) { send(message, length, true); }
+  void binary(AsyncWebSocketMessageBuffer* buffer) {
+    if (buffer) {
+      send(buffer->get(), buffer->length(), true);
+    }
+  }
+};
+
+typedef std::function<void(AsyncWebSocket* server, AsyncWebSocketClient* client, AwsEventType type,
+                           void* arg, uint8_t* data, size_t length)> AwsEventHandler;
+typedef std::function<void(uint32_t id, const uint8_t* data, size_t length, bool binary)> SimSendHandler;
+typedef std::function<void(AsyncWebServerRequest* request)> ArRequestHandlerFunction;
+
+class AsyncWebHandler {
+  public:
+  virtual ~AsyncWebHandler() {}
+};
+
+class AsyncWebSocket : public AsyncWebHandler {
+  std::string _url;
+  AwsEventHandler _handler;
+  SimSendHandler _onSend;
+  std::vector<AsyncWebSocketClient*> _clients;
+  std::vector<AsyncWebSocketMessageBuffer*> _buffers;
+  unsigned long _buffersMade = 0;
+  uint32_t _nextId = 1;
+
+  friend class AsyncWebSocketClient;
+  AsyncWebSocketClient* client(uint32_t id);
+  void cleanBuffers();
+
+  public:
+  explicit AsyncWebSocket(const char* url) : _url(url) {}
+  ~AsyncWebSocket();
+
+  const char* url() { return _url.c_str(); }
+  void onEvent(AwsEventHandler handler) { _handler = handler; }
+  size_t count() { return _clients.size(); }
+  void cleanupClients() {}
+
+  void textAll(const char* message, size_t length);
+  void textAll(const char* message) { textAll(message, strlen(message)); }
+  void binaryAll(const char* message, size_t length);
+  void binaryAll(uint8_t* message, size_t length) { binaryAll((const char*)message, length); }
+  void binaryAll(AsyncWebSocketMessageBuffer* buffer);
+  AsyncWebSocketMessageBuffer* makeBuffer(size_t size = 0);
+
+  // simulation side
+
+  // a client connects, returns its id
+  uint32_t connect();
+
+  void disconnect(uint32_t id);
+
+  // a message from client id arrives in one frame
+  void receive(uint32_t id, const uint8_t* data, size_t length, bool binary = false);
+
+  // client id stops reading, or catches up on what was held back
+  void stall(uint32_t id, bool stalled);
+
+  // called for every message a client gets
+  void onSend(SimSendHandler handler) { _onSend = handler; }
+
+  // message buffers made so far, each one a heap allocation on the ESP,
+  // and those not freed yet
+  unsigned long buffersMade() { return _buffersMade; }
+  size_t buffersHeld() { return _buffers.size(); }
+};
+
+class AsyncStaticWebHandler : public AsyncWebHandler {
+  std::string _uri;
+  fs::FS& _fs;
+  std::string _path;
+  std::string _defaultFile = "index.htm";
+  std::string _cacheControl;
+
+  friend class AsyncWebServer;
+
+  public:
+  AsyncStaticWebHandler(const char* uri, fs::FS& fs, const char* path, const char* cacheControl)
+    : _uri(uri), _fs(fs), _path(path), _cacheControl(cacheControl ? cacheControl : "") {}
+
+  AsyncStaticWebHandler& setDefaultFile(const char* filename) { _defaultFile = filename; return *this; }
+  AsyncStaticWebHandler& setCacheControl(const char* cacheControl) { _cacheControl = cacheControl; return *this; }
+};
+
+class AsyncWebServerRequest {
+  const char* _url;
+  int _status = 0;
+  std::string _type;
+  size_t _length = 0;
+
+  friend class AsyncWebServer;
+
+  public:
+  explicit AsyncWebServerRequest(const char* url) : _url(url) {}
+
+  const char* url() { return _url; }
+  void send(int code, const char* contentType, const char* content) {
+    _status = code;
+    _type = contentType;
+    _length = strlen(content);
+  }
+};
+
+class AsyncWebServer {
+  std::vector<AsyncWebSocket*> _sockets;
+  std::vector<AsyncStaticWebHandler*> _statics;
+  ArRequestHandlerFunction _notFound;
+
+  public:
+  explicit AsyncWebServer(uint16_t port);
+  ~AsyncWebServer();
+
+  void begin() {}
+  AsyncWebHandler& addHandler(AsyncWebSocket* socket) { _sockets.push_back(socket); return *socket; }
+  AsyncStaticWebHandler& serveStatic(const char* uri, fs::FS& fs, const char* path, const char* cacheControl = nullptr);
+  void onNotFound(ArRequestHandlerFunction handler) { _notFound = handler; }
+
+  // simulation side
+
+  // answer a GET, prints the status line and headers to out, returns the status
+  int get(const char* url, Print& out);
+
+  // the WebSocket added for url, nullptr if none
+  AsyncWebSocket* webSocket(const char* url);
+};
+
+namespace hal {
+
+// AsyncWebServer instances in construction order, nullptr if out of range
+AsyncWebServer* webServer(uint8_t index);
+
+}
+
+#endif
@@ -0,0 +1,23 @@
+/*
+ * Esp.h
+ * Host version of the ESP8266 core's ESP object, part of NativeHal.
+ *
+ * The cycle counter runs off the virtual clock at 80 cycles per us, so it
+ * only moves where the simulation spends virtual time.
+ */
+
+#ifndef NATIVE_HAL_ESP_H
+#define NATIVE_HAL_ESP_H
+
+#include <stdint.h>
+
+class EspClass {
+  public:
+  uint32_t getCycleCount();
+  uint8_t getCpuFreqMHz() { return 80; }
+  uint32_t random();    // the host's random device, like the ESP's hardware RNG
+};
+
+extern EspClass ESP;
+
+#endif
@@ -0,0 +1,104 @@
+#include <sys/stat.h>
+#include "FS.h"
+
+// a scratch directory, not data/: what the firmware writes there, such as
+// the sound catalog, must not end up in the LittleFS image
+#ifndef HAL_FS_ROOT
+#define HAL_FS_ROOT ".pio/sim_fs"
+#endif
+
+fs::FS LittleFS(HAL_FS_ROOT);
+
+namespace fs {
+
+File::File(FILE* file, const char* name) : _file(file, fclose), _name(name) {
+}
+
+int File::available() {
+  return _file ? (int)(size() - position()) : 0;
+}
+
+int File::read() {
+  return _file ? fgetc(_file.get()) : -1;
+}
+
+int File::peek() {
+  if (!_file) {
+    return -1;
+  }
+  int value = fgetc(_file.get());
+  if (value != EOF) {
+    ungetc(value, _file.get());
+  }
+  return value;
+}
+
+size_t File::read(uint8_t* buffer, size_t size) {
+  return _file ? fread(buffer, 1, size, _file.get()) : 0;
+}
+
+size_t File::write(uint8_t value) {
+  return write(&value, 1);
+}
+
+size_t File::write(const uint8_t* buffer, size_t size) {
+  return _file ? fwrite(buffer, 1, size, _file.get()) : 0;
+}
+
+bool File::seek(uint32_t position) {
+  return _file && fseek(_file.get(), position, SEEK_SET) == 0;
+}
+
+size_t File::position() const {
+  return _file ? ftell(_file.get()) : 0;
+}
+
+size_t File::size() const {
+  if (!_file) {
+    return 0;
+  }
+  struct stat info;
+  fflush(_file.get());
+  return fstat(fileno(_file.get()), &info) == 0 ? info.st_size : 0;
+}
+
+void File::close() {
+  _file.reset();
+}
+
+std::string FS::hostPath(const char* path) {
+  return _root + (path[0] == '/' ? "" : "/") + path;
+}
+
+// like LittleFS.begin(), which formats a flash it cannot mount, an empty
+// filesystem is made when the directory is missing
+bool FS::begin() {
+  for (size_t at = _root.find('/', 1); at != std::string::npos; at = _root.find('/', at + 1)) {
+    mkdir(_root.substr(0, at).c_str(), 0755);
+  }
+  mkdir(_root.c_str(), 0755);
+  struct stat info;
+  return stat(_root.c_str(), &info) == 0 && S_ISDIR(info.st_mode);
+}
+
+File FS::open(const char* path, const char* mode) {
+  std::string hostMode = mode;
+  hostMode += "b";
+  FILE* file = fopen(hostPath(path).c_str(), hostMode.c_str());
+  return file ? File(file, path) : File();
+}
+
+bool FS::exists(const char* path) {
+  struct stat info;
+  return stat(hostPath(path).c_str(), &info) == 0;
+}
+
+bool FS::remove(const char* path) {
+  return ::remove(hostPath(path).c_str()) == 0;
+}
+
+bool FS::rename(const char* from, const char* to) {
+  return ::rename(hostPath(from).c_str(), hostPath(to).c_str()) == 0;
+}
+
+}
@@ -0,0 +1,67 @@
+/*
+ * FS.h
+ * Host version of the ESP8266 file system API, part of NativeHal.
+ *
+ * Paths are mapped onto a host directory, by default the project's data/
+ * folder, so the simulation sees the same files uploadfs would flash.
+ */
+
+#ifndef NATIVE_HAL_FS_H
+#define NATIVE_HAL_FS_H
+
+#include <stdio.h>
+#include <memory>
+#include <string>
+#include "Stream.h"
+
+namespace fs {
+
+class File : public Stream {
+  std::shared_ptr<FILE> _file;
+  std::string _name;
+
+  public:
+  File() {}
+  File(FILE* file, const char* name);
+
+  explicit operator bool() const { return (bool)_file; }
+
+  int available() override;
+  int read() override;
+  int peek() override;
+  size_t read(uint8_t* buffer, size_t size);
+  size_t write(uint8_t value) override;
+  size_t write(const uint8_t* buffer, size_t size) override;
+  using Print::write;
+  bool seek(uint32_t position);
+  size_t position() const;
+  size_t size() const;
+  void close();
+  const char* name() const { return _name.c_str(); }
+};
+
+class FS {
+  std::string _root;
+
+  std::string hostPath(const char* path);
+
+  public:
+  explicit FS(const char* root) : _root(root) {}
+
+  bool begin();
+  void end() {}
+  File open(const char* path, const char* mode);
+  bool exists(const char* path);
+  bool remove(const char* path);
+  bool rename(const char* from, const char* to);
+
+  // simulation side
+  void setRoot(const char* root) { _root = root; }
+};
+
+}
+
+using fs::File;
+using fs::FS;
+
+#endif
@@ -0,0 +1,60 @@
+/*
+ * HardwareSerial.h
+ * Host version of the ESP8266 UARTs, part of NativeHal.
+ *
+ * Serial and Serial1 (TX only) echo what the firmware prints to stdout
+ * while set to SERIAL_8N1, the console format. After swap() Serial is on
+ * the alternate pins, where a device listens instead of the console, and
+ * stops echoing.
+ *
+ * Writes go through a UART_TX_FIFO_SIZE byte TX FIFO that drains one byte
+ * time per byte at the set baud rate and format; a write to a full FIFO
+ * waits for room, like the real UART. onTransmit() sees every byte with
+ * the virtual time its start bit goes out.
+ */
+
+#ifndef NATIVE_HAL_HARDWARE_SERIAL_H
+#define NATIVE_HAL_HARDWARE_SERIAL_H
+
+#include <functional>
+#include "SimStream.h"
+
+#define UART_TX_FIFO_SIZE 0x80
+
+enum SerialConfig {
+  SERIAL_8N1,
+  SERIAL_8N2
+};
+
+class HardwareSerial : public SimStream {
+  bool _echo;
+  SerialConfig _config = SERIAL_8N1;
+  uint64_t _txIdleAt = 0;       // virtual us the last queued byte is out
+  std::function<void(uint8_t value, uint64_t at, unsigned long baud)> _onTransmit;
+
+  public:
+  explicit HardwareSerial(bool echo) : _echo(echo) {}
+
+  void begin(unsigned long baud, SerialConfig config = SERIAL_8N1);
+  void updateBaudRate(unsigned long baud);
+
+  size_t write(uint8_t value) override;
+  using Print::write;
+  int availableForWrite() override;
+  void flush() override;        // waits until the last byte is out
+
+  void setEcho(bool echo) { _echo = echo; }
+  void swap() { _echo = false; }
+
+  // simulation side
+
+  // called for every byte with the virtual us its start bit goes out
+  void onTransmit(std::function<void(uint8_t value, uint64_t at, unsigned long baud)> handler) {
+    _onTransmit = handler;
+  }
+};
+
+extern HardwareSerial Serial;
+extern HardwareSerial Serial1;
+
+#endif
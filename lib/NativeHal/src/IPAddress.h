@@ -0,0 +1,25 @@
+/*
+ * IPAddress.h
+ * Host version of the Arduino IPAddress class, part of NativeHal.
+ */
+
+#ifndef NATIVE_HAL_IP_ADDRESS_H
+#define NATIVE_HAL_IP_ADDRESS_H
+
+#include <stdint.h>
+
+class IPAddress {
+  uint8_t _bytes[4];
+
+  public:
+  IPAddress() : _bytes{0, 0, 0, 0} {}
+  IPAddress(uint8_t a, uint8_t b, uint8_t c, uint8_t d) : _bytes{a, b, c, d} {}
+
+  uint8_t operator[](int index) const { return _bytes[index]; }
+  bool operator==(const IPAddress& other) const {
+    return _bytes[0] == other._bytes[0] && _bytes[1] == other._bytes[1] &&
+           _bytes[2] == other._bytes[2] && _bytes[3] == other._bytes[3];
+  }
+};
+
+#endif
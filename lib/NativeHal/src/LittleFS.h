@@ -0,0 +1,13 @@
+/*
+ * LittleFS.h
+ * Host stand-in for the LittleFS flash file system, part of NativeHal.
+ */
+
+#ifndef NATIVE_HAL_LITTLE_FS_H
+#define NATIVE_HAL_LITTLE_FS_H
+
+#include "FS.h"
+
+extern fs::FS LittleFS;
+
+#endif
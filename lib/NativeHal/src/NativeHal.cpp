@@ -0,0 +1,553 @@
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+#include <algorithm>
+#include <random>
+#include "NativeHal.h"
+#include "LittleFS.h"
+#include "ESP8266WiFi.h"
+#include "DFPlayerEmulator.h"
+#include "ESPAsyncWebServer.h"
+#include "WiFiUdp.h"
+
+ESP8266WiFiClass WiFi;
+EspClass ESP;
+
+static uint64_t clockUs = 0;
+static int masked = 0;
+
+static uint8_t pinModes[HAL_PIN_COUNT];
+static uint8_t pinLevels[HAL_PIN_COUNT];
+static hal::PinListener pinListener = nullptr;
+static uint32_t pinReadCount = 0;
+
+static timercallback timerCallback = nullptr;
+static bool timerEnabled = false;
+static bool timerArmed = false;
+static uint8_t timerDivider = 1;
+static uint64_t timerDeadline = 0;
+
+static unsigned long randomState = 1;
+
+// fires timer1 if its deadline has passed and interrupts are on
+static void serviceTimer() {
+  while (!masked && timerArmed && timerDeadline <= clockUs) {
+    timerArmed = false;
+    if (timerCallback) {
+      masked++;   // the ISR runs with interrupts off
+      timerCallback();
+      masked--;
+    }
+  }
+}
+
+uint64_t hal::now() {
+  return clockUs;
+}
+
+void hal::advance(uint64_t us) {
+  uint64_t target = clockUs + us;
+  while (!masked && timerArmed && timerDeadline <= target) {
+    if (timerDeadline > clockUs) {
+      clockUs = timerDeadline;
+    }
+    serviceTimer();
+  }
+  clockUs = target;
+}
+
+void hal::advanceMasked(uint64_t us) {
+  masked++;
+  clockUs += us;
+  masked--;
+  serviceTimer();   // a deadline that passed meanwhile fires late
+}
+
+void hal::setInput(uint8_t pin, uint8_t level) {
+  if (pin < HAL_PIN_COUNT) {
+    pinLevels[pin] = level ? HIGH : LOW;
+  }
+}
+
+uint8_t hal::pinLevel(uint8_t pin) {
+  return pin < HAL_PIN_COUNT ? pinLevels[pin] : LOW;
+}
+
+uint32_t hal::pinReads() {
+  return pinReadCount;
+}
+
+void hal::onPinChange(PinListener listener) {
+  pinListener = listener;
+}
+
+const char* hal::pinName(uint8_t pin) {
+  static const char* const names[HAL_PIN_COUNT] = {
+    "D3", "TX", "D4", "RX", "D2", "D1", "GPIO6", "GPIO7",
+    "GPIO8", "SD2", "SD3", "GPIO11", "D6", "D7", "D5", "D8", "D0"
+  };
+  return pin < HAL_PIN_COUNT ? names[pin] : "?";
+}
+
+void hal::reset() {
+  clockUs = 0;
+  masked = 0;
+  memset(pinModes, 0, sizeof(pinModes));
+  memset(pinLevels, 0, sizeof(pinLevels));
+  pinReadCount = 0;
+  timerArmed = false;
+}
+
+unsigned long millis() {
+  return clockUs / 1000;
+}
+
+unsigned long micros() {
+  return clockUs;
+}
+
+uint32_t EspClass::getCycleCount() {
+  return (uint32_t)(clockUs * 80);
+}
+
+uint32_t EspClass::random() {
+  static std::random_device device;
+  return device();
+}
+
+void delay(unsigned long ms) {
+  hal::advance(ms ? ms * 1000ULL : HAL_YIELD_US);
+}
+
+void delayMicroseconds(unsigned int us) {
+  hal::advance(us);
+}
+
+void yield() {
+  hal::advance(HAL_YIELD_US);
+}
+
+void pinMode(uint8_t pin, uint8_t mode) {
+  if (pin < HAL_PIN_COUNT) {
+    pinModes[pin] = mode;
+  }
+}
+
+void digitalWrite(uint8_t pin, uint8_t value) {
+  if (pin >= HAL_PIN_COUNT) {
+    return;
+  }
+  value = value ? HIGH : LOW;
+  if (pinLevels[pin] != value) {
+    pinLevels[pin] = value;
+    if (pinListener && pinModes[pin] == OUTPUT) {
+      pinListener(pin, value, clockUs);
+    }
+  }
+}
+
+int digitalRead(uint8_t pin) {
+  pinReadCount++;
+  return hal::pinLevel(pin);
+}
+
+void noInterrupts() {
+  masked = 1;
+}
+
+void interrupts() {
+  masked = 0;
+  serviceTimer();
+}
+
+long random(long max) {
+  if (max <= 0) {
+    return 0;
+  }
+  randomState = randomState * 1103515245UL + 12345UL;
+  return (long)((randomState >> 16) % (unsigned long)max);
+}
+
+long random(long min, long max) {
+  return max > min ? min + random(max - min) : min;
+}
+
+void randomSeed(unsigned long seed) {
+  randomState = seed ? seed : 1;
+}
+
+void timer1_isr_init() {
+  timerArmed = false;
+}
+
+void timer1_attachInterrupt(timercallback userFunc) {
+  timerCallback = userFunc;
+}
+
+void timer1_detachInterrupt() {
+  timerCallback = nullptr;
+  timerArmed = false;
+}
+
+void timer1_enable(uint8_t divider, uint8_t intType, uint8_t reload) {
+  (void)intType;
+  (void)reload;
+  timerDivider = divider == TIM_DIV256 ? 256 : divider == TIM_DIV16 ? 16 : 1;
+  timerEnabled = true;
+}
+
+void timer1_disable() {
+  timerEnabled = false;
+  timerArmed = false;
+}
+
+void timer1_write(uint32_t ticks) {
+  if (!timerEnabled) {
+    return;
+  }
+  timerDeadline = clockUs + ((uint64_t)ticks * timerDivider + 79) / 80;   // 80 MHz base clock
+  timerArmed = true;
+}
+
+#ifndef UNIT_TEST
+
+void setup();
+void loop();
+
+struct InputEvent {
+  uint64_t at;
+  uint8_t pin;
+  uint8_t level;
+};
+
+#define RX_PORT_SERIAL 0xFF   // RxEvent for Serial rather than a SoftwareSerial
+#define HAL_PLAYERS 3         // DFPlayer emulators, one per SoftwareSerial
+
+struct RxEvent {
+  uint64_t at;
+  uint8_t port;
+  std::vector<uint8_t> data;
+};
+
+enum WebEventKind {
+  WEB_GET,              // GET of text
+  WEB_TEXT,             // WebSocket messages
+  WEB_BINARY,
+  WEB_STALL,            // the WebSocket client stops reading
+  WEB_RESUME
+};
+
+struct WebEvent {
+  uint64_t at;
+  WebEventKind kind;
+  std::string text;
+};
+
+struct UdpEvent {
+  uint64_t at;
+  uint16_t port;
+  std::vector<uint8_t> data;
+};
+
+static bool quiet = false;
+
+// reports of the simulation itself, Serial may be taken by the firmware
+class StdoutPrint : public Print {
+  public:
+  size_t write(uint8_t value) override { return putchar(value) != EOF; }
+};
+
+static void tracePin(uint8_t pin, uint8_t level, uint64_t at) {
+  if (!quiet) {
+    printf("[%10.3f ms] %-5s %s\n", at / 1000.0, hal::pinName(pin), level ? "HIGH" : "LOW");
+  }
+}
+
+static int parsePin(const char* name) {
+  for (uint8_t pin = 0; pin < HAL_PIN_COUNT; pin++) {
+    if (strcmp(name, hal::pinName(pin)) == 0) {
+      return pin;
+    }
+  }
+  char* end;
+  long pin = strtol(name, &end, 10);
+  return *end == '\0' && pin >= 0 && pin < HAL_PIN_COUNT ? pin : -1;
+}
+
+static void usage(const char* program) {
+  fprintf(stderr,
+    "usage: %s [options]\n"
+    "  --run <ms>                   virtual time to simulate (default 30000)\n"
+    "  --loop <us>                  virtual time per loop() pass (default 100)\n"
+    "  --input <pin>=<0|1>@<ms>     drive an input pin, pin as D5 or GPIO number\n"
+    "  --rx <port>=<hex bytes>@<ms> send bytes to SoftwareSerial <port>\n"
+    "  --serial <text>@<ms>         send text to Serial, like typing in a terminal\n"
+    "  --ws <text>@<ms>             send a WebSocket text message to /ws of the\n"
+    "                               first AsyncWebServer, connecting first\n"
+    "  --ws-hex <hex bytes>@<ms>    same as a binary message\n"
+    "  --ws-stall <ms>-<ms>         the WebSocket client stops reading meanwhile\n"
+    "  --http <path>@<ms>           GET path from the first AsyncWebServer\n"
+    "  --udp <port>=<hex bytes>@<ms> broadcast a UDP packet to <port>\n"
+    "  --udp-delay <us>             UDP delivery time (default 1000)\n"
+    "  --udp-trace                  print the UDP packets the firmware sends\n"
+    "  --fs <dir>                   host directory used as LittleFS (default .pio/sim_fs)\n"
+    "  --player-delay <us>          DFPlayer reply delay (default 2000)\n"
+    "  --player-boot <ms>           DFPlayer ignores everything until then\n"
+    "  --player-drop <percent>      DFPlayer replies lost\n"
+    "  --player-corrupt <percent>   DFPlayer replies with a flipped bit\n"
+    "  --player-seed <n>            random seed for drops and corruption (default 1)\n"
+    "  --track <n>=<ms>             length of DFPlayer track n (default 5000)\n"
+    "  --no-player                  no DFPlayer emulator on each SoftwareSerial, up\n"
+    "                               to 3, or Serial if the firmware has none\n"
+    "  --quiet                      do not trace output pins\n",
+    program);
+}
+
+// runs the firmware against the virtual clock, faster than real time
+int main(int argc, char** argv) {
+  uint64_t runUs = 30000000ULL;
+  uint64_t loopUs = 100;
+  std::vector<InputEvent> inputs;
+  std::vector<RxEvent> rx;
+  std::vector<WebEvent> web;
+  std::vector<UdpEvent> udp;
+  bool udpTrace = false;
+  DFPlayerEmulator players[HAL_PLAYERS];
+  uint8_t playerCount = 0;
+  DFPlayerEmulator::Settings playerSettings;
+  bool withPlayer = true;
+
+  for (int i = 1; i < argc; i++) {
+    const char* value = i + 1 < argc ? argv[i + 1] : nullptr;
+    if (strcmp(argv[i], "--quiet") == 0) {
+      quiet = true;
+    } else if (value && strcmp(argv[i], "--run") == 0) {
+      runUs = strtoull(value, nullptr, 10) * 1000ULL;
+      i++;
+    } else if (value && strcmp(argv[i], "--loop") == 0) {
+      loopUs = strtoull(value, nullptr, 10);
+      i++;
+    } else if (value && strcmp(argv[i], "--fs") == 0) {
+      LittleFS.setRoot(value);
+      i++;
+    } else if (strcmp(argv[i], "--udp-trace") == 0) {
+      udpTrace = true;
+    } else if (value && strcmp(argv[i], "--udp-delay") == 0) {
+      hal::udpDelay(strtoull(value, nullptr, 10));
+      i++;
+    } else if (value && strcmp(argv[i], "--udp") == 0) {
+      unsigned port;
+      char hex[512];
+      double at;
+      if (sscanf(value, "%u=%511[0-9a-fA-F]@%lf", &port, hex, &at) != 3 || strlen(hex) % 2) {
+        usage(argv[0]);
+        return 2;
+      }
+      UdpEvent event = {(uint64_t)(at * 1000), (uint16_t)port, {}};
+      for (size_t j = 0; hex[j]; j += 2) {
+        char byte[3] = {hex[j], hex[j + 1], '\0'};
+        event.data.push_back((uint8_t)strtoul(byte, nullptr, 16));
+      }
+      udp.push_back(event);
+      i++;
+    } else if (strcmp(argv[i], "--no-player") == 0) {
+      withPlayer = false;
+    } else if (value && strcmp(argv[i], "--player-delay") == 0) {
+      playerSettings.replyDelayUs = strtoul(value, nullptr, 10);
+      i++;
+    } else if (value && strcmp(argv[i], "--player-boot") == 0) {
+      playerSettings.bootMs = strtoul(value, nullptr, 10);
+      i++;
+    } else if (value && strcmp(argv[i], "--player-drop") == 0) {
+      playerSettings.dropPercent = strtoul(value, nullptr, 10);
+      i++;
+    } else if (value && strcmp(argv[i], "--player-corrupt") == 0) {
+      playerSettings.corruptPercent = strtoul(value, nullptr, 10);
+      i++;
+    } else if (value && strcmp(argv[i], "--player-seed") == 0) {
+      playerSettings.seed = strtoul(value, nullptr, 10);
+      i++;
+    } else if (value && strcmp(argv[i], "--track") == 0) {
+      unsigned track;
+      unsigned long ms;
+      if (sscanf(value, "%u=%lu", &track, &ms) != 2) {
+        usage(argv[0]);
+        return 2;
+      }
+      for (DFPlayerEmulator& player : players) {
+        player.setTrackLength(track, ms);
+      }
+      i++;
+    } else if (value && strcmp(argv[i], "--input") == 0) {
+      char pin[16];
+      int level;
+      double at;
+      if (sscanf(value, "%15[^=]=%d@%lf", pin, &level, &at) != 3 || parsePin(pin) < 0) {
+        usage(argv[0]);
+        return 2;
+      }
+      inputs.push_back({(uint64_t)(at * 1000), (uint8_t)parsePin(pin), (uint8_t)(level ? HIGH : LOW)});
+      i++;
+    } else if (value && strcmp(argv[i], "--rx") == 0) {
+      unsigned port;
+      char hex[256];
+      double at;
+      if (sscanf(value, "%u=%255[0-9a-fA-F]@%lf", &port, hex, &at) != 3 || strlen(hex) % 2) {
+        usage(argv[0]);
+        return 2;
+      }
+      RxEvent event = {(uint64_t)(at * 1000), (uint8_t)port, {}};
+      for (size_t j = 0; hex[j]; j += 2) {
+        char byte[3] = {hex[j], hex[j + 1], '\0'};
+        event.data.push_back((uint8_t)strtoul(byte, nullptr, 16));
+      }
+      rx.push_back(event);
+      i++;
+    } else if (value && (strcmp(argv[i], "--ws") == 0 || strcmp(argv[i], "--http") == 0)) {
+      const char* at = strrchr(value, '@');
+      if (!at || at == value) {
+        usage(argv[0]);
+        return 2;
+      }
+      WebEventKind kind = strcmp(argv[i], "--http") == 0 ? WEB_GET : WEB_TEXT;
+      web.push_back({(uint64_t)(atof(at + 1) * 1000), kind, std::string(value, at)});
+      i++;
+    } else if (value && strcmp(argv[i], "--ws-stall") == 0) {
+      double from, to;
+      if (sscanf(value, "%lf-%lf", &from, &to) != 2 || to < from) {
+        usage(argv[0]);
+        return 2;
+      }
+      web.push_back({(uint64_t)(from * 1000), WEB_STALL, "stall"});
+      web.push_back({(uint64_t)(to * 1000), WEB_RESUME, "resume"});
+      i++;
+    } else if (value && strcmp(argv[i], "--ws-hex") == 0) {
+      char hex[512];
+      double at;
+      if (sscanf(value, "%511[0-9a-fA-F]@%lf", hex, &at) != 2 || strlen(hex) % 2) {
+        usage(argv[0]);
+        return 2;
+      }
+      WebEvent event = {(uint64_t)(at * 1000), WEB_BINARY, ""};
+      for (size_t j = 0; hex[j]; j += 2) {
+        char byte[3] = {hex[j], hex[j + 1], '\0'};
+        event.text.push_back((char)strtoul(byte, nullptr, 16));
+      }
+      web.push_back(event);
+      i++;
+    } else if (value && strcmp(argv[i], "--serial") == 0) {
+      const char* at = strrchr(value, '@');
+      if (!at || at == value) {
+        usage(argv[0]);
+        return 2;
+      }
+      RxEvent event = {(uint64_t)(atof(at + 1) * 1000), RX_PORT_SERIAL, {}};
+      event.data.assign(value, at);
+      rx.push_back(event);
+      i++;
+    } else {
+      usage(argv[0]);
+      return 2;
+    }
+  }
+
+  std::stable_sort(inputs.begin(), inputs.end(),
+    [](const InputEvent& a, const InputEvent& b) { return a.at < b.at; });
+  std::stable_sort(rx.begin(), rx.end(),
+    [](const RxEvent& a, const RxEvent& b) { return a.at < b.at; });
+  std::stable_sort(web.begin(), web.end(),
+    [](const WebEvent& a, const WebEvent& b) { return a.at < b.at; });
+  std::stable_sort(udp.begin(), udp.end(),
+    [](const UdpEvent& a, const UdpEvent& b) { return a.at < b.at; });
+  for (const RxEvent& event : rx) {   // queued up front so they also arrive during setup()
+    SimStream* port = event.port == RX_PORT_SERIAL ? &Serial : hal::softwareSerial(event.port);
+    if (port) {
+      port->inject(event.data.data(), event.data.size(), event.at);
+    }
+  }
+
+  if (withPlayer) {
+    if (!hal::softwareSerial(0)) {
+      players[playerCount++].attach(Serial, playerSettings);
+    }
+    for (; playerCount < HAL_PLAYERS && hal::softwareSerial(playerCount); playerCount++) {
+      DFPlayerEmulator::Settings settings = playerSettings;
+      settings.seed += playerCount;   // each loses different replies
+      players[playerCount].attach(*hal::softwareSerial(playerCount), settings);
+    }
+  }
+
+  hal::onPinChange(tracePin);
+  if (udpTrace) {
+    hal::onUdpSend([](uint16_t port, const uint8_t* data, size_t length) {
+      printf("[%10.3f ms] udp<%u ", hal::now() / 1000.0, (unsigned)port);
+      for (size_t j = 0; j < length; j++) {
+        printf("%02x", data[j]);
+      }
+      printf("\n");
+    });
+  }
+  size_t nextInput = 0;
+  size_t nextWeb = 0;
+  size_t nextUdp = 0;
+  uint32_t wsClient = 0;
+  bool started = false;
+  StdoutPrint out;
+
+  while (hal::now() < runUs) {
+    while (nextInput < inputs.size() && inputs[nextInput].at <= hal::now()) {
+      hal::setInput(inputs[nextInput].pin, inputs[nextInput].level);
+      nextInput++;
+    }
+    while (started && nextWeb < web.size() && web[nextWeb].at <= hal::now() && hal::webServer(0)) {
+      const WebEvent& event = web[nextWeb++];
+      AsyncWebServer* server = hal::webServer(0);
+      printf("[%10.3f ms] %-5s ", hal::now() / 1000.0, event.kind == WEB_GET ? "GET" : "ws>");
+      for (char c : event.text) {
+        printf(event.kind == WEB_BINARY ? "%02x" : "%c", (uint8_t)c);
+      }
+      printf("\n");
+      if (event.kind == WEB_GET) {
+        server->get(event.text.c_str(), out);
+        continue;
+      }
+      AsyncWebSocket* socket = server->webSocket("/ws");
+      if (socket && !wsClient) {
+        socket->onSend([](uint32_t id, const uint8_t* data, size_t length, bool binary) {
+          printf("[%10.3f ms] ws<%-2u ", hal::now() / 1000.0, (unsigned)id);
+          for (size_t j = 0; j < length; j++) {
+            printf(binary ? "%02x" : "%c", data[j]);
+          }
+          printf("\n");
+        });
+        wsClient = socket->connect();
+      }
+      if (socket && (event.kind == WEB_STALL || event.kind == WEB_RESUME)) {
+        socket->stall(wsClient, event.kind == WEB_STALL);
+      } else if (socket) {
+        socket->receive(wsClient, (const uint8_t*)event.text.data(), event.text.size(), event.kind == WEB_BINARY);
+      }
+    }
+    while (started && nextUdp < udp.size() && udp[nextUdp].at <= hal::now()) {   // sockets open in setup()
+      hal::udpInject(udp[nextUdp].port, udp[nextUdp].data.data(), udp[nextUdp].data.size());
+      nextUdp++;
+    }
+    if (!started) {
+      setup();
+      started = true;
+    } else {
+      loop();
+    }
+    for (uint8_t i = 0; i < playerCount; i++) {
+      players[i].update();
+    }
+    hal::advance(loopUs);
+  }
+  for (uint8_t i = 0; i < playerCount; i++) {
+    players[i].report(out);
+  }
+  fflush(stdout);
+  return 0;
+}
+
+#endif
@@ -0,0 +1,60 @@
+/*
+ * NativeHal.h
+ * Simulation controls for running the controller firmware on the host.
+ *
+ * The firmware's setup() and loop() run against a virtual clock. Time only
+ * moves when the simulation calls advance(), when the firmware waits with
+ * delay()/yield(), or when a bit-banged serial link sends a byte. timer1
+ * interrupts fire at their exact virtual deadline unless interrupts are
+ * masked, in which case they fire as soon as they are unmasked.
+ *
+ * Unless built for unit tests, NativeHal provides main(), which runs the
+ * firmware faster than real time and traces every output pin change.
+ * See main() in NativeHal.cpp for the command line.
+ */
+
+#ifndef NATIVE_HAL_H
+#define NATIVE_HAL_H
+
+#include <Arduino.h>
+#include "SimStream.h"
+
+#define HAL_PIN_COUNT 17      // GPIO0..GPIO16
+#define HAL_YIELD_US 10       // virtual cost of delay(0) and yield()
+
+namespace hal {
+
+typedef void (*PinListener)(uint8_t pin, uint8_t level, uint64_t at);
+
+// virtual time in us since boot
+uint64_t now();
+
+// move the clock forward, firing timer1 on the way
+void advance(uint64_t us);
+
+// move the clock forward with interrupts masked, like a bit-banged byte
+void advanceMasked(uint64_t us);
+
+// drive an input pin from outside
+void setInput(uint8_t pin, uint8_t level);
+
+uint8_t pinLevel(uint8_t pin);
+
+// digitalRead() calls since reset, what polling the inputs costs
+uint32_t pinReads();
+
+// called on every change of an output pin
+void onPinChange(PinListener listener);
+
+// "D3" style name of a GPIO number
+const char* pinName(uint8_t pin);
+
+// SoftwareSerial instances in construction order, nullptr if out of range
+SimStream* softwareSerial(uint8_t index);
+
+// reset the clock, pins and timer, used between simulation runs
+void reset();
+
+}
+
+#endif
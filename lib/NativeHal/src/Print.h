@@ -0,0 +1,44 @@
+/*
+ * Print.h
+ * Host version of the Arduino Print class, part of NativeHal.
+ */
+
+#ifndef NATIVE_HAL_PRINT_H
+#define NATIVE_HAL_PRINT_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+class Print {
+  size_t printNumber(unsigned long n, int base);
+
+  public:
+  virtual ~Print() {}
+
+  virtual size_t write(uint8_t c) = 0;
+  virtual size_t write(const uint8_t* buffer, size_t size);
+  size_t write(const char* str);
+  virtual int availableForWrite() { return 0; }
+  virtual void flush() {}
+
+  size_t print(const char* str);
+  size_t print(char c);
+  size_t print(int n, int base = 10);
+  size_t print(unsigned int n, int base = 10);
+  size_t print(long n, int base = 10);
+  size_t print(unsigned long n, int base = 10);
+  size_t print(double n, int digits = 2);
+
+  size_t println();
+  size_t println(const char* str);
+  size_t println(char c);
+  size_t println(int n, int base = 10);
+  size_t println(unsigned int n, int base = 10);
+  size_t println(long n, int base = 10);
+  size_t println(unsigned long n, int base = 10);
+  size_t println(double n, int digits = 2);
+
+  size_t printf(const char* format, ...) __attribute__((format(printf, 2, 3)));
+};
+
+#endif
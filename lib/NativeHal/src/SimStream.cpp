@@ -0,0 +1,123 @@
+#include <stdio.h>
+#include <vector>
+#include "NativeHal.h"
+#include "HardwareSerial.h"
+#include "SoftwareSerial.h"
+
+void SimStream::begin(unsigned long baud) {
+  _baud = baud;
+}
+
+unsigned long SimStream::byteTime() {
+  return _baud ? (_frameBits * 1000000UL + _baud - 1) / _baud : 0;
+}
+
+int SimStream::available() {
+  int count = 0;
+  uint64_t now = hal::now();
+  for (const Pending& pending : _rx) {
+    if (pending.at > now) {
+      break;
+    }
+    count++;
+  }
+  return count;
+}
+
+int SimStream::read() {
+  if (!available()) {
+    return -1;
+  }
+  uint8_t value = _rx.front().value;
+  _rx.pop_front();
+  return value;
+}
+
+int SimStream::peek() {
+  return available() ? _rx.front().value : -1;
+}
+
+size_t SimStream::write(uint8_t value) {
+  if (_bitBanged) {
+    hal::advanceMasked(byteTime());
+  }
+  _written++;
+  if (_onWrite) {
+    _onWrite(value);
+  }
+  return 1;
+}
+
+void SimStream::inject(const uint8_t* data, size_t length, unsigned long delayUs) {
+  uint64_t at = hal::now() + delayUs;
+  if (!_rx.empty() && _rx.back().at > at) {   // the link is still busy with earlier bytes
+    at = _rx.back().at;
+  }
+  for (size_t i = 0; i < length; i++) {
+    at += byteTime();
+    _rx.push_back({data[i], at});
+  }
+}
+
+void SimStream::onWrite(std::function<void(uint8_t)> handler) {
+  _onWrite = handler;
+}
+
+HardwareSerial Serial(true);
+HardwareSerial Serial1(true);
+
+void HardwareSerial::begin(unsigned long baud, SerialConfig config) {
+  SimStream::begin(baud);
+  _config = config;
+  _frameBits = config == SERIAL_8N2 ? 11 : 10;
+}
+
+void HardwareSerial::updateBaudRate(unsigned long baud) {
+  _baud = baud;
+}
+
+size_t HardwareSerial::write(uint8_t value) {
+  if (!availableForWrite()) {   // the real UART spins until the FIFO has room
+    hal::advance(_txIdleAt - hal::now() - (UART_TX_FIFO_SIZE - 1) * byteTime());
+  }
+  uint64_t at = _txIdleAt > hal::now() ? _txIdleAt : hal::now();
+  _txIdleAt = at + byteTime();
+  if (_onTransmit) {
+    _onTransmit(value, at, _baud);
+  }
+  if (_echo && _config == SERIAL_8N1) {
+    putchar(value);
+  }
+  return SimStream::write(value);
+}
+
+int HardwareSerial::availableForWrite() {
+  uint64_t now = hal::now();
+  unsigned long byte = byteTime();
+  if (_txIdleAt <= now || !byte) {
+    return UART_TX_FIFO_SIZE;
+  }
+  uint64_t queued = (_txIdleAt - now + byte - 1) / byte;   // the byte on the wire too
+  return queued < UART_TX_FIFO_SIZE ? UART_TX_FIFO_SIZE - queued : 0;
+}
+
+void HardwareSerial::flush() {
+  if (_txIdleAt > hal::now()) {
+    hal::advance(_txIdleAt - hal::now());
+  }
+}
+
+static std::vector<SoftwareSerial*>& softwareSerials() {
+  static std::vector<SoftwareSerial*> instances;
+  return instances;
+}
+
+SoftwareSerial::SoftwareSerial(uint8_t rxPin, uint8_t txPin) : SimStream(true) {
+  (void)rxPin;
+  (void)txPin;
+  softwareSerials().push_back(this);
+}
+
+SimStream* hal::softwareSerial(uint8_t index) {
+  return index < softwareSerials().size() ? softwareSerials()[index] : nullptr;
+}
@@ -0,0 +1,64 @@
+/*
+ * SimStream.h
+ * Simulated serial link, part of NativeHal.
+ *
+ * Bytes the firmware writes are handed to an onWrite() handler, which is
+ * where a simulated device listens. Bytes for the firmware are injected with
+ * an arrival time and only become available() once the virtual clock gets
+ * there, spaced one byte time apart like a real UART at the set baud rate.
+ *
+ * A bit-banged link (SoftwareSerial) also holds the CPU while it writes:
+ * each byte moves the virtual clock on by one byte time with interrupts
+ * masked.
+ */
+
+#ifndef NATIVE_HAL_SIM_STREAM_H
+#define NATIVE_HAL_SIM_STREAM_H
+
+#include <deque>
+#include <functional>
+#include "Stream.h"
+
+class SimStream : public Stream {
+  struct Pending {
+    uint8_t value;
+    uint64_t at;    // virtual us the byte arrives
+  };
+
+  std::deque<Pending> _rx;
+  std::function<void(uint8_t)> _onWrite;
+  bool _bitBanged;
+  uint64_t _written = 0;
+
+  protected:
+  unsigned long _baud = 0;
+  uint8_t _frameBits = 10;      // start, 8 data and stop bits
+
+  public:
+  explicit SimStream(bool bitBanged = false) : _bitBanged(bitBanged) {}
+
+  void begin(unsigned long baud);
+  void end() {}
+
+  int available() override;
+  int read() override;
+  int peek() override;
+  size_t write(uint8_t value) override;
+  using Print::write;
+  int availableForWrite() override { return 128; }
+
+  // simulation side
+
+  // queue bytes for the firmware, the first arrives delayUs from now
+  void inject(const uint8_t* data, size_t length, unsigned long delayUs = 0);
+
+  // called for every byte the firmware writes
+  void onWrite(std::function<void(uint8_t)> handler);
+
+  // us to send one byte at the current baud rate, 0 if begin() was not called
+  unsigned long byteTime();
+
+  uint64_t bytesWritten() { return _written; }
+};
+
+#endif
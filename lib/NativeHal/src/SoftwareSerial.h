@@ -0,0 +1,19 @@
+/*
+ * SoftwareSerial.h
+ * Host version of EspSoftwareSerial, part of NativeHal.
+ *
+ * Instances register themselves in construction order so the simulation
+ * can reach them with hal::softwareSerial(index).
+ */
+
+#ifndef NATIVE_HAL_SOFTWARE_SERIAL_H
+#define NATIVE_HAL_SOFTWARE_SERIAL_H
+
+#include "SimStream.h"
+
+class SoftwareSerial : public SimStream {
+  public:
+  SoftwareSerial(uint8_t rxPin, uint8_t txPin);
+};
+
+#endif
@@ -0,0 +1,20 @@
+/*
+ * Stream.h
+ * Host version of the Arduino Stream class, part of NativeHal.
+ */
+
+#ifndef NATIVE_HAL_STREAM_H
+#define NATIVE_HAL_STREAM_H
+
+#include "Print.h"
+
+class Stream : public Print {
+  public:
+  virtual int available() = 0;
+  virtual int read() = 0;
+  virtual int peek() = 0;
+
+  size_t readBytes(uint8_t* buffer, size_t length);
+};
+
+#endif
@@ -0,0 +1,118 @@
+#include <algorithm>
+#include "NativeHal.h"
+#include "WiFiUdp.h"
+
+static std::vector<WiFiUDP*>& sockets() {
+  static std::vector<WiFiUDP*> instances;
+  return instances;
+}
+
+static uint64_t udpDelayUs = 1000;
+static hal::UdpListener udpListener;
+
+static void broadcast(WiFiUDP* from, uint16_t port, const uint8_t* data, size_t length, uint64_t at) {
+  for (WiFiUDP* socket : sockets()) {
+    if (socket != from && socket->port() == port) {
+      socket->deliver(data, length, at);
+    }
+  }
+}
+
+void hal::udpInject(uint16_t port, const uint8_t* data, size_t length, uint64_t delayUs) {
+  broadcast(nullptr, port, data, length, hal::now() + delayUs);
+}
+
+void hal::udpDelay(uint64_t us) {
+  udpDelayUs = us;
+}
+
+void hal::onUdpSend(UdpListener listener) {
+  udpListener = listener;
+}
+
+WiFiUDP::WiFiUDP() {
+  sockets().push_back(this);
+}
+
+WiFiUDP::~WiFiUDP() {
+  sockets().erase(std::find(sockets().begin(), sockets().end(), this));
+}
+
+uint8_t WiFiUDP::begin(uint16_t port) {
+  _port = port;
+  return 1;
+}
+
+void WiFiUDP::stop() {
+  _port = 0;
+  _inbox.clear();
+}
+
+int WiFiUDP::beginPacket(IPAddress ip, uint16_t port) {
+  (void)ip;
+  _outgoing.clear();
+  _outgoingPort = port;
+  return 1;
+}
+
+size_t WiFiUDP::write(uint8_t value) {
+  _outgoing.push_back(value);
+  return 1;
+}
+
+size_t WiFiUDP::write(const uint8_t* buffer, size_t size) {
+  _outgoing.insert(_outgoing.end(), buffer, buffer + size);
+  return size;
+}
+
+int WiFiUDP::endPacket() {
+  if (udpListener) {
+    udpListener(_outgoingPort, _outgoing.data(), _outgoing.size());
+  }
+  broadcast(this, _outgoingPort, _outgoing.data(), _outgoing.size(), hal::now() + udpDelayUs);
+  _outgoing.clear();
+  return 1;
+}
+
+int WiFiUDP::parsePacket() {
+  if (_inbox.empty() || _inbox.front().at > hal::now()) {
+    _current.clear();
+    _read = 0;
+    return 0;
+  }
+  _current = _inbox.front().data;
+  _read = 0;
+  _inbox.pop_front();
+  return _current.size();
+}
+
+int WiFiUDP::available() {
+  return _current.size() - _read;
+}
+
+int WiFiUDP::read() {
+  return _read < _current.size() ? _current[_read++] : -1;
+}
+
+int WiFiUDP::read(uint8_t* buffer, size_t length) {
+  size_t count = std::min(length, _current.size() - _read);
+  memcpy(buffer, _current.data() + _read, count);
+  _read += count;
+  return count;
+}
+
+int WiFiUDP::peek() {
+  return _read < _current.size() ? _current[_read] : -1;
+}
+
+void WiFiUDP::flush() {
+}
+
+void WiFiUDP::deliver(const uint8_t* data, size_t length, uint64_t at) {
+  if (!_port) {
+    return;
+  }
+  auto later = std::upper_bound(_inbox.begin(), _inbox.end(), at,
+    [](uint64_t time, const Packet& packet) { return time < packet.at; });
+  _inbox.insert(later, Packet{at, std::vector<uint8_t>(data, data + length)});
+}
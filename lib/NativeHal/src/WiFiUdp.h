@@ -0,0 +1,76 @@
+/*
+ * WiFiUdp.h
+ * Host stand-in for the ESP8266 WiFiUDP class, part of NativeHal.
+ *
+ * All WiFiUDP instances of the process share a loopback network: a packet
+ * sent to a port reaches every other instance that listens on it, after
+ * hal::udpDelay() us of virtual time, whatever the address. The simulation
+ * can put packets on the network with hal::udpInject() and watch everything
+ * the firmware sends with hal::onUdpSend().
+ */
+
+#ifndef NATIVE_HAL_WIFI_UDP_H
+#define NATIVE_HAL_WIFI_UDP_H
+
+#include <deque>
+#include <functional>
+#include <vector>
+#include <Arduino.h>
+#include "IPAddress.h"
+
+class WiFiUDP : public Stream {
+  struct Packet {
+    uint64_t at;    // virtual us it arrives
+    std::vector<uint8_t> data;
+  };
+
+  uint16_t _port = 0;
+  std::deque<Packet> _inbox;
+  std::vector<uint8_t> _current;    // packet taken by parsePacket()
+  size_t _read = 0;
+  std::vector<uint8_t> _outgoing;
+  uint16_t _outgoingPort = 0;
+
+  public:
+  WiFiUDP();
+  ~WiFiUDP();
+
+  uint8_t begin(uint16_t port);
+  void stop();
+
+  int beginPacket(IPAddress ip, uint16_t port);
+  size_t write(uint8_t value) override;
+  size_t write(const uint8_t* buffer, size_t size) override;
+  using Print::write;
+  int endPacket();
+
+  // size of the next packet that has arrived, 0 if none, the rest of the
+  // previous packet is dropped
+  int parsePacket();
+  int available() override;
+  int read() override;
+  int read(uint8_t* buffer, size_t length);
+  int peek() override;
+  void flush() override;          // sending is immediate, nothing to wait for
+
+  // simulation side
+  void deliver(const uint8_t* data, size_t length, uint64_t at);
+  uint16_t port() { return _port; }
+};
+
+namespace hal {
+
+typedef std::function<void(uint16_t port, const uint8_t* data, size_t length)> UdpListener;
+
+// put a packet on the loopback network, it arrives delayUs from now
+void udpInject(uint16_t port, const uint8_t* data, size_t length, uint64_t delayUs = 0);
+
+// virtual us a sent packet takes, default 1000
+void udpDelay(uint64_t us);
+
+// called for every packet the firmware sends
+void onUdpSend(UdpListener listener);
+
+}
+
+#endif
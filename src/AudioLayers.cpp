@@ -0,0 +1,112 @@
+#include "AudioLayers.h"
+
+void AudioLayers::play(uint16_t track) {
+  _playing.file = 0;    // a new track ends the insert
+  _player.play(track);
+}
+
+void AudioLayers::loop(uint16_t track) {
+  PlaybackTracker& playback = _player.playback();
+  if (!playback.looping() || playback.track() != track) {
+    _playing.file = 0;
+  }
+  _player.loop(track);  // not sent if it loops already, the effect goes on
+}
+
+void AudioLayers::playFolder(uint8_t folder, uint16_t file) {
+  _playing.file = 0;
+  _player.playFolder(folder, file);
+}
+
+void AudioLayers::stop() {
+  _playing.file = 0;
+  _queued = 0;
+  _player.stop();
+}
+
+void AudioLayers::clearEffects() {
+  if (_playing.file) {
+    _player.stopAdvertise();
+    _playing.file = 0;
+  }
+  _queued = 0;
+}
+
+bool AudioLayers::effect(uint16_t file, uint16_t ms, uint8_t priority, uint16_t maxWaitMs) {
+  unsigned long now = millis();
+  update(now);
+  if (!file || !_player.ready() || !_player.playback().playing()) {
+    _dropped++;   // nothing to insert into
+    return false;
+  }
+  Effect effect = {file, ms, priority, now + maxWaitMs};
+  if (!_playing.file) {
+    return start(effect, now);
+  }
+  if (priority > _playing.priority) {
+    if (!start(effect, now)) {   // replaces the insert, no stopAdvertise() needed
+      return false;
+    }
+    _preempted++;
+    return true;
+  }
+  if (!maxWaitMs) {
+    _dropped++;
+    return false;
+  }
+  enqueue(effect);
+  return true;
+}
+
+bool AudioLayers::start(const Effect& effect, unsigned long now) {
+  if (!_player.advertise(effect.file)) {
+    _dropped++;   // the player's queue was full, by the time it has room the moment is gone
+    return false;
+  }
+  _playing = effect;
+  _playing.until = now + effect.ms;
+  _effects++;
+  return true;
+}
+
+// by priority, after those of the same priority; a full queue gives up its
+// lowest entry for a higher one
+void AudioLayers::enqueue(const Effect& effect) {
+  if (_queued == AUDIO_QUEUE_SIZE) {
+    if (_queue[_queued - 1].priority >= effect.priority) {
+      _dropped++;
+      return;
+    }
+    _queued--;
+    _dropped++;
+  }
+  uint8_t i = _queued++;
+  for (; i > 0 && _queue[i - 1].priority < effect.priority; i--) {
+    _queue[i] = _queue[i - 1];
+  }
+  _queue[i] = effect;
+}
+
+void AudioLayers::update(unsigned long now) {
+  if (_playing.file && (long)(now - _playing.until) >= 0) {
+    _playing.file = 0;    // the module went back to the bed by itself
+  }
+  uint8_t kept = 0;
+  for (uint8_t i = 0; i < _queued; i++) {
+    if ((long)(now - _queue[i].until) > 0) {
+      _dropped++;     // waited long enough
+    } else {
+      _queue[kept++] = _queue[i];
+    }
+  }
+  _queued = kept;
+
+  if (!_playing.file && _queued && _player.ready() && _player.playback().playing()) {
+    Effect next = _queue[0];
+    _queued--;
+    for (uint8_t i = 0; i < _queued; i++) {
+      _queue[i] = _queue[i + 1];
+    }
+    start(next, now);
+  }
+}
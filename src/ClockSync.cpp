@@ -0,0 +1,73 @@
+#include "ClockSync.h"
+
+// correction for the drift since the offset was measured, us
+long ClockSync::drifted(unsigned long local) {
+  return (long)((int64_t)(int32_t)(uint32_t)(local - _refLocal) * _driftPpb / 1000000000LL);
+}
+
+void ClockSync::beacon(uint32_t master, unsigned long local) {
+  long difference = (int32_t)(master - (uint32_t)local);   // micros() wraps at 32 bits
+  _lastBeacon = local;
+  _beacons++;
+
+  if (!_locked) {     // first beacon, a rough estimate until the window is full
+    _locked = true;
+    _refLocal = local;
+    _offset = difference;
+  }
+
+  // compare with the drift taken out, so a long window does not favor its end
+  if (!_samples || difference - (long)((int64_t)(int32_t)(uint32_t)(local - _bestLocal) * _driftPpb / 1000000000LL) > _best) {
+    _best = difference;
+    _bestLocal = local;
+  }
+  if (++_samples < SYNC_WINDOW) {
+    return;
+  }
+  _samples = 0;
+
+  // drift over the span since the anchor window, long enough for the noise
+  // of the window offsets not to matter
+  if (!_havePrevious) {
+    _anchorLocal = _bestLocal;
+    _anchorOffset = _best;
+  } else {
+    long elapsed = (int32_t)(uint32_t)(_bestLocal - _anchorLocal);
+    if (elapsed >= SYNC_DRIFT_MIN_MS * 1000L) {
+      long measured = (long)((int64_t)(_best - _anchorOffset) * 1000000000LL / elapsed);
+      if (measured > -SYNC_DRIFT_MAX_PPB && measured < SYNC_DRIFT_MAX_PPB) {
+        _driftPpb += (measured - _driftPpb) / SYNC_DRIFT_WEIGHT;
+      }
+    }
+    if (elapsed >= SYNC_DRIFT_SPAN_MS * 1000L) {   // follow a crystal warming up
+      _anchorLocal = _bestLocal;
+      _anchorOffset = _best;
+    }
+  }
+  _havePrevious = true;
+  _refLocal = _bestLocal;
+  _offset = _best;
+}
+
+void ClockSync::reset() {
+  _locked = false;
+  _samples = 0;
+  _havePrevious = false;
+  _driftPpb = 0;
+}
+
+bool ClockSync::locked(unsigned long now) {
+  if (_locked && now - _lastBeacon > SYNC_LOST_MS * 1000UL) {
+    reset();
+  }
+  return _locked;
+}
+
+uint32_t ClockSync::toMaster(unsigned long local) {
+  return (uint32_t)(local + _offset + drifted(local));
+}
+
+unsigned long ClockSync::toLocal(uint32_t master) {
+  uint32_t local = master - (uint32_t)_offset;
+  return (uint32_t)(local - drifted(local));    // drift is tiny, one step is enough
+}
@@ -0,0 +1,117 @@
+#include "ControlProtocol.h"
+
+// true if message is name, or name=<number> when a value is expected
+static bool match(const char* message, size_t length, const char* name, bool withValue, uint16_t& value) {
+  size_t nameLength = strlen(name);
+  if (length < nameLength || memcmp(message, name, nameLength) != 0) {
+    return false;
+  }
+  if (!withValue) {
+    return length == nameLength;
+  }
+  if (length < nameLength + 2 || length > nameLength + 6 || message[nameLength] != '=') {
+    return false;
+  }
+  uint32_t number = 0;
+  for (size_t i = nameLength + 1; i < length; i++) {
+    if (message[i] < '0' || message[i] > '9') {
+      return false;
+    }
+    number = number * 10 + (message[i] - '0');
+  }
+  if (number > 0xFFFF) {
+    return false;
+  }
+  value = number;
+  return true;
+}
+
+bool ControlParser::parse(const char* message, size_t length, ControlCommand& command) {
+  memset(&command, 0, sizeof(command));
+  if (match(message, length, "trigger", false, command.argument)) {
+    command.type = CONTROL_TRIGGER;
+  } else if (match(message, length, "abort", false, command.argument)) {
+    command.type = CONTROL_ABORT;
+  } else if (match(message, length, "scene", true, command.argument)) {
+    command.type = CONTROL_SCENE;
+  } else if (match(message, length, "volume", true, command.argument) && command.argument <= 30) {
+    command.type = CONTROL_VOLUME;
+  } else if (match(message, length, CONTROL_HEARTBEAT_TEXT, false, command.argument)) {
+    command.type = CONTROL_HEARTBEAT;
+  } else {
+    return false;
+  }
+  return true;
+}
+
+bool ControlParser::next(ControlCommand& command) {
+  while (_position < _length) {
+    const char* message = _text + _position;
+    size_t length = 0;
+    while (_position + length < _length && message[length] != ';') {
+      length++;
+    }
+    _position += length + 1;    // past the ';'
+    if (!length) {
+      continue;
+    }
+    if (parse(message, length, command)) {
+      return true;
+    }
+    if (_unknown < 0xFF) {
+      _unknown++;
+    }
+  }
+  return false;
+}
+
+BinaryControlParser::BinaryControlParser(const uint8_t* data, size_t length) : _data(data), _length(length) {
+  if (_length % CONTROL_RECORD_SIZE) {
+    _length = 0;
+    _unknown = 1;
+  }
+}
+
+bool BinaryControlParser::next(ControlCommand& command) {
+  while (_position < _length) {
+    const uint8_t* record = _data + _position;
+    _position += CONTROL_RECORD_SIZE;
+    command.type = record[0];
+    command.channel = record[1];
+    command.sequence = record[2] | record[3] << 8;
+    int16_t value0 = (int16_t)(record[4] | record[5] << 8);
+    int16_t value1 = (int16_t)(record[6] | record[7] << 8);
+    command.argument = value0 < 0 ? 0 : value0;
+    command.x = value0;
+    command.y = value1;
+
+    bool valid;
+    switch (command.type) {
+      case CONTROL_TRIGGER:
+      case CONTROL_ABORT:
+      case CONTROL_HEARTBEAT:
+        valid = true;
+        break;
+      case CONTROL_SCENE:
+        valid = value0 >= 0;
+        break;
+      case CONTROL_VOLUME:
+        valid = value0 >= 0 && value0 <= 30;
+        break;
+      case CONTROL_JOYSTICK:
+        valid = value0 >= -CONTROL_JOYSTICK_MAX && value0 <= CONTROL_JOYSTICK_MAX &&
+                value1 >= -CONTROL_JOYSTICK_MAX && value1 <= CONTROL_JOYSTICK_MAX;
+        break;
+      default:
+        valid = false;
+        break;
+    }
+    if (valid) {
+      return true;
+    }
+    if (_unknown < 0xFF) {
+      _unknown++;
+    }
+  }
+  return false;
+}
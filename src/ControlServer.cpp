@@ -0,0 +1,128 @@
+#include "ControlServer.h"
+
+ControlServer::ControlServer() : _server(CONTROL_PORT), _socket(CONTROL_WS_PATH) {
+}
+
+void ControlServer::begin(FS& fs) {
+  _socket.onEvent([this](AsyncWebSocket* server, AsyncWebSocketClient* client, AwsEventType type,
+                         void* arg, uint8_t* data, size_t length) {
+    (void)server;
+    onEvent(client, type, arg, data, length);
+  });
+  _server.addHandler(&_socket);
+  _server.serveStatic("/", fs, "/").setDefaultFile("index.html").setCacheControl(CONTROL_CACHE_CONTROL);
+  _server.onNotFound([](AsyncWebServerRequest* request) {
+    request->send(404, "text/plain", "Not found");
+  });
+  _server.begin();
+}
+
+void ControlServer::onEvent(AsyncWebSocketClient* client, AwsEventType type, void* arg, uint8_t* data, size_t length) {
+  if (type == WS_EVT_CONNECT || type == WS_EVT_DISCONNECT) {
+    for (Client& slot : _clients) {
+      if (type == WS_EVT_CONNECT ? !slot.client : slot.client == client) {
+        slot.client = type == WS_EVT_CONNECT ? client : nullptr;
+        slot.synced = false;
+        break;
+      }
+    }
+    return;
+  }
+  if (type != WS_EVT_DATA) {
+    return;
+  }
+  const AwsFrameInfo* info = (const AwsFrameInfo*)arg;
+  // commands are short, a message split over several frames or packets is
+  // not one of ours
+  if (!info->final || info->index != 0 || info->len != length) {
+    _unknown++;
+    return;
+  }
+  if (info->opcode == WS_BINARY) {
+    BinaryControlParser parser(data, length);
+    receive(client, parser);
+  } else if (info->opcode == WS_TEXT) {
+    ControlParser parser((const char*)data, length);
+    receive(client, parser);
+  } else {
+    _unknown++;
+  }
+}
+
+template <class Parser>
+void ControlServer::receive(AsyncWebSocketClient* client, Parser& parser) {
+  ControlCommand command;
+  while (parser.next(command)) {
+    if (command.sequence) {   // 0 for text commands
+      _sequence = command.sequence;
+    }
+    if (command.type == CONTROL_HEARTBEAT) {
+      if (client->canSend()) {
+        client->text(CONTROL_HEARTBEAT_TEXT);
+      }
+      continue;
+    }
+    queue(command);
+  }
+  _unknown += parser.unknown();
+}
+
+void ControlServer::queue(const ControlCommand& command) {
+  _received++;
+  if (controlCoalesces(command.type)) {
+    for (uint8_t i = _head; i != _tail; i = (i + 1) % CONTROL_QUEUE_SIZE) {
+      if (_queue[i].type == command.type && _queue[i].channel == command.channel) {
+        _queue[i] = command;
+        _coalesced++;
+        return;
+      }
+    }
+  }
+  uint8_t next = (_tail + 1) % CONTROL_QUEUE_SIZE;
+  if (next == _head) {
+    _dropped++;
+    return;
+  }
+  _queue[_tail] = command;
+  _tail = next;
+}
+
+bool ControlServer::read(ControlCommand& command) {
+  if (_head == _tail) {
+    return false;
+  }
+  command = _queue[_head];
+  _head = (_head + 1) % CONTROL_QUEUE_SIZE;
+  return true;
+}
+
+void ControlServer::update(unsigned long now) {
+  if (now - _cleanedAt >= CONTROL_CLEANUP_MS) {
+    _cleanedAt = now;
+    _socket.cleanupClients();
+  }
+}
+
+uint32_t ControlServer::clients() {
+  return _socket.count();
+}
+
+void ControlServer::push(Telemetry& telemetry, bool changed) {
+  for (Client& slot : _clients) {
+    if (!slot.client || (slot.synced && !changed)) {
+      continue;
+    }
+    if (!slot.client->canSend()) {
+      slot.synced = false;    // catches up with a keyframe
+      _pushDropped++;
+      continue;
+    }
+    if (slot.synced) {
+      slot.client->binary((const char*)telemetry.delta(), telemetry.deltaLength());
+    } else {
+      slot.client->binary((const char*)telemetry.keyframe(), telemetry.keyframeLength());
+      slot.synced = true;
+    }
+    _pushed++;
+  }
+}
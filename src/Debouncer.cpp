@@ -0,0 +1,82 @@
+#include "Debouncer.h"
+
+Debouncer::Input* Debouncer::find(uint8_t pin) {
+  for (uint8_t i = 0; i < _count; i++) {
+    if (_inputs[i].pin == pin) {
+      return &_inputs[i];
+    }
+  }
+  return nullptr;
+}
+
+bool Debouncer::attach(uint8_t pin, uint16_t debounceTime, uint16_t longPressTime) {
+  Input* input = find(pin);
+  if (!input) {
+    if (_count >= DEBOUNCER_MAX_INPUTS) {
+      return false;
+    }
+    input = &_inputs[_count++];
+  }
+
+  unsigned long now = millis();
+  input->pin = pin;
+  input->raw = digitalRead(pin);
+  input->stable = input->raw;
+  input->events = 0;
+  input->longPressed = true;    // a switch already held at boot is not a long press
+  input->debounceTime = debounceTime;
+  input->longPressTime = longPressTime;
+  input->changedAt = now;
+  input->stableAt = now;
+  return true;
+}
+
+void Debouncer::update() {
+  update(millis());
+}
+
+void Debouncer::update(unsigned long now) {
+  if (now == _lastSample) {   // pins only need sampling once per ms
+    return;
+  }
+  _lastSample = now;
+
+  for (uint8_t i = 0; i < _count; i++) {
+    Input& input = _inputs[i];
+    uint8_t level = digitalRead(input.pin);
+
+    if (level != input.raw) {   // noise or a new level, restart the window
+      input.raw = level;
+      input.changedAt = now;
+      continue;
+    }
+
+    if (input.raw != input.stable && now - input.changedAt >= input.debounceTime) {
+      input.stable = input.raw;
+      input.stableAt = now;
+      input.longPressed = false;
+      input.events |= (input.stable == HIGH) ? DEBOUNCE_RISING : DEBOUNCE_FALLING;
+    }
+
+    if (input.longPressTime && !input.longPressed && input.stable == HIGH &&
+        now - input.stableAt >= input.longPressTime) {
+      input.longPressed = true;
+      input.events |= DEBOUNCE_LONG_PRESS;
+    }
+  }
+}
+
+uint8_t Debouncer::read(uint8_t pin) {
+  Input* input = find(pin);
+  return input ? input->stable : LOW;
+}
+
+uint8_t Debouncer::events(uint8_t pin) {
+  Input* input = find(pin);
+  if (!input) {
+    return 0;
+  }
+  uint8_t events = input->events;
+  input->events = 0;
+  return events;
+}
@@ -0,0 +1,151 @@
+#include "DmxOutput.h"
+#include "Profiler.h"
+
+void DmxOutput::begin(HardwareSerial& uart, uint16_t channels) {
+  _uart = &uart;
+  _channels = channels && channels <= DMX_CHANNELS ? channels : DMX_CHANNELS;
+  memset(_frame, 0, sizeof(_frame));    // start code 0, all channels off
+  memset(_next, 0, sizeof(_next));
+  for (Fade& fade : _fades) {
+    fade.channel = 0;
+  }
+  _committed = false;
+  _uart->begin(DMX_BAUD, SERIAL_8N2);
+  _state = DMX_DRAIN;                   // a frame starts with a break
+  _idleAt = micros();
+}
+
+// queue bytes that fit the FIFO, the line is busy until they and whatever
+// was in the FIFO and the shift register are out
+void DmxOutput::send(const uint8_t* data, uint16_t length, unsigned long byteTime) {
+  int room = _uart->availableForWrite();
+  _uart->write(data, length);
+  _idleAt = micros() + (DMX_FIFO_SIZE - room + length + 1) * byteTime;
+}
+
+bool DmxOutput::idle(unsigned long now) {
+  return (long)(now - _idleAt) >= 0 && _uart->availableForWrite() >= DMX_FIFO_SIZE;
+}
+
+void DmxOutput::update() {
+  update(micros());
+}
+
+void DmxOutput::update(unsigned long now) {
+  switch (_state) {
+    case DMX_OFF:
+      break;
+    case DMX_DATA: {
+      uint16_t left = _channels + 1 - _sent;
+      int room = _uart->availableForWrite();
+      if (room > left) {
+        room = left;
+      }
+      if (room > 0) {
+        send(_frame + _sent, room, DMX_BYTE_US);
+        _sent += room;
+      }
+      if (_sent == _channels + 1) {
+        _state = DMX_DRAIN;
+      }
+      break;
+    }
+    case DMX_DRAIN:
+      if (idle(now) && (!_frames || now - _frameAt >= DMX_MIN_FRAME_US)) {
+        _uart->updateBaudRate(DMX_BREAK_BAUD);
+        _uart->write((uint8_t)0);             // the break, its stop bits are the mark after it
+        _idleAt = micros() + DMX_BREAK_BYTE_US;
+        _state = DMX_BREAK;
+      }
+      break;
+    case DMX_BREAK:
+      if (idle(now)) {
+        _uart->updateBaudRate(DMX_BAUD);
+        startFrame(now);
+        _state = DMX_DATA;
+        update(now);                          // first slots right away
+      }
+      break;
+  }
+}
+
+// levels for the frame about to go out: the last commit, then the fades
+void DmxOutput::startFrame(unsigned long now) {
+  if (_frames) {
+    _period = now - _frameAt;
+    if (_period > _maxPeriod) {
+      _maxPeriod = _period;
+    }
+  }
+  _frameAt = now;
+  _frames++;
+  _sent = 0;
+
+  if (_committed) {
+    memcpy(_frame + 1, _next, _channels);
+    _committed = false;
+  }
+  PROFILE_SCOPE(PROFILE_FADES);
+  for (Fade& fade : _fades) {
+    if (!fade.channel) {
+      continue;
+    }
+    uint8_t level = fade.envelope.value(now);
+    _frame[fade.channel] = level;
+    _next[fade.channel - 1] = level;
+    if (!fade.envelope.running()) {
+      fade.channel = 0;
+    }
+  }
+}
+
+void DmxOutput::cancelFade(uint16_t channel) {
+  for (Fade& fade : _fades) {
+    if (fade.channel == channel) {
+      fade.channel = 0;
+    }
+  }
+}
+
+void DmxOutput::set(uint16_t channel, uint8_t level) {
+  if (channel < 1 || channel > _channels) {
+    return;
+  }
+  cancelFade(channel);
+  _next[channel - 1] = level;
+}
+
+uint8_t DmxOutput::get(uint16_t channel) {
+  return channel >= 1 && channel <= _channels ? _next[channel - 1] : 0;
+}
+
+void DmxOutput::commit() {
+  _committed = true;
+}
+
+void DmxOutput::fade(uint16_t channel, uint8_t level, unsigned long ms, uint8_t curve) {
+  if (channel < 1 || channel > _channels) {
+    return;
+  }
+  Fade* slot = nullptr;
+  for (Fade& fade : _fades) {
+    if (fade.channel == channel || (!fade.channel && !slot)) {
+      slot = &fade;
+    }
+  }
+  if (ms * 1000UL < (1UL << ENVELOPE_TICK_SHIFT) || !slot) {
+    set(channel, level);
+    return;
+  }
+  slot->channel = channel;
+  slot->envelope.start(_next[channel - 1], level, ms, curve, micros());
+}
+
+bool DmxOutput::fading() {
+  for (const Fade& fade : _fades) {
+    if (fade.channel) {
+      return true;
+    }
+  }
+  return false;
+}
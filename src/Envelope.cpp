@@ -0,0 +1,54 @@
+#include "Envelope.h"
+
+// (2^(6x) - 1) / 63 and 3x^2 - 2x^3, scaled to 65535
+static const uint16_t exponentialCurve[ENVELOPE_CURVE_POINTS] PROGMEM = {
+  0, 144, 309, 496, 709, 952, 1229, 1543, 1902, 2310, 2775, 3305, 3908, 4595, 5377, 6267, 7282,
+  8437, 9752, 11250, 12955, 14898, 17110, 19629, 22498, 25764, 29485, 33721, 38546, 44040, 50296, 57421, 65535
+};
+
+static const uint16_t easeCurve[ENVELOPE_CURVE_POINTS] PROGMEM = {
+  0, 188, 736, 1620, 2816, 4300, 6048, 8036, 10240, 12636, 15200, 17908, 20736, 23660, 26656, 29700, 32768,
+  35835, 38879, 41875, 44799, 47627, 50335, 52899, 55295, 57499, 59487, 61235, 62719, 63915, 64799, 65347, 65535
+};
+
+uint16_t envelopeShape(uint8_t curve, uint16_t progress) {
+  const uint16_t* table;
+  switch (curve) {
+    case CURVE_EXPONENTIAL:
+      table = exponentialCurve;
+      break;
+    case CURVE_EASE_IN_OUT:
+      table = easeCurve;
+      break;
+    default:
+      return progress;
+  }
+  uint8_t segment = progress >> 11;         // 32 segments of 2048
+  uint16_t low = pgm_read_word(&table[segment]);
+  uint16_t high = pgm_read_word(&table[segment + 1]);
+  return low + (((uint32_t)(high - low) * (progress & 0x7FF)) >> 11);
+}
+
+void Envelope::start(int16_t from, int16_t to, unsigned long ms, uint8_t curve, unsigned long now) {
+  _from = from;
+  _to = to;
+  _curve = curve < CURVE_COUNT ? curve : (uint8_t)CURVE_LINEAR;
+  _startAt = now;
+  _ticks = (ms * 1000UL) >> ENVELOPE_TICK_SHIFT;
+  _rate = _ticks ? (1UL << ENVELOPE_PROGRESS_BITS) / _ticks : 0;
+  _running = true;
+}
+
+int16_t Envelope::value(unsigned long now) {
+  if (!_running) {
+    return _to;
+  }
+  uint32_t ticks = (uint32_t)(now - _startAt) >> ENVELOPE_TICK_SHIFT;
+  if (ticks >= _ticks) {
+    _running = false;
+    return _to;
+  }
+  uint16_t progress = (ticks * _rate) >> (ENVELOPE_PROGRESS_BITS - 16);
+  int32_t shaped = envelopeShape(_curve, progress);
+  return _from + (((int32_t)(_to - _from) * shaped + 0x8000) >> 16);
+}
@@ -0,0 +1,43 @@
+#include "LogBuffer.h"
+
+size_t LogBuffer::write(uint8_t value) {
+  return write(&value, 1);
+}
+
+size_t LogBuffer::write(const uint8_t* buffer, size_t size) {
+  size_t written = 0;
+  while (written < size && _count < LOG_BUFFER_SIZE) {
+    _buffer[(_tail + _count) % LOG_BUFFER_SIZE] = buffer[written++];
+    _count++;
+  }
+  _dropped += size - written;
+  return size;    // dropped text is not retried by the caller
+}
+
+void LogBuffer::update() {
+  int room = _out.availableForWrite();
+  while (room > 0 && _count) {
+    size_t chunk = LOG_BUFFER_SIZE - _tail;   // up to the end of the ring
+    if (chunk > _count) {
+      chunk = _count;
+    }
+    if (chunk > (size_t)room) {
+      chunk = room;
+    }
+    chunk = _out.write(_buffer + _tail, chunk);
+    if (!chunk) {
+      return;
+    }
+    _tail = (_tail + chunk) % LOG_BUFFER_SIZE;
+    _count -= chunk;
+    room -= chunk;
+  }
+}
+
+void LogBuffer::flush() {
+  while (_count) {
+    update();
+    yield();
+  }
+  _out.flush();
+}
@@ -0,0 +1,32 @@
+#include "PlaybackTracker.h"
+
+void PlaybackTracker::started(uint16_t track, unsigned long now, bool looping) {
+  _track = track;
+  _playing = true;
+  _looping = looping;
+  _startedAt = now;
+}
+
+void PlaybackTracker::stopped() {
+  _playing = false;
+}
+
+bool PlaybackTracker::finishedEvent(uint16_t track, unsigned long now) {
+  if (!_playing || track != _track) {
+    return false;
+  }
+  if (now - _startedAt < PLAYBACK_MIN_TRACK_MS) {
+    return false;   // repeat of an earlier finished event
+  }
+  if (_looping) {   // the player starts it over by itself
+    _startedAt = now;
+    return false;
+  }
+  _playing = false;
+  _length = now - _startedAt;
+  return true;
+}
+
+bool PlaybackTracker::finished(uint16_t track) {
+  return _track == track && !_playing;
+}
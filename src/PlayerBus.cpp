@@ -0,0 +1,209 @@
+#include "PlayerBus.h"
+
+uint8_t PlayerBus::add(const char* name, DFRobotDFPlayerMini& driver, PlayerState& state) {
+  if (_count >= PLAYER_BUS_CHANNELS) {
+    return PLAYER_BUS_NONE;
+  }
+  Channel& channel = _channels[_count];
+  memset(&channel, 0, sizeof(channel));
+  channel.name = name;
+  channel.driver = &driver;
+  channel.state = &state;
+  channel.link = state.link();
+  return _count++;
+}
+
+void PlayerBus::receive(unsigned long now) {
+  for (uint8_t i = 0; i < _count; i++) {
+    Channel& channel = _channels[i];
+    channel.finished = channel.state->update(now);   // never blocks
+    if (channel.state->link() != channel.link) {
+      channel.link = channel.state->link();
+      channel.linkChanged = true;
+    }
+  }
+}
+
+bool PlayerBus::linkChanged(uint8_t channel) {
+  bool changed = _channels[channel].linkChanged;
+  _channels[channel].linkChanged = false;
+  return changed;
+}
+
+unsigned long PlayerBus::newlyDropped(uint8_t channel) {
+  Channel& dropping = _channels[channel];
+  unsigned long dropped = dropping.driver->queueDropped() - dropping.dropped;
+  dropping.dropped += dropped;
+  return dropped;
+}
+
+void PlayerBus::hold(uint8_t channels) {
+  for (uint8_t i = 0; i < _count; i++) {
+    uint8_t bit = 1 << i;
+    if ((channels & bit) && !((_holding | _group) & bit)) {
+      _channels[i].mark = _channels[i].driver->queueSequence();
+      _holding |= bit;
+    }
+  }
+}
+
+bool PlayerBus::send(Channel& channel) {
+  unsigned long started = micros();
+  if (!channel.driver->poll()) {
+    return false;
+  }
+  if (_held) {
+    return true;
+  }
+  uint32_t sendUs = micros() - started;
+  channel.sends++;
+  channel.sendUs += sendUs;
+  if (sendUs > channel.maxSendUs) {
+    channel.maxSendUs = sendUs;
+  }
+  return true;
+}
+
+bool PlayerBus::transmit() {
+  if (_holding) {
+    join();
+  }
+  if (_group && (_released || groupReady())) {
+    return releaseNext();
+  }
+  for (uint8_t k = 0; k < _count; k++) {
+    uint8_t i = (_next + k) % _count;
+    Channel& channel = _channels[i];
+    if ((_group & (1 << i)) && channel.driver->sendSequence() == channel.mark) {
+      continue;   // the group's frame is next, it waits for the others
+    }
+    if (send(channel)) {
+      _next = (i + 1) % _count;   // the channel after it goes first next time
+      return true;
+    }
+  }
+  return false;
+}
+
+// the held channels that got a frame since hold() make the group
+void PlayerBus::join() {
+  for (uint8_t i = 0; i < _count; i++) {
+    uint8_t bit = 1 << i;
+    if ((_holding & bit) && _channels[i].driver->queueSequence() != _channels[i].mark) {
+      _group |= bit;
+    }
+  }
+  _holding = 0;
+}
+
+// every channel of the group has its group frame next and can send it now
+bool PlayerBus::groupReady() {
+  bool ready = true;
+  for (uint8_t i = 0; i < _count; i++) {
+    Channel& channel = _channels[i];
+    if (!(_group & (1 << i))) {
+      continue;
+    }
+    int32_t ahead = channel.mark - channel.driver->sendSequence();
+    if (ahead < 0) {
+      _group &= ~(1 << i);    // the frame is gone, nothing to wait for
+    } else if (ahead || !channel.driver->canSend()) {
+      ready = false;
+    }
+  }
+  return ready && _group;
+}
+
+// one group frame per pass, nothing else until the last of them is out
+bool PlayerBus::releaseNext() {
+  for (uint8_t i = 0; i < _count; i++) {
+    if (!(_group & (1 << i))) {
+      continue;
+    }
+    unsigned long started = micros();
+    if (!send(_channels[i])) {
+      return false;   // not free after all, again next pass
+    }
+    if (!_released++) {
+      _releasedAt = started;
+    }
+    _group &= ~(1 << i);
+    if (!_group) {
+      if (_released > 1 && !_held) {
+        _groups++;
+        _lastSkewUs = started - _releasedAt;
+        if (_lastSkewUs > _maxSkewUs) {
+          _maxSkewUs = _lastSkewUs;
+        }
+      }
+      _released = 0;
+    }
+    return true;
+  }
+  return false;
+}
+
+void PlayerBus::resetStats() {
+  for (uint8_t i = 0; i < _count; i++) {
+    _channels[i].sends = _channels[i].sendUs = _channels[i].maxSendUs = 0;
+  }
+  _groups = _lastSkewUs = _maxSkewUs = 0;
+  _held = false;
+}
+
+void PlayerBus::holdStats() {
+  for (uint8_t i = 0; i < _count; i++) {
+    Channel& channel = _channels[i];
+    channel.frames = channel.driver->framesSent();
+    channel.ackUs = channel.driver->ackLatency();
+    channel.timeouts = channel.driver->timeOutCount();
+  }
+  _held = true;
+}
+
+unsigned long PlayerBus::sends() {
+  unsigned long sends = 0;
+  for (uint8_t i = 0; i < _count; i++) {
+    sends += _channels[i].sends;
+  }
+  return sends;
+}
+
+uint32_t PlayerBus::meanSendUs() {
+  uint32_t sendUs = 0;
+  for (uint8_t i = 0; i < _count; i++) {
+    sendUs += _channels[i].sendUs;
+  }
+  unsigned long count = sends();
+  return count ? sendUs / count : 0;
+}
+
+uint32_t PlayerBus::maxSendUs() {
+  uint32_t maxUs = 0;
+  for (uint8_t i = 0; i < _count; i++) {
+    if (_channels[i].maxSendUs > maxUs) {
+      maxUs = _channels[i].maxSendUs;
+    }
+  }
+  return maxUs;
+}
+
+void PlayerBus::report(Print& out) {
+  for (uint8_t line = 0; line < reportLines(); line++) {
+    reportLine(out, line);
+  }
+}
+
+void PlayerBus::reportLine(Print& out, uint8_t line) {
+  if (line < _count) {
+    Channel& channel = _channels[line];
+    DFRobotDFPlayerMini& driver = *channel.driver;
+    out.printf("  %-8s frames %lu, sends %lu (max %lu us), ack %lu us, timeouts %lu, %s\n", channel.name,
+               _held ? channel.frames : driver.framesSent(), channel.sends, (unsigned long)channel.maxSendUs,
+               _held ? channel.ackUs : driver.ackLatency(), _held ? channel.timeouts : driver.timeOutCount(),
+               channel.state->ready() ? "online" : "offline");
+  } else if (line == _count) {
+    out.printf("  groups %lu, skew %lu us (max %lu us, bound %lu us)\n", _groups, (unsigned long)_lastSkewUs,
+               (unsigned long)_maxSkewUs, (unsigned long)skewBoundUs());
+  }
+}
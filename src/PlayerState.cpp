@@ -0,0 +1,386 @@
+#include "PlayerState.h"
+#include "Profiler.h"
+#include "PlayerFrames.h"
+
+// query command for each value, in the order they are refreshed, their
+// frames are queryFrames
+static const struct {
+  uint8_t value;
+  uint8_t command;
+} playerQueries[] = {
+  {PLAYER_PLAY_STATE, 0x42},
+  {PLAYER_VOLUME, 0x43},
+  {PLAYER_EQ, 0x44},
+  {PLAYER_FILE_COUNT, 0x48}   // files on the SD card
+};
+static_assert(sizeof(playerQueries) / sizeof(playerQueries[0]) == sizeof(queryFrames) / sizeof(queryFrames[0]),
+              "a query without a frame");
+
+void PlayerState::begin() {
+  _query = 0;
+  forget(PLAYER_ALL);
+  _backoff = PLAYER_RETRY_MS;
+  boot(millis());
+}
+
+void PlayerState::boot(unsigned long now) {
+  _player.sendFrame(&resetFrame);   // queued, the module answers card online once it is up
+  _link = PLAYER_BOOTING;
+  _linkAt = now;
+}
+
+// retries of the startup handshake
+void PlayerState::linkStep(unsigned long now) {
+  if (_link == PLAYER_BOOTING && now - _linkAt >= PLAYER_BOOT_TIMEOUT_MS) {
+    _bootFailures++;
+    _link = PLAYER_OFFLINE;
+    _linkAt = now;
+  } else if (_link == PLAYER_OFFLINE && now - _linkAt >= _backoff) {
+    _backoff = _backoff * 2 < PLAYER_RETRY_MAX_MS ? _backoff * 2 : PLAYER_RETRY_MAX_MS;
+    boot(now);
+  }
+}
+
+void PlayerState::forget(uint8_t values) {
+  _known &= ~values;
+  _stale |= values;
+}
+
+void PlayerState::answer(uint8_t command, uint16_t value) {
+  if (command != _query) {
+    return;   // not asked for or overtaken by a command, the cache is newer
+  }
+  _query = 0;
+
+  switch (command) {
+    case 0x42:    // low byte 0 stopped, 1 playing, 2 paused
+      if ((value & 0xFF) != 1) {
+        _playback.stopped();
+      }
+      _known |= PLAYER_PLAY_STATE;
+      _stale &= ~PLAYER_PLAY_STATE;
+      break;
+    case 0x43:
+      _volume = value;
+      _known |= PLAYER_VOLUME;
+      _stale &= ~PLAYER_VOLUME;
+      break;
+    case 0x44:
+      _eq = value;
+      _known |= PLAYER_EQ;
+      _stale &= ~PLAYER_EQ;
+      break;
+    case 0x48:
+      _fileCount = value;
+      _known |= PLAYER_FILE_COUNT;
+      _stale &= ~PLAYER_FILE_COUNT;
+      break;
+    default:      // an ask()
+      _answered = command;
+      _answer = value;
+      break;
+  }
+}
+
+bool PlayerState::ask(uint8_t command, uint16_t parameter) {
+  if (!ready() || _query || _player.busy()) {
+    return false;
+  }
+  if (!_player.query(command, parameter)) {
+    return false;
+  }
+  _query = command;
+  _queriedAt = millis();
+  _answered = 0;
+  return true;
+}
+
+bool PlayerState::answered(uint8_t command, uint16_t& value) {
+  if (_answered != command) {
+    return false;
+  }
+  _answered = 0;
+  value = _answer;
+  return true;
+}
+
+void PlayerState::refresh(unsigned long now) {
+  if (_query && now - _queriedAt >= PLAYER_QUERY_TIMEOUT_MS) {
+    _query = 0;   // answer lost, the value stays stale and is asked for again
+  }
+  if (_query || !_stale || _player.busy()) {
+    return;
+  }
+  for (uint8_t i = 0; i < sizeof(playerQueries) / sizeof(playerQueries[0]); i++) {
+    if (_stale & playerQueries[i].value) {
+      if (_player.sendFrame(&queryFrames[i])) {
+        _query = playerQueries[i].command;
+        _queriedAt = now;
+      }
+      return;
+    }
+  }
+}
+
+uint16_t PlayerState::update(unsigned long now) {
+  uint16_t finished = 0;
+
+  const DFPlayerEvent* event;
+  while ((event = _player.readEvent())) {   // only parses bytes already received
+    uint16_t value = event->parameter;
+    switch (event->type) {
+      case DFPlayerFeedBack:
+        answer(event->command, value);
+        break;
+      case DFPlayerPlayFinished:
+        if (_playback.finishedEvent(value, now)) {
+          finished = value;
+        }
+        break;
+      case DFPlayerCardOnline:
+      case DFPlayerUSBOnline:
+      case DFPlayerCardUSBOnline:   // the player was reset
+        _playback.stopped();
+        forget(PLAYER_ALL);
+        _retry = 0;   // restore() sends the volume and EQ again
+        if (_link != PLAYER_READY) {
+          _link = PLAYER_READY;
+          _backoff = PLAYER_RETRY_MS;
+          if (!_readyAt) {
+            _readyAt = now ? now : 1;   // 0 is not yet
+          }
+        }
+        break;
+      case DFPlayerCardRemoved:
+      case DFPlayerUSBRemoved:      // nothing to play until it is back
+        _playback.stopped();
+        _ramp.stop();
+        _retry = 0;
+        _link = PLAYER_OFFLINE;
+        _linkAt = now;
+        break;
+      case DFPlayerError:
+        if (value == FileIndexOut || value == FileMismatch) {
+          _playback.stopped();
+        }
+        break;
+      case TimeOut:
+      case WrongStack:    // a command may not have arrived
+        forget(PLAYER_VOLUME | PLAYER_EQ | PLAYER_PLAY_STATE);
+        break;
+    }
+  }
+
+  if (_link != PLAYER_READY) {
+    linkStep(now);
+    return finished;
+  }
+  retry();
+  rampStep(now);
+  refresh(now);
+  return finished;
+}
+
+// commands a full queue turned away, sent again once it has room; the
+// play state first, it is what the audience hears
+void PlayerState::retry() {
+  if (!_retry || _player.queued() >= DFPLAYER_QUEUE_SIZE) {
+    return;
+  }
+  _retried++;
+  if (_retry & PLAYER_PLAY_STATE) {
+    switch (_retryCommand) {
+      case 0x03: play(_retryFile); break;
+      case 0x08: loop(_retryFile); break;
+      case 0x0F: playFolder(_retryFolder, _retryFile); break;
+      default: stop(); break;
+    }
+  } else if (_retry & PLAYER_VOLUME) {
+    _retry &= ~PLAYER_VOLUME;
+    if (!_ramp.running()) {
+      sendVolume(_wantedVolume);  // a ramp sends its next step by itself
+    }
+  } else {
+    _retry &= ~PLAYER_EQ;
+    EQ(_wantedEq);
+  }
+}
+
+// a play state command did not fit in the queue, the one to send again
+void PlayerState::playDropped(uint8_t command, uint8_t folder, uint16_t file) {
+  _retry |= PLAYER_PLAY_STATE;
+  _retryCommand = command;
+  _retryFolder = folder;
+  _retryFile = file;
+}
+
+// the play state is what the last command made it
+void PlayerState::playStateSent() {
+  _known |= PLAYER_PLAY_STATE;
+  _stale &= ~PLAYER_PLAY_STATE;
+  if (_query == 0x42) {
+    _query = 0;   // its answer would be older than the command
+  }
+  _retry &= ~PLAYER_PLAY_STATE;   // a newer command replaces one not sent yet
+}
+
+void PlayerState::play(uint16_t track) {
+  if (!ready()) {
+    return;
+  }
+  bool sent = track >= 1 && track <= PLAYER_FRAME_TRACKS ? _player.sendFrame(&playFrames[track - 1])
+                                                        : _player.play(track);
+  if (!sent) {
+    playDropped(0x03, 0, track);
+    return;
+  }
+  _playback.started(track, millis());
+  playStateSent();
+}
+
+void PlayerState::loop(uint16_t track) {
+  if (!ready()) {
+    return;
+  }
+  if (known(PLAYER_PLAY_STATE) && _playback.looping() && _playback.track() == track) {
+    _skipped++;
+    _retry &= ~PLAYER_PLAY_STATE;
+    return;
+  }
+  bool sent = track >= 1 && track <= PLAYER_FRAME_TRACKS ? _player.sendFrame(&loopFrames[track - 1])
+                                                        : _player.loop(track);
+  if (!sent) {
+    playDropped(0x08, 0, track);
+    return;
+  }
+  _playback.started(track, millis(), true);
+  playStateSent();
+}
+
+void PlayerState::stop() {
+  if (!ready() || (known(PLAYER_PLAY_STATE) && !_playback.playing())) {
+    _skipped++;
+    _retry &= ~PLAYER_PLAY_STATE;
+    return;
+  }
+  if (!_player.sendFrame(&stopFrame)) {
+    playDropped(0x16, 0, 0);
+    return;
+  }
+  _playback.stopped();
+  playStateSent();
+}
+
+// the module reports the end of a folder track with its file number
+void PlayerState::playFolder(uint8_t folder, uint16_t file) {
+  if (!ready()) {
+    return;
+  }
+  bool sent = file > 255 ? _player.playLargeFolder(folder, file) : _player.playFolder(folder, file);
+  if (!sent) {
+    playDropped(0x0F, folder, file);
+    return;
+  }
+  _playback.started(file, millis());
+  playStateSent();
+}
+
+bool PlayerState::advertise(uint16_t file) {
+  if (!ready()) {
+    return false;
+  }
+  return file >= 1 && file <= PLAYER_FRAME_TRACKS ? _player.sendFrame(&advertiseFrames[file - 1])
+                                                  : _player.advertise(file);
+}
+
+bool PlayerState::stopAdvertise() {
+  return ready() && _player.sendFrame(&stopAdvertiseFrame);
+}
+
+void PlayerState::volume(uint8_t volume) {
+  _wanted |= PLAYER_VOLUME;
+  _wantedVolume = volume > 30 ? 30 : volume;
+  _ramp.stop();
+  sendVolume(volume);
+}
+
+void PlayerState::ramp(uint8_t volume, unsigned long ms, uint8_t curve) {
+  _wanted |= PLAYER_VOLUME;
+  _wantedVolume = volume > 30 ? 30 : volume;
+  if (!ready() || !known(PLAYER_VOLUME)) {
+    sendVolume(volume);   // nothing to ramp from
+    return;
+  }
+  _ramp.start(_volume, volume > 30 ? 30 : volume, ms, curve, micros());
+  _rampSentAt = millis() - PLAYER_RAMP_INTERVAL_MS;
+}
+
+// the next ramp step, if the link has room for it
+void PlayerState::rampStep(unsigned long now) {
+  if (!_ramp.running() || now - _rampSentAt < PLAYER_RAMP_INTERVAL_MS || _player.queued()) {
+    return;
+  }
+  PROFILE_SCOPE(PROFILE_RAMPS);
+  _rampSentAt = now;
+  uint8_t volume = _ramp.value(micros());
+  if (volume != _volume) {
+    _rampSteps++;
+    sendVolume(volume);
+  }
+}
+
+void PlayerState::sendVolume(uint8_t volume) {
+  if (!ready()) {
+    return;
+  }
+  if (volume > 30) {
+    volume = 30;
+  }
+  if (known(PLAYER_VOLUME) && _volume == volume) {
+    _skipped++;
+    return;
+  }
+  if (!_player.sendFrame(&volumeFrames[volume])) {   // volume is 30 at most
+    _retry |= PLAYER_VOLUME;    // the cache keeps the volume the player still has
+    return;
+  }
+  _retry &= ~PLAYER_VOLUME;
+  _volume = volume;
+  _known |= PLAYER_VOLUME;
+  _stale &= ~PLAYER_VOLUME;
+  if (_query == 0x43) {
+    _query = 0;   // its answer would be older than the command
+  }
+}
+
+void PlayerState::EQ(uint8_t eq) {
+  _wanted |= PLAYER_EQ;
+  _wantedEq = eq;
+  if (!ready()) {
+    return;
+  }
+  if (known(PLAYER_EQ) && _eq == eq) {
+    _skipped++;
+    return;
+  }
+  if (!_player.EQ(eq)) {
+    _retry |= PLAYER_EQ;
+    return;
+  }
+  _retry &= ~PLAYER_EQ;
+  _eq = eq;
+  _known |= PLAYER_EQ;
+  _stale &= ~PLAYER_EQ;
+  if (_query == 0x44) {
+    _query = 0;
+  }
+}
+
+void PlayerState::restore() {
+  if (_wanted & PLAYER_EQ) {
+    EQ(_wantedEq);
+  }
+  if ((_wanted & PLAYER_VOLUME) && !_ramp.running()) {
+    sendVolume(_wantedVolume);
+  }
+}
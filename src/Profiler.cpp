@@ -0,0 +1,79 @@
+#include "Profiler.h"
+
+#ifdef PROFILER
+
+Profiler profiler;
+
+static const char* const sectionNames[PROFILE_SECTION_COUNT] = {
+  "loop", "console", "switches", "player_events", "player_send", "timeline", "relay_write", "fades", "ramps"
+};
+
+static const char* const counterNames[PROFILE_COUNTER_COUNT] = {
+  "player_timeouts", "player_wrong_stack", "log_dropped"
+};
+
+static void writeUint32(Print& out, uint32_t value) {
+  uint8_t bytes[4] = {(uint8_t)value, (uint8_t)(value >> 8), (uint8_t)(value >> 16), (uint8_t)(value >> 24)};
+  out.write(bytes, sizeof(bytes));
+}
+
+void Profiler::reset() {
+  noInterrupts();   // the relay ISR records too
+  memset(_sections, 0, sizeof(_sections));
+  memset(_counters, 0, sizeof(_counters));
+  interrupts();
+}
+
+void Profiler::dumpCsv(Print& out) {
+  uint32_t mhz = ESP.getCpuFreqMHz();
+  out.print(F("section,count,mean_us,max_us"));
+  for (uint8_t b = 0; b < PROFILE_BUCKETS; b++) {   // bucket bounds in cycles
+    out.print(F(",lt"));
+    if (b < PROFILE_BUCKETS - 1) {
+      out.print(PROFILE_BUCKET_CYCLES << b);
+    } else {
+      out.print(F("inf"));
+    }
+  }
+  out.println();
+  for (uint8_t i = 0; i < PROFILE_SECTION_COUNT; i++) {
+    const Section& s = _sections[i];
+    out.print(sectionNames[i]);
+    out.print(',');
+    out.print(s.count);
+    out.print(',');
+    out.print(s.count ? (unsigned long)(s.totalCycles / s.count / mhz) : 0UL);
+    out.print(',');
+    out.print(s.maxCycles / mhz);
+    for (uint8_t b = 0; b < PROFILE_BUCKETS; b++) {
+      out.print(',');
+      out.print(s.buckets[b]);
+    }
+    out.println();
+  }
+  for (uint8_t i = 0; i < PROFILE_COUNTER_COUNT; i++) {
+    out.print(counterNames[i]);
+    out.print(',');
+    out.println(_counters[i]);
+  }
+}
+
+void Profiler::dumpBinary(Print& out) {
+  const uint8_t header[] = {'P', 'R', 'F', '1', PROFILE_SECTION_COUNT, PROFILE_BUCKETS,
+                            PROFILE_BUCKET_SHIFT, PROFILE_COUNTER_COUNT, (uint8_t)ESP.getCpuFreqMHz()};
+  out.write(header, sizeof(header));
+  for (uint8_t i = 0; i < PROFILE_SECTION_COUNT; i++) {
+    const Section& s = _sections[i];
+    writeUint32(out, s.count);
+    writeUint32(out, s.count ? (uint32_t)(s.totalCycles / s.count) : 0);
+    writeUint32(out, s.maxCycles);
+    for (uint8_t b = 0; b < PROFILE_BUCKETS; b++) {
+      writeUint32(out, s.buckets[b]);
+    }
+  }
+  for (uint8_t i = 0; i < PROFILE_COUNTER_COUNT; i++) {
+    writeUint32(out, _counters[i]);
+  }
+}
+
+#endif
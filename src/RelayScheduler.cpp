@@ -0,0 +1,174 @@
+#include "RelayScheduler.h"
+#include "Profiler.h"
+
+RelayScheduler* RelayScheduler::_instance = nullptr;
+
+RelayScheduler::RelayScheduler(const uint8_t* pins, uint8_t pinCount)
+  : _pins(pins), _pinCount(pinCount) {
+  if (_pinCount > RELAY_SCHEDULER_OUTPUTS) {
+    _pinCount = RELAY_SCHEDULER_OUTPUTS;
+  }
+  resetJitter();
+}
+
+void RelayScheduler::begin(StrobePatterns& patterns) {
+  _patterns = &patterns;
+  _instance = this;
+  timer1_isr_init();
+  timer1_attachInterrupt(onTimer);
+  timer1_enable(TIM_DIV16, TIM_EDGE, TIM_SINGLE);
+}
+
+void IRAM_ATTR RelayScheduler::onTimer() {
+  if (_instance) {
+    _instance->fire();
+  }
+}
+
+void IRAM_ATTR RelayScheduler::apply(uint8_t outputs, uint8_t pattern, unsigned long at) {
+  _outputs = outputs;
+  _pattern = pattern;
+  _step = 0;
+  _nextTick = at + PATTERN_TICK_US;
+  writePins();
+}
+
+// only pins whose state changes are written
+void IRAM_ATTR RelayScheduler::writePins() {
+  PROFILE_SCOPE(PROFILE_RELAY_WRITE);
+  uint8_t state = _outputs;
+  if (_pattern != PATTERN_STEADY && _patterns && !_patterns->bit(_pattern, _step)) {
+    state = 0;
+  }
+  uint8_t changed = state ^ _written;
+  for (uint8_t i = 0; changed && i < _pinCount; i++, changed >>= 1) {
+    if (changed & 0x01) {
+      digitalWrite(_pins[i], (state >> i) & 0x01 ? HIGH : LOW);
+    }
+  }
+  _written = state;
+}
+
+// applies every edge that is due, steps a running pattern and re-arms the
+// timer for whichever comes next, runs in the timer ISR or with interrupts off
+void IRAM_ATTR RelayScheduler::fire() {
+  unsigned long now = micros();
+
+  while (_head != _tail && (long)(now - _edges[_head].due) >= 0) {
+    const Edge& edge = _edges[_head];
+    apply(edge.outputs, edge.pattern, edge.due);
+    long late = (long)(now - edge.due);
+    if (late < _minLate) {
+      _minLate = late;
+    }
+    if (late > _maxLate) {
+      _maxLate = late;
+    }
+    _totalLate += late < 0 ? -late : late;
+    _edgeCount++;
+    _head = (_head + 1) % RELAY_SCHEDULER_EDGES;
+  }
+
+  bool patternRunning = _pattern != PATTERN_STEADY && _outputs && _patterns;
+  if (patternRunning && (long)(now - _nextTick) >= 0) {
+    uint8_t length = _patterns->length(_pattern);
+    while ((long)(now - _nextTick) >= 0) {  // catch up on ticks missed with interrupts off
+      _step = (_step + 1) % length;
+      _nextTick += PATTERN_TICK_US;
+    }
+    writePins();
+  }
+
+  bool armed = false;
+  unsigned long wake = 0;
+  if (_head != _tail) {
+    wake = _edges[_head].due;
+    armed = true;
+  }
+  if (patternRunning && (!armed || (long)(_nextTick - wake) < 0)) {
+    wake = _nextTick;
+    armed = true;
+  }
+  if (armed) {
+    unsigned long ticks = (wake - now) * RELAY_TIMER_TICKS_PER_US;
+    if (ticks > RELAY_TIMER_MAX_TICKS) {  // too far out, wake up early and look again
+      ticks = RELAY_TIMER_MAX_TICKS;
+    }
+    timer1_write(ticks);
+  }
+}
+
+bool RelayScheduler::schedule(unsigned long due, uint8_t outputs, uint8_t pattern) {
+  uint8_t next = (_tail + 1) % RELAY_SCHEDULER_EDGES;
+  if (next == _head) {
+    return false;
+  }
+
+  noInterrupts();
+  bool wasIdle = _head == _tail;
+  _edges[_tail].due = due;
+  _edges[_tail].outputs = outputs;
+  _edges[_tail].pattern = pattern;
+  _tail = next;
+  if (wasIdle) {    // new earliest edge, re-arm the timer (or apply a late edge now)
+    fire();
+  }
+  interrupts();
+  return true;
+}
+
+void RelayScheduler::write(uint8_t outputs, uint8_t pattern) {
+  noInterrupts();
+  apply(outputs, pattern, micros());
+  fire();   // start the pattern clock if needed
+  interrupts();
+}
+
+void RelayScheduler::cancel() {
+  noInterrupts();
+  _head = _tail;    // a timer still running finds nothing to fire
+  interrupts();
+}
+
+uint8_t RelayScheduler::outputs() {
+  return _outputs;
+}
+
+uint8_t RelayScheduler::pattern() {
+  return _pattern;
+}
+
+uint8_t RelayScheduler::pending() {
+  return (_tail - _head + RELAY_SCHEDULER_EDGES) % RELAY_SCHEDULER_EDGES;
+}
+
+void RelayScheduler::resetJitter() {
+  noInterrupts();
+  _edgeCount = 0;
+  _minLate = 0x7FFFFFFFL;
+  _maxLate = -0x7FFFFFFFL;
+  _totalLate = 0;
+  interrupts();
+}
+
+void RelayScheduler::reportJitter(Print& out) {
+  noInterrupts();
+  uint32_t edges = _edgeCount;
+  long minLate = _minLate;
+  long maxLate = _maxLate;
+  uint32_t totalLate = _totalLate;
+  interrupts();
+
+  out.print(F("Relay jitter: edges "));
+  out.print(edges);
+  if (edges) {
+    out.print(F(", min "));
+    out.print(minLate);
+    out.print(F(" us, max "));
+    out.print(maxLate);
+    out.print(F(" us, mean |late| "));
+    out.print(totalLate / edges);
+    out.print(F(" us"));
+  }
+  out.println();
+}
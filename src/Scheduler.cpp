@@ -0,0 +1,186 @@
+#include "Scheduler.h"
+
+static const char* const priorityNames[] = {"high", "normal", "low"};
+
+uint8_t Scheduler::add(const char* name, TaskFunction run, uint32_t period, uint8_t priority, uint32_t deadline,
+                       bool once) {
+  if (_count >= SCHEDULER_TASKS || !run) {
+    return TASK_NONE;
+  }
+  Task& task = _tasks[_count];
+  memset(&task, 0, sizeof(task));
+  task.name = name;
+  task.run = run;
+  task.period = period;
+  task.deadline = deadline;
+  task.releaseAt = micros();
+  task.priority = priority <= TASK_LOW ? priority : (uint8_t)TASK_LOW;
+  task.once = once;
+  task.pass = _pass;    // first run on the next pass
+  return _count++;
+}
+
+uint8_t Scheduler::every(const char* name, TaskFunction run, uint32_t periodUs, uint8_t priority,
+                         uint32_t deadlineUs) {
+  return add(name, run, periodUs, priority, deadlineUs ? deadlineUs : periodUs, false);
+}
+
+uint8_t Scheduler::once(const char* name, TaskFunction run, uint8_t priority, uint32_t deadlineUs) {
+  return add(name, run, 0, priority, deadlineUs, true);
+}
+
+void Scheduler::wake(uint8_t task, unsigned long at) {
+  if (task < _count && _tasks[task].once) {
+    _tasks[task].releaseAt = at;
+    _tasks[task].ready = true;
+  }
+}
+
+void Scheduler::cancel(uint8_t task) {
+  if (task < _count) {
+    _tasks[task].ready = false;
+  }
+}
+
+bool Scheduler::due(Task& task, unsigned long now) {
+  if (task.pass == _pass) {
+    return false;
+  }
+  if (task.once) {
+    return task.ready && (int32_t)(now - task.releaseAt) >= 0;
+  }
+  return task.period == TASK_EVERY_PASS || (int32_t)(now - task.releaseAt) >= 0;
+}
+
+void Scheduler::run() {
+  _pass++;
+  if (!_held) {
+    _passes++;
+  }
+  while (true) {
+    unsigned long now = micros();
+    unsigned long nowMs = millis();
+    Task* next = nullptr;
+    int32_t nextSlack = 0;
+    for (uint8_t i = 0; i < _count; i++) {
+      Task& task = _tasks[i];
+      if (!due(task, now)) {
+        continue;
+      }
+      // us left until the deadline, every pass tasks have all the time there is
+      int32_t slack = task.deadline ? (int32_t)(task.releaseAt + task.deadline - now) : INT32_MAX;
+      if (!next || task.priority < next->priority || (task.priority == next->priority && slack < nextSlack)) {
+        next = &task;
+        nextSlack = slack;
+      }
+    }
+    if (!next) {
+      return;
+    }
+    next->pass = _pass;
+    next->run(now, nowMs);
+    account(*next, now, micros());
+  }
+}
+
+void Scheduler::account(Task& task, unsigned long started, unsigned long ended) {
+  if (!_held) {
+    uint32_t runUs = ended - started;
+    task.runs++;
+    task.busyUs += runUs;
+    if (runUs > task.maxRunUs) {
+      task.maxRunUs = runUs;
+    }
+    if (task.once || task.period != TASK_EVERY_PASS) {
+      uint32_t late = started - task.releaseAt;
+      if (late > task.maxLateUs) {
+        task.maxLateUs = late;
+      }
+      if (task.deadline && late > task.deadline) {
+        task.missed++;
+      }
+    }
+  }
+
+  if (task.once) {
+    task.ready = false;
+  } else if (task.period != TASK_EVERY_PASS) {
+    task.releaseAt += task.period;
+    if ((int32_t)(started - task.releaseAt) >= 0) {
+      task.releaseAt = started + task.period;   // releases already missed are dropped, not run in a burst
+    }
+  }
+}
+
+void Scheduler::resetStats() {
+  for (uint8_t i = 0; i < _count; i++) {
+    Task& task = _tasks[i];
+    task.runs = task.missed = task.busyUs = task.maxRunUs = task.maxLateUs = 0;
+  }
+  _passes = 0;
+  _statsAt = micros();
+  _held = false;
+}
+
+void Scheduler::holdStats() {
+  if (!_held) {
+    _heldAt = micros();
+    _held = true;
+  }
+}
+
+uint32_t Scheduler::missed() {
+  uint32_t missed = 0;
+  for (uint8_t i = 0; i < _count; i++) {
+    missed += _tasks[i].missed;
+  }
+  return missed;
+}
+
+uint8_t Scheduler::utilisation() {
+  uint32_t elapsed = (_held ? _heldAt : micros()) - _statsAt;
+  uint64_t busy = 0;
+  for (uint8_t i = 0; i < _count; i++) {
+    busy += _tasks[i].busyUs;
+  }
+  return elapsed ? busy * 100 / elapsed : 0;
+}
+
+void Scheduler::report(Print& out) {
+  for (uint8_t line = 0; line < reportLines(); line++) {
+    reportLine(out, line);
+  }
+}
+
+void Scheduler::reportLine(Print& out, uint8_t line) {
+  uint32_t elapsed = (_held ? _heldAt : micros()) - _statsAt;
+  if (line == 0) {
+    out.printf("Tasks: %lu passes in %lu ms, mean pass %lu us\n", (unsigned long)_passes,
+               (unsigned long)(elapsed / 1000), _passes ? (unsigned long)(elapsed / _passes) : 0UL);
+  } else if (line == 1) {
+    out.printf("  %-10s %-6s %8s %8s %7s %7s %7s %6s %6s\n", "task", "prio", "period", "runs", "mean", "max",
+               "late", "missed", "cpu");
+  } else if (line < _count + 2) {
+    Task& task = _tasks[line - 2];
+    out.printf("  %-10s %-6s ", task.name, priorityNames[task.priority]);
+    if (task.once || task.period == TASK_EVERY_PASS) {
+      out.printf("%8s", task.once ? "once" : "pass");
+    } else {
+      out.printf("%8lu", (unsigned long)task.period);
+    }
+    uint32_t permille = elapsed ? (uint64_t)task.busyUs * 1000 / elapsed : 0;
+    out.printf(" %8lu %7lu %7lu %7lu %6lu %3lu.%lu%%\n", (unsigned long)task.runs,
+               task.runs ? (unsigned long)(task.busyUs / task.runs) : 0UL, (unsigned long)task.maxRunUs,
+               (unsigned long)task.maxLateUs, (unsigned long)task.missed, (unsigned long)(permille / 10),
+               (unsigned long)(permille % 10));
+  } else if (line == _count + 2) {
+    uint64_t busy = 0;
+    for (uint8_t i = 0; i < _count; i++) {
+      busy += _tasks[i].busyUs;
+    }
+    uint32_t permille = elapsed ? busy * 1000 / elapsed : 0;
+    permille = permille < 1000 ? permille : 1000;
+    out.printf("  busy %lu.%lu%%, idle %lu.%lu%%\n", (unsigned long)(permille / 10), (unsigned long)(permille % 10),
+               (unsigned long)((1000 - permille) / 10), (unsigned long)((1000 - permille) % 10));
+  }
+}
@@ -0,0 +1,100 @@
+#include "ShowFile.h"
+
+static uint32_t crc32Update(uint32_t crc, const uint8_t* data, size_t length) {
+  crc = ~crc;
+  while (length--) {
+    crc ^= *data++;
+    for (uint8_t bit = 0; bit < 8; bit++) {
+      crc = (crc >> 1) ^ (0xEDB88320UL & -(crc & 0x01));
+    }
+  }
+  return ~crc;
+}
+
+bool ShowFile::open(fs::FS& fs, const char* path, uint8_t outputs) {
+  close();
+  _file = fs.open(path, "r");
+  if (!_file) {
+    return false;
+  }
+
+  ShowFileHeader header;
+  if (_file.read((uint8_t*)&header, sizeof(header)) != sizeof(header) || !validate(header, outputs)) {
+    close();
+    return false;
+  }
+  _count = header.cueCount;
+  return rewind();
+}
+
+// single pass over the cue records, checks size, checksum, order, outputs
+// and patterns
+bool ShowFile::validate(const ShowFileHeader& header, uint8_t outputs) {
+  if (header.magic != SHOW_FILE_MAGIC || header.version != SHOW_FILE_VERSION ||
+      header.cueSize != sizeof(Cue) || header.cueCount == 0) {
+    return false;
+  }
+  if (_file.size() != sizeof(ShowFileHeader) + (size_t)header.cueCount * sizeof(Cue)) {
+    return false;
+  }
+
+  uint32_t crc = 0;
+  uint16_t lastAt = 0;
+  uint16_t remaining = header.cueCount;
+  while (remaining) {
+    uint8_t cues = remaining < SHOW_FILE_BUFFER_CUES ? remaining : SHOW_FILE_BUFFER_CUES;
+    size_t length = cues * sizeof(Cue);
+    if (_file.read((uint8_t*)_buffer, length) != length) {
+      return false;
+    }
+    crc = crc32Update(crc, (const uint8_t*)_buffer, length);
+    for (uint8_t i = 0; i < cues; i++) {
+      if (_buffer[i].at < lastAt || (_buffer[i].outputs & ~outputs) ||
+          _buffer[i].pattern >= STROBE_PATTERN_COUNT) {
+        return false;
+      }
+      lastAt = _buffer[i].at;
+    }
+    remaining -= cues;
+  }
+  return crc == header.checksum;
+}
+
+void ShowFile::close() {
+  if (_file) {
+    _file.close();
+  }
+  _count = 0;
+  _index = 0;
+  _buffered = 0;
+  _position = 0;
+}
+
+uint16_t ShowFile::count() {
+  return _count;
+}
+
+bool ShowFile::rewind() {
+  _index = 0;
+  _buffered = 0;
+  _position = 0;
+  return _file && _file.seek(sizeof(ShowFileHeader));
+}
+
+bool ShowFile::next(Cue& cue) {
+  if (_index >= _count) {
+    return false;
+  }
+  if (_position >= _buffered) {   // refill from flash
+    uint16_t remaining = _count - _index;
+    uint8_t cues = remaining < SHOW_FILE_BUFFER_CUES ? remaining : SHOW_FILE_BUFFER_CUES;
+    if (_file.read((uint8_t*)_buffer, cues * sizeof(Cue)) != cues * sizeof(Cue)) {
+      return false;
+    }
+    _buffered = cues;
+    _position = 0;
+  }
+  cue = _buffer[_position++];
+  _index++;
+  return true;
+}
@@ -0,0 +1,93 @@
+#include "ShowSync.h"
+
+void ShowSync::begin(bool master) {
+  _master = master;
+  if (master) {
+    _boot = ESP.random();   // hardware RNG, differs from boot to boot
+  }
+  _udp.begin(SYNC_PORT);
+}
+
+void ShowSync::send(SyncPacket& packet) {
+  packet.magic = SYNC_MAGIC;
+  packet.boot = _boot;
+  packet.sentAt = micros();   // as late as possible, it is what followers measure
+  _udp.beginPacket(IPAddress(255, 255, 255, 255), SYNC_PORT);
+  _udp.write((const uint8_t*)&packet, sizeof(packet));
+  _udp.endPacket();
+}
+
+uint8_t ShowSync::update(unsigned long now) {
+  if (_master) {
+    if (_repeats && now - _repeatAt >= SYNC_REPEAT_MS) {
+      _repeats--;
+      _repeatAt = now;
+      send(_repeat);
+    }
+    if (now - _beaconAt >= SYNC_BEACON_MS) {
+      _beaconAt = now;
+      SyncPacket beacon = {};
+      beacon.type = SYNC_BEACON;
+      send(beacon);
+    }
+    while (_udp.parsePacket()) {}   // another master, nothing to follow
+    return SYNC_NONE;
+  }
+
+  uint8_t event = SYNC_NONE;
+  int size;
+  while ((size = _udp.parsePacket()) > 0) {
+    SyncPacket packet;
+    unsigned long arrived = micros();
+    if (size != (int)sizeof(packet) || _udp.read((uint8_t*)&packet, sizeof(packet)) != (int)sizeof(packet) ||
+        packet.magic != SYNC_MAGIC) {
+      _rejected++;    // the next parsePacket() skips what is left
+      continue;
+    }
+    _received++;
+    uint8_t found = receive(packet, arrived);
+    if (found != SYNC_NONE) {
+      event = found;
+    }
+  }
+  _clock.locked(micros());    // lets a lost master time out
+  return event;
+}
+
+uint8_t ShowSync::receive(const SyncPacket& packet, unsigned long now) {
+  _clock.beacon(packet.sentAt, now);    // every packet carries the master clock
+  if (packet.type == SYNC_BEACON || (_eventSeen && packet.event == _event && packet.boot == _boot)) {
+    return SYNC_NONE;
+  }
+  _eventSeen = true;
+  _event = packet.event;
+  _boot = packet.boot;
+  if (packet.type == SYNC_TRIGGER) {
+    _startAt = packet.startAt;
+    _scene = packet.scene;
+    return SYNC_START;
+  }
+  return packet.type == SYNC_ABORT ? SYNC_STOP : SYNC_NONE;
+}
+
+unsigned long ShowSync::trigger(uint8_t scene) {
+  unsigned long startAt = micros() + SYNC_LEAD_MS * 1000UL;
+  _repeat = {};
+  _repeat.type = SYNC_TRIGGER;
+  _repeat.scene = scene;
+  _repeat.event = ++_event;
+  _repeat.startAt = startAt;
+  _repeats = SYNC_REPEATS - 1;
+  _repeatAt = millis();
+  send(_repeat);
+  return startAt;
+}
+
+void ShowSync::abort() {
+  _repeat = {};
+  _repeat.type = SYNC_ABORT;
+  _repeat.event = ++_event;
+  _repeats = SYNC_REPEATS - 1;
+  _repeatAt = millis();
+  send(_repeat);
+}
@@ -0,0 +1,210 @@
+#include "SoundCatalog.h"
+
+#define QUERY_FOLDER_COUNT 0x4F
+#define QUERY_FOLDER_FILES 0x4E
+
+static uint16_t gcd(uint16_t a, uint16_t b) {
+  while (b) {
+    uint16_t r = a % b;
+    a = b;
+    b = r;
+  }
+  return a;
+}
+
+void SoundCatalog::begin(fs::FS* fs) {
+  _fs = fs;
+  clear();
+  load();
+}
+
+void SoundCatalog::clear() {
+  memset(_folders, 0, sizeof(_folders));
+  _folderCount = 0;
+}
+
+void SoundCatalog::load() {
+  if (!_fs) {
+    return;
+  }
+  fs::File file = _fs->open(CATALOG_FILE, "r");
+  if (!file) {
+    return;
+  }
+  CatalogFileHeader header;
+  uint16_t files[CATALOG_FOLDERS];
+  bool valid = file.read((uint8_t*)&header, sizeof(header)) == sizeof(header) &&
+               header.magic == CATALOG_MAGIC && header.version == CATALOG_VERSION &&
+               header.folders <= CATALOG_FOLDERS &&
+               file.size() == sizeof(header) + header.folders * sizeof(uint16_t) &&
+               file.read((uint8_t*)files, header.folders * sizeof(uint16_t)) == header.folders * sizeof(uint16_t);
+  file.close();
+  for (uint8_t i = 0; valid && i < header.folders; i++) {
+    valid = files[i] <= CATALOG_MAX_FILES;
+  }
+  if (!valid) {
+    return;
+  }
+  for (uint8_t i = 0; i < header.folders; i++) {
+    _folders[i].files = files[i];
+    _folders[i].drawn = files[i];   // first pick starts a round
+  }
+  _folderCount = header.folders;
+  _fingerprint = header.fingerprint;
+  _cached = true;
+}
+
+// tens of ms of flash writes and a sector erase, once per new card
+void SoundCatalog::save() {
+  _unsaved = false;
+  if (!_fs) {
+    return;
+  }
+  fs::File file = _fs->open(CATALOG_FILE, "w");
+  if (!file) {
+    return;
+  }
+  CatalogFileHeader header = {CATALOG_MAGIC, CATALOG_VERSION, _folderCount, _fingerprint};
+  file.write((const uint8_t*)&header, sizeof(header));
+  for (uint8_t i = 0; i < _folderCount; i++) {
+    file.write((const uint8_t*)&_folders[i].files, sizeof(uint16_t));
+  }
+  file.close();
+}
+
+void SoundCatalog::update(unsigned long now) {
+  if (!_player.ready() || !_player.known(PLAYER_FILE_COUNT)) {
+    return;   // a scan goes on where it was once the player is back
+  }
+  uint16_t total = _player.fileCount();
+  if (total == _fingerprint) {
+    if (_state == CATALOG_SCANNING) {
+      scan(now);
+      return;
+    }
+    if (_state == CATALOG_READY) {
+      if (_verifying) {
+        scan(now);
+      }
+      return;
+    }
+    if (_cached) {    // picks start from the stored counts, the card is checked meanwhile
+      _state = CATALOG_READY;
+      _fromCache = true;
+      _verifying = true;
+      startScan(now);
+      return;
+    }
+  }
+
+  // a card the counts are not from, or none stored
+  clear();
+  _fingerprint = total;
+  _cached = _fromCache = _verifying = false;
+  _unsaved = false;
+  startScan(now);
+  _state = CATALOG_SCANNING;
+}
+
+void SoundCatalog::startScan(unsigned long now) {
+  _scanning = 0;
+  _tries = 0;
+  _asked = false;
+  _complete = true;
+  _scanStartedAt = now;
+}
+
+// one query in flight at a time: the folder count, then each folder's files
+void SoundCatalog::scan(unsigned long now) {
+  uint8_t command = _scanning ? QUERY_FOLDER_FILES : QUERY_FOLDER_COUNT;
+  if (!_asked) {
+    if (_player.ask(command, _scanning)) {
+      _asked = true;
+      _askedAt = now;
+    }
+    return;
+  }
+  uint16_t value;
+  if (_player.answered(command, value)) {
+    _asked = false;
+    scanned(value, now);
+  } else if (now - _askedAt >= PLAYER_QUERY_TIMEOUT_MS) {
+    _asked = false;
+    if (++_tries >= CATALOG_QUERY_TRIES) {
+      _complete = false;    // not stored, scanned again next boot
+      if (_verifying) {     // the stored count stands
+        scanned(_scanning ? _folders[_scanning - 1].files : _folderCount, now);
+      } else {
+        scanned(0, now);
+      }
+    }
+  }
+}
+
+void SoundCatalog::scanned(uint16_t value, unsigned long now) {
+  _tries = 0;
+  if (!_scanning) {
+    uint8_t count = value < CATALOG_FOLDERS ? value : CATALOG_FOLDERS;
+    if (count != _folderCount) {
+      _fromCache = false;
+      for (uint8_t i = _folderCount; i < count; i++) {
+        _folders[i] = Folder();   // a new folder, counted next
+      }
+      _folderCount = count;
+    }
+  } else {
+    Folder& folder = _folders[_scanning - 1];
+    uint16_t files = value < CATALOG_MAX_FILES ? value : CATALOG_MAX_FILES;
+    if (files != folder.files || !_verifying) {
+      _fromCache = false;
+      folder.files = files;
+      folder.drawn = files;   // a new round on the card's count
+    }
+  }
+  if (_scanning < _folderCount) {
+    _scanning++;
+    return;
+  }
+  _scanMs = now - _scanStartedAt;
+  _state = CATALOG_READY;
+  _verifying = false;
+  _unsaved = _complete && _fs && !_fromCache;   // saved between shows
+}
+
+// a new permutation for the next round, its first file is not the last one
+// of the round before
+void SoundCatalog::shuffle(Folder& folder) {
+  uint16_t files = folder.files;
+  folder.drawn = 0;
+  folder.step = 1;
+  if (files > 2) {
+    uint16_t step = random(1, files);
+    while (gcd(step, files) != 1) {
+      step = step % (files - 1) + 1;    // reaches 1 at the latest
+    }
+    folder.step = step;
+  }
+  folder.offset = random(files);
+  if (files > 1 && folder.offset + 1 == folder.last) {
+    folder.offset = (folder.offset + 1) % files;
+  }
+}
+
+uint16_t SoundCatalog::pick(uint8_t folder) {
+  if (!ready() || folder < 1 || folder > _folderCount) {
+    return 0;
+  }
+  Folder& entry = _folders[folder - 1];
+  if (!entry.files) {
+    return 0;
+  }
+  if (entry.drawn >= entry.files) {
+    shuffle(entry);
+  }
+  entry.last = ((uint32_t)entry.step * entry.drawn++ + entry.offset) % entry.files + 1;
+  return entry.last;
+}
+
+uint16_t SoundCatalog::files(uint8_t folder) {
+  return folder >= 1 && folder <= _folderCount ? _folders[folder - 1].files : 0;
+}
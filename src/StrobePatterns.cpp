@@ -0,0 +1,90 @@
+#include "StrobePatterns.h"
+
+enum patternShape : uint8_t {
+  SHAPE_STEADY,
+  SHAPE_FLASH,    // a = period, b = on time, in ticks
+  SHAPE_BURST,    // a = longest run, b = random seed
+  SHAPE_RAMP      // a = start period, b = end period, in ticks
+};
+
+struct PatternDescription {
+  uint8_t shape;
+  uint8_t a;
+  uint8_t b;
+  uint8_t length;   // steps
+};
+
+static const PatternDescription descriptions[STROBE_PATTERN_COUNT] PROGMEM = {
+  {SHAPE_STEADY, 0, 0, 1},      // PATTERN_STEADY
+  {SHAPE_FLASH, 50, 25, 50},    // PATTERN_FLASH_SLOW
+  {SHAPE_FLASH, 10, 3, 10},     // PATTERN_FLASH_FAST
+  {SHAPE_BURST, 6, 0xA5, 128},  // PATTERN_THRASH
+  {SHAPE_RAMP, 20, 2, 128}      // PATTERN_RAMP
+};
+
+void StrobePatterns::set(Sequence& sequence, uint8_t step, bool on) {
+  if (on) {
+    sequence.bits[step >> 3] |= 1 << (step & 0x07);
+  }
+}
+
+void StrobePatterns::begin() {
+  for (uint8_t id = 0; id < STROBE_PATTERN_COUNT; id++) {
+    PatternDescription description;
+    memcpy_P(&description, &descriptions[id], sizeof(description));
+    Sequence& sequence = _sequences[id];
+    memset(sequence.bits, 0, sizeof(sequence.bits));
+    sequence.length = description.length;
+
+    switch (description.shape) {
+      case SHAPE_STEADY:
+        for (uint8_t step = 0; step < sequence.length; step++) {
+          set(sequence, step, true);
+        }
+        break;
+      case SHAPE_FLASH:
+        for (uint8_t step = 0; step < sequence.length; step++) {
+          set(sequence, step, step % description.a < description.b);
+        }
+        break;
+      case SHAPE_BURST: {   // on and off runs of random length from an 8 bit LFSR
+        uint8_t lfsr = description.b;
+        bool on = true;
+        uint8_t step = 0;
+        while (step < sequence.length) {
+          lfsr = (lfsr >> 1) ^ (-(lfsr & 0x01) & 0xB8);
+          uint8_t run = 1 + lfsr % description.a;
+          for (; run && step < sequence.length; run--, step++) {
+            set(sequence, step, on);
+          }
+          on = !on;
+        }
+        break;
+      }
+      case SHAPE_RAMP: {    // one flash per period, period shrinks from a to b
+        uint8_t step = 0;
+        while (step < sequence.length) {
+          uint8_t period = description.a - (description.a - description.b) * step / sequence.length;
+          uint8_t onTime = period / 2 ? period / 2 : 1;
+          for (uint8_t i = 0; i < period && step < sequence.length; i++, step++) {
+            set(sequence, step, i < onTime);
+          }
+        }
+        break;
+      }
+    }
+  }
+}
+
+bool IRAM_ATTR StrobePatterns::bit(uint8_t pattern, uint16_t step) {
+  if (pattern >= STROBE_PATTERN_COUNT || !_sequences[pattern].length) {
+    return true;
+  }
+  const Sequence& sequence = _sequences[pattern];
+  step %= sequence.length;
+  return (sequence.bits[step >> 3] >> (step & 0x07)) & 0x01;
+}
+
+uint8_t IRAM_ATTR StrobePatterns::length(uint8_t pattern) {
+  return pattern < STROBE_PATTERN_COUNT ? _sequences[pattern].length : 1;
+}
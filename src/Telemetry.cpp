@@ -0,0 +1,71 @@
+#include <stddef.h>
+#include "Telemetry.h"
+
+struct TelemetryField {
+  uint8_t offset;
+  uint8_t size;
+};
+
+#define TELEMETRY_FIELD(name) {offsetof(TelemetryState, name), sizeof(((TelemetryState*)0)->name)}
+
+static const TelemetryField fields[TELEMETRY_FIELD_COUNT] = {
+  TELEMETRY_FIELD(state),
+  TELEMETRY_FIELD(cue),
+  TELEMETRY_FIELD(scene),
+  TELEMETRY_FIELD(sceneElapsed),
+  TELEMETRY_FIELD(outputs),
+  TELEMETRY_FIELD(track),
+  TELEMETRY_FIELD(playing),
+  TELEMETRY_FIELD(volume),
+  TELEMETRY_FIELD(playerTimeouts),
+  TELEMETRY_FIELD(playerBadFrames),
+  TELEMETRY_FIELD(loopRate),
+  TELEMETRY_FIELD(loopGapMax),
+  TELEMETRY_FIELD(sequence),
+  TELEMETRY_FIELD(clients),
+  TELEMETRY_FIELD(playerDropped)
+};
+
+static_assert(sizeof(TelemetryState) == 28, "fields changed, update fields and TELEMETRY_FIELDS in ui.js");
+
+#define TELEMETRY_ALL_FIELDS ((1U << TELEMETRY_FIELD_COUNT) - 1)
+
+// the ESP8266 and the host are little endian, fields are copied as they are
+size_t Telemetry::encode(uint8_t* frame, uint8_t type, const TelemetryState& state, uint16_t mask) {
+  frame[0] = type;
+  frame[1] = mask;
+  frame[2] = mask >> 8;
+  size_t length = 3;
+  for (uint8_t i = 0; i < TELEMETRY_FIELD_COUNT; i++) {
+    if (mask & (1U << i)) {
+      memcpy(frame + length, (const uint8_t*)&state + fields[i].offset, fields[i].size);
+      length += fields[i].size;
+    }
+  }
+  return length;
+}
+
+bool Telemetry::update(const TelemetryState& state, unsigned long now) {
+  _pushedAt = now;
+  uint16_t mask = 0;
+  for (uint8_t i = 0; i < TELEMETRY_FIELD_COUNT; i++) {
+    const uint8_t* value = (const uint8_t*)&state + fields[i].offset;
+    if (memcmp(value, (const uint8_t*)&_sent + fields[i].offset, fields[i].size) != 0) {
+      mask |= 1U << i;
+    }
+  }
+  if (!mask) {
+    return false;
+  }
+  _deltaLength = encode(_delta, TELEMETRY_DELTA, state, mask);
+  _keyframeLength = 0;    // stale, rebuilt on demand
+  _sent = state;
+  return true;
+}
+
+const uint8_t* Telemetry::keyframe() {
+  if (!_keyframeLength) {
+    _keyframeLength = encode(_keyframe, TELEMETRY_KEYFRAME, _sent, TELEMETRY_ALL_FIELDS);
+  }
+  return _keyframe;
+}
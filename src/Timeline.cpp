@@ -0,0 +1,187 @@
+#include "Timeline.h"
+
+Timeline::Timeline(RelayScheduler& relays, SoundHandler sound, SoundFinished soundFinished)
+  : _relays(relays), _sound(sound), _soundFinished(soundFinished) {
+}
+
+bool ProgmemCues::rewind() {
+  _index = 0;
+  return true;
+}
+
+bool ProgmemCues::next(Cue& cue) {
+  if (_index >= _count) {
+    return false;
+  }
+  memcpy_P(&cue, &_cues[_index++], sizeof(Cue));
+  return true;
+}
+
+void Timeline::begin(CueSource* source) {
+  _source = source;
+  _sourceDone = true;   // nothing runs until start()
+  _aheadCount = 0;
+  _scheduled = 0;
+}
+
+void Timeline::fill() {
+  while (!_sourceDone && _aheadCount < TIMELINE_LOOKAHEAD) {
+    if (_source->next(_ahead[(_aheadHead + _aheadCount) % TIMELINE_LOOKAHEAD])) {
+      _aheadCount++;
+    } else {
+      _sourceDone = true;
+    }
+  }
+}
+
+// hand the relay states of upcoming cues to the hardware timer
+void Timeline::schedule(unsigned long now) {
+  while (_scheduled < _aheadCount) {
+    const Cue& cue = _ahead[(_aheadHead + _scheduled) % TIMELINE_LOOKAHEAD];
+    if (cue.sound == CUE_SOUND_AWAIT) {   // its time is not known until it fires
+      break;
+    }
+    unsigned long due = _start + cue.at * 1000UL;
+    if ((long)(due - now) > (long)RELAY_SCHEDULER_HORIZON_US || !_relays.schedule(due, cue.outputs, cue.pattern)) {
+      break;
+    }
+    _scheduled++;
+  }
+}
+
+void Timeline::start(unsigned long now) {
+  _start = now;
+  _cursor = 0;
+  _aheadHead = 0;
+  _aheadCount = 0;
+  _scheduled = 0;
+  _relays.cancel();
+  _sourceDone = !(_source && _source->rewind());
+  fill();
+  _scene = 0;
+  _sceneAt = _aheadCount ? _ahead[_aheadHead].at : 0;
+  schedule(now);
+}
+
+void Timeline::start(unsigned long now, uint8_t scene) {
+  start(now);
+  if (!scene) {
+    return;
+  }
+  _relays.cancel();     // cues are skipped, not scheduled
+  _scheduled = 0;
+
+  uint8_t outputs = 0;
+  uint8_t pattern = PATTERN_STEADY;
+  bool volumeSet = false;
+  uint16_t volume = 0;
+  bool lookSet = false;
+  uint16_t look = 0;
+  bool channelsSet = false;
+  uint16_t channels = 0;
+  uint16_t at = 0;
+  uint8_t passed = 0;   // scenes skipped so far
+  while (_aheadCount) {
+    const Cue& cue = _ahead[_aheadHead];
+    if (_cursor && cue.at != at && ++passed == scene) {
+      break;
+    }
+    at = cue.at;
+    outputs = cue.outputs;
+    pattern = cue.pattern;
+    if (cue.sound == CUE_SOUND_VOLUME) {
+      volumeSet = true;
+      volume = cue.argument;
+    } else if (cue.sound == CUE_SOUND_RAMP) {
+      volumeSet = true;
+      volume = cue.argument & 0xFF;   // where the ramp would have got to
+    } else if (cue.sound == CUE_LIGHT_LOOK) {
+      lookSet = true;
+      look = cue.argument;
+    } else if (cue.sound == CUE_SOUND_CHANNELS) {
+      channelsSet = true;
+      channels = cue.argument;
+    }
+    _aheadHead = (_aheadHead + 1) % TIMELINE_LOOKAHEAD;
+    _aheadCount--;
+    _cursor++;
+    fill();
+  }
+
+  if (_aheadCount) {
+    at = _ahead[_aheadHead].at;
+  }
+  _start = now - at * 1000UL;
+  _scene = passed;    // scene, or the last one if the show has fewer
+  _sceneAt = at;
+  _relays.write(outputs, pattern);
+  if (channelsSet && _sound) {
+    _sound(CUE_SOUND_CHANNELS, channels);   // the volume goes to the channels selected last
+  }
+  if (volumeSet && _sound) {
+    _sound(CUE_SOUND_VOLUME, volume);
+  }
+  if (lookSet && _sound) {
+    _sound(CUE_LIGHT_LOOK, look);
+  }
+  schedule(now);
+}
+
+int Timeline::update(unsigned long now) {
+  int applied = -1;
+
+  while (_aheadCount) {
+    const Cue& cue = _ahead[_aheadHead];
+    if (now - _start < cue.at * 1000UL) {
+      if (cue.sound != CUE_SOUND_AWAIT || !_soundFinished || !_soundFinished(cue.argument)) {
+        break;
+      }
+      _start = now - cue.at * 1000UL;   // the sound ended early, later cues move up
+    }
+    if (cue.at != _sceneAt) {
+      _scene++;
+      _sceneAt = cue.at;
+    }
+    if (cue.sound != CUE_SOUND_NONE && cue.sound != CUE_SOUND_AWAIT && _sound) {
+      _sound(cue.sound, cue.argument);
+    }
+    if (_scheduled) {   // the timer already set the relays for this cue
+      _scheduled--;
+    } else {
+      _relays.write(cue.outputs, cue.pattern);
+    }
+    _aheadHead = (_aheadHead + 1) % TIMELINE_LOOKAHEAD;
+    _aheadCount--;
+    applied = _cursor++;
+  }
+
+  fill();
+  schedule(now);
+  return applied;
+}
+
+bool Timeline::finished() {
+  return _sourceDone && !_aheadCount;
+}
+
+void Timeline::shift(long us) {
+  _start += us;
+}
+
+unsigned long Timeline::elapsed(unsigned long now) {
+  return (now - _start) / 1000;
+}
+
+unsigned long Timeline::sceneElapsed(unsigned long now) {
+  unsigned long ms = elapsed(now);
+  return ms > _sceneAt ? ms - _sceneAt : 0;   // 0 before the show's first cue time
+}
+
+void Timeline::writeOutputs(uint8_t outputs) {
+  _relays.cancel();
+  _relays.write(outputs);
+}
+
+uint8_t Timeline::outputs() {
+  return _relays.outputs();
+}
@@ -1,220 +1,893 @@
+// pio test builds src/ for the test suites, which bring their own main()
+#ifndef UNIT_TEST
+
 #include <Arduino.h>
 #include <ESP8266WiFi.h>
+#include <LittleFS.h>
+#ifndef DFPLAYER_ON_UART0
 #include "SoftwareSerial.h"
+#endif
 #include "DFRobotDFPlayerMini.h"  // see https://wiki.dfrobot.com/DFPlayer_Mini_SKU_DFR0299
+#include "Debouncer.h"
+#include "PlayerState.h"
+#include "StrobePatterns.h"
+#include "RelayScheduler.h"
+#include "Timeline.h"
+#include "ShowFile.h"
+#include "LogBuffer.h"
+#include "Profiler.h"
+#include "ControlServer.h"
+#include "Telemetry.h"
+#include "ShowSync.h"
+#include "DmxOutput.h"
+#include "Scheduler.h"
+#include "AudioLayers.h"
+#include "SoundCatalog.h"
+#include "PlayerBus.h"
 
 // hardware settings
+// build with -DDFPLAYER_ON_UART0 to run the DFPlayer on the hardware UART
+// instead of bit-banged SoftwareSerial: UART0 swapped to D7 (RX) and D8
+// (TX), console on Serial1, whose TX is D4, so the strobe relay moves to D6
+// build with -DDMX_OUTPUT to drive DMX lights from Serial1 (D4) through a
+// MAX485 with DE and RE tied high, the strobe relay moves to D6 as well
+// build with -DMULTI_PLAYER for a DFPlayer per speaker, all on
+// SoftwareSerial: the machine on D1/D2, the monster on D7 (RX) and D8 (TX),
+// the crowd on D4 (RX) and D0 (TX), the strobe relay moves to D6
+#if defined(MULTI_PLAYER) && (defined(DFPLAYER_ON_UART0) || defined(DMX_OUTPUT))
+#error "MULTI_PLAYER needs D4, D7 and D8, the DFPLAYER_ON_UART0 and DMX_OUTPUT builds use them"
+#endif
+#ifdef DFPLAYER_ON_UART0
+#ifdef DMX_OUTPUT
+#error "DMX_OUTPUT needs Serial1, the DFPLAYER_ON_UART0 build has its console there"
+#endif
+#define PLAYER_SERIAL Serial  // swapped to D7/D8 in setup()
+#define LOG_SERIAL Serial1    // TX only, D4
+#define RELAY_STROBE_PIN D6   // output
+#else
 #define SERIAL_RX_PIN D1      // input
 #define SERIAL_TX_PIN D2      // output
-#define RELAY_SPARK_PIN D3    // output
+#define PLAYER_SERIAL mySoftwareSerial
+#define LOG_SERIAL Serial
+#ifdef DMX_OUTPUT
+#define DMX_SERIAL Serial1    // TX only, D4
+#define RELAY_STROBE_PIN D6   // output
+#elif defined(MULTI_PLAYER)
+#define MONSTER_RX_PIN D7     // input
+#define MONSTER_TX_PIN D8     // output
+#define CROWD_RX_PIN D4       // input
+#define CROWD_TX_PIN D0       // output
+#define RELAY_STROBE_PIN D6   // output
+#else
 #define RELAY_STROBE_PIN D4   // output
+#endif
+#endif
+#define RELAY_SPARK_PIN D3    // output
 #define MAIN_SWITCH_PIN D5    // input
 #define DEBOUNCE_TIME_MS 20   // how long to check for noise on switchs
 
-// scenes
+// web controller, the prop opens its own access point, UI at 192.168.4.1
+#ifndef WIFI_AP_SSID
+#define WIFI_AP_SSID "frankenstein"
+#endif
+#ifndef WIFI_AP_PASSWORD
+#define WIFI_AP_PASSWORD "itsalive"   // at least 8 characters
+#endif
+
+// multi-prop sync, see include/ShowSync.h: the prop with the access point
+// is the master and starts every prop on the network with its own show,
+// build the others with -DSHOW_SYNC_FOLLOWER to join it and follow
+#define SYNC_SLEW_US 500      // follower: clock correction that moves a running show
+
+// tasks run by the scheduler from loop(), see setup()
+#define SWITCHES_PERIOD_US 1000       // the Debouncer samples once per ms
+#define SWITCHES_DEADLINE_US 10000    // half the debounce time
+#define START_DEADLINE_US 1000        // a show start later than this is a missed deadline
+#define PROFILE_PERIOD_US 100000      // console profile requests
+#define REPORT_LINE_ROOM 120          // LogBuffer room for a line of the show end report
+#define REPORT_DONE 0xFF
+
+// relay outputs, bit n of a cue's outputs drives relayPins[n]
+#define OUTPUT_SPARK 0x01
+#define OUTPUT_STROBE 0x02
+static const uint8_t relayPins[] = {RELAY_SPARK_PIN, RELAY_STROBE_PIN};
+
+// DMX lighting looks for CUE_LIGHT_LOOK cues: fade time, envelopeCurve of
+// the fade and levels of channels 1 to DMX_LOOK_CHANNELS, an RGBW fixture
+#define DMX_LOOK_CHANNELS 4
+#define LOOK_DARK 0
+#define LOOK_GLOW 1
+#define LOOK_FULL 2
+#define LOOK_DIM 3
+struct DmxLook {
+  uint16_t fadeMs;
+  uint8_t curve;
+  uint8_t levels[DMX_LOOK_CHANNELS];
+};
+static constexpr DmxLook dmxLooks[] PROGMEM = {
+  {500,  CURVE_LINEAR,      {0,   0,   0,   0}},     // dark
+  {6000, CURVE_EXPONENTIAL, {0,   80,  255, 0}},     // lab glow, builds up while the machine charges
+  {0,    CURVE_LINEAR,      {255, 255, 255, 255}},   // full, the monster thrashing
+  {1000, CURVE_EASE_IN_OUT, {60,  0,   0,   0}}      // dim red
+};
+#define DMX_LOOK_COUNT (sizeof(dmxLooks) / sizeof(dmxLooks[0]))
+
+// DFPlayer channels for CUE_SOUND_CHANNELS cues, bit n = channel n, only
+// the machine in builds without MULTI_PLAYER
+#define CHANNEL_MACHINE 0x01
+#define CHANNEL_MONSTER 0x02
+#define CHANNEL_CROWD 0x04
+
+// tracks, the bed the effects play over
+#define SOUND_MACHINE_HUM 1
+#define SOUND_CHARGING 2
+// the monster's card holds its growl as track 1, so the act 2 bed starts
+// the hum and the growl together as a grouped start
+
+// SD card folders of variations for CUE_SOUND_RANDOM cues, sounds/ in the
+// repository holds them by name
+#define FOLDER_SCREAMS 1    // sounds/screaming goat
+#define FOLDER_SLAMS 2      // sounds/slam
+
+// one-shot effects for CUE_SOUND_EFFECT cues, inserted over the bed: file
+// in the ADVERT folder of the SD card, length, priority (higher cuts off
+// lower) and how long it may wait for the effect ahead of it
+#define EFFECT_THUD 0
+#define EFFECT_SLAM 1
+#define EFFECT_SCREAM 2
+struct SoundEffect {
+  uint16_t file;
+  uint16_t ms;
+  uint8_t priority;
+  uint16_t maxWaitMs;
+};
+static constexpr SoundEffect soundEffects[] PROGMEM = {
+  {1, 1500, 1, 500},    // thud, the machine switching on
+  {2, 1000, 2, 0},      // slam, the monster hitting the walls
+  {3, 2500, 3, 0}       // scream, cuts off anything else
+};
+#define SOUND_EFFECT_COUNT (sizeof(soundEffects) / sizeof(soundEffects[0]))
+
+// scenes, act 1 ends with the charging sound, ACT1_SCENE_TIME at the latest
 #define ACT1_SCENE_TIME 6000
 #define ACT2_SCENE_TIME 3000
 #define ACT3_SCENE_TIME 2000
 #define ACT4_SCENE_TIME 3000
 #define ACT5_SCENE_TIME 2000
 #define ACT6_SCENE_TIME 6000
-enum statePerform {
-  ACT1_START,   // main switch pulled, machine charging
-  ACT1_SCENE,
-  ACT2_START,   // monster thrashing (sparks and strobe 3 sec)
-  ACT2_SCENE,
-  ACT3_START,   // quiet for 2 sec
-  ACT3_SCENE,
-  ACT4_START,   // monster thrashing (sparks and strobe 3 sec)
-  ACT4_SCENE,
-  ACT5_START,   // quiet for 2 sec
-  ACT5_SCENE,
-  ACT6_START,   // monster escapes (strobe on)
-  ACT6_SCENE
-};
+#define ACT2_AT (ACT1_SCENE_TIME)
+#define ACT3_AT (ACT2_AT + ACT2_SCENE_TIME)
+#define ACT4_AT (ACT3_AT + ACT3_SCENE_TIME)
+#define ACT5_AT (ACT4_AT + ACT4_SCENE_TIME)
+#define ACT6_AT (ACT5_AT + ACT5_SCENE_TIME)
+#define SHOW_END_AT (ACT6_AT + ACT6_SCENE_TIME)
 
-// sound effects
-#define SOUND_MACHINE_HUM 1
-#define SOUND_CHARGING 2
-#define SOUND_THUD 3
+// show file on LittleFS, compiled from a script with tools/compile_show.py
+#define SHOW_FILE_PATH "/show.bin"
+
+// built-in show, used when there is no valid show file
+// the last cue holds until the main switch is turned off
+static constexpr Cue showCues[] PROGMEM = {
+  {0,           0,                            PATTERN_STEADY, CUE_SOUND_RAMP,   rampArgument(20, 3000)},  // act 1: machine charging
+  {0,           0,                            PATTERN_STEADY, CUE_SOUND_PLAY,   SOUND_CHARGING},
+  {0,           0,                            PATTERN_STEADY, CUE_LIGHT_LOOK,   LOOK_GLOW},
+  {0,           0,                            PATTERN_STEADY, CUE_SOUND_EFFECT, EFFECT_THUD},
+  {ACT2_AT,     0,                            PATTERN_STEADY, CUE_SOUND_AWAIT,  SOUND_CHARGING},
+  {ACT2_AT,     0,                            PATTERN_STEADY, CUE_SOUND_CHANNELS, CHANNEL_MACHINE | CHANNEL_MONSTER},
+  {ACT2_AT,     0,                            PATTERN_STEADY, CUE_SOUND_LOOP,   SOUND_MACHINE_HUM},  // the bed from here on
+  {ACT2_AT,     0,                            PATTERN_STEADY, CUE_SOUND_CHANNELS, CHANNEL_MACHINE},
+  {ACT2_AT,     OUTPUT_SPARK | OUTPUT_STROBE, PATTERN_STEADY, CUE_LIGHT_LOOK,   LOOK_FULL},       // act 2: monster thrashing
+  {ACT2_AT,     OUTPUT_SPARK | OUTPUT_STROBE, PATTERN_STEADY, CUE_SOUND_EFFECT, EFFECT_SLAM},
+  {ACT2_AT + 1500, OUTPUT_SPARK | OUTPUT_STROBE, PATTERN_STEADY, CUE_SOUND_EFFECT, EFFECT_SLAM},
+  {ACT3_AT,     0,                            PATTERN_STEADY, CUE_LIGHT_LOOK,   LOOK_DIM},        // act 3: pause
+  {ACT4_AT,     OUTPUT_SPARK | OUTPUT_STROBE, PATTERN_STEADY, CUE_LIGHT_LOOK,   LOOK_FULL},       // act 4: monster thrashing
+  {ACT4_AT,     OUTPUT_SPARK | OUTPUT_STROBE, PATTERN_STEADY, CUE_SOUND_EFFECT, EFFECT_SLAM},
+  {ACT4_AT + 1500, OUTPUT_SPARK | OUTPUT_STROBE, PATTERN_STEADY, CUE_SOUND_EFFECT, EFFECT_SLAM},
+  {ACT5_AT,     0,                            PATTERN_STEADY, CUE_LIGHT_LOOK,   LOOK_DIM},        // act 5: pause
+  {ACT6_AT,     OUTPUT_STROBE,                PATTERN_STEADY, CUE_LIGHT_LOOK,   LOOK_DARK},       // act 6: monster escapes
+  {ACT6_AT,     OUTPUT_STROBE,                PATTERN_STEADY, CUE_SOUND_RANDOM, FOLDER_SCREAMS},  // a different one every show
+  {SHOW_END_AT, OUTPUT_STROBE,                PATTERN_STEADY, CUE_SOUND_NONE,   0}
+};
+#define SHOW_CUE_COUNT (sizeof(showCues) / sizeof(showCues[0]))
+static_assert(SHOW_CUE_COUNT <= 0xFFFF, "show has too many cues");
+static_assert(SHOW_END_AT <= 0xFFFF, "show is longer than a cue offset can hold");
+static_assert(cuesInOrder(showCues, SHOW_CUE_COUNT), "show cues must be in time order");
+static_assert(cuesUseOutputs(showCues, SHOW_CUE_COUNT, OUTPUT_SPARK | OUTPUT_STROBE), "show cue drives an unknown relay");
+static_assert(cuesUsePatterns(showCues, SHOW_CUE_COUNT), "show cue uses an unknown pattern");
+static_assert(cuesSoundBurst(showCues, SHOW_CUE_COUNT) <= PLAYER_CUE_FRAMES, "show cues at one time queue more DFPlayer frames than fit");
 
 // states
 enum stateMachine {
   STOPPED,
   IDLING,
-  PERFORMING
+  PERFORMING,
+  STARTING    // waiting for the synchronized start
 };
 stateMachine state = STOPPED;
-statePerform performanceState = ACT1_START;
+bool switchHeld = false;  // show aborted with the main switch on, wait for it to go off
+unsigned long showStartAt = 0;  // micros(), STARTING until then
+uint8_t showScene = 0;
+bool following = false;         // follower: show started by the master
+unsigned long followedStart = 0;  // micros() the running show was last aligned to
 
-static unsigned long sceneTimer;
+#ifndef DFPLAYER_ON_UART0
 SoftwareSerial mySoftwareSerial(SERIAL_RX_PIN, SERIAL_TX_PIN); // RX, TX
+#endif
+#ifdef MULTI_PLAYER
+SoftwareSerial monsterSerial(MONSTER_RX_PIN, MONSTER_TX_PIN);
+SoftwareSerial crowdSerial(CROWD_RX_PIN, CROWD_TX_PIN);
+#endif
+LogBuffer console(LOG_SERIAL);
 DFRobotDFPlayerMini myDFPlayer;
-bool switchPosition(int pin, bool state);    // debounce switch
-void performSequence();
+PlayerState player(myDFPlayer);
+#ifdef MULTI_PLAYER
+DFRobotDFPlayerMini monsterDFPlayer;
+PlayerState monsterPlayer(monsterDFPlayer);
+DFRobotDFPlayerMini crowdDFPlayer;
+PlayerState crowdPlayer(crowdDFPlayer);
+#endif
+PlayerBus players;                // channel 0 is the machine, player
+uint8_t soundChannels = CHANNEL_MACHINE;    // where sound cues go
+AudioLayers audio(player);
+SoundCatalog catalog(player);
+Debouncer switches;
+StrobePatterns patterns;
+ProgmemCues builtinShow(showCues, SHOW_CUE_COUNT);
+ShowFile showFile;
+void playSound(uint8_t sound, uint16_t argument);
+bool soundFinished(uint16_t track);
+RelayScheduler relays(relayPins, sizeof(relayPins));
+Timeline timeline(relays, playSound, soundFinished);
+ControlServer control;
+Telemetry telemetry;
+ShowSync sync;
+#ifdef DMX_OUTPUT
+DmxOutput dmx;
+#endif
+Scheduler scheduler;
+uint8_t startTaskId;              // woken for showStartAt
+void showTask(unsigned long now, unsigned long nowMs);
+void startTask(unsigned long now, unsigned long nowMs);
+void switchesTask(unsigned long now, unsigned long nowMs);
+void playerTask(unsigned long now, unsigned long nowMs);
+void syncTask(unsigned long now, unsigned long nowMs);
+void controlTask(unsigned long now, unsigned long nowMs);
+void consoleTask(unsigned long now, unsigned long nowMs);
+#ifdef DMX_OUTPUT
+void dmxTask(unsigned long now, unsigned long nowMs);
+#endif
+void showLook(uint16_t look);
+void playEffect(uint16_t effect);
+void playRandom(uint16_t folder);
+void channelSound(uint8_t channel, uint8_t sound, uint16_t argument);
+void startPlayer(DFRobotDFPlayerMini& driver, Stream& stream, PlayerState& state, const char* name);
+int16_t lastCue = -1;             // last cue applied this show
+void pushTelemetry(unsigned long now, unsigned long nowMs);
+void startShow(uint8_t scene);
+void scheduleShow(unsigned long at, uint8_t scene);
+void beginShow();
+void endShow();
+void abortShow();
+void followMaster(unsigned long now);
+void controlCommand(const ControlCommand& command);
+void playerLinkChanged(uint8_t channel, unsigned long now);
+catalogState catalogShown = CATALOG_WAITING;
+bool catalogChecking = false;   // shown as served from the file, checking the card
+void catalogChanged();
+
+// cost of the player link, to compare the SoftwareSerial and UART builds
+unsigned long lastLoopAt = 0;     // micros()
+unsigned long maxLoopGap = 0;     // us between two loop() passes
+unsigned long windowLoops = 0;    // loop() passes since the last telemetry push
+unsigned long windowMaxGap = 0;   // us
+uint8_t reportLine = REPORT_DONE; // next line of the show end tables, consoleTask() prints it
+void printReportLine();
+
+#ifdef PROFILER
+// profile dump requests typed on the console: c = CSV, b = binary, r = reset
+// the UART build has no console input and dumps CSV at show end only
+void profileTask(unsigned long now, unsigned long nowMs);
+void profileRequests();
+void profileDump(bool binary);
+#endif
 
 void setup() {
   pinMode(MAIN_SWITCH_PIN, INPUT);
   pinMode(RELAY_SPARK_PIN, OUTPUT);
   pinMode(RELAY_STROBE_PIN, OUTPUT);
   pinMode(LED_BUILTIN, OUTPUT);
+  switches.attach(MAIN_SWITCH_PIN, DEBOUNCE_TIME_MS);
 
   digitalWrite(RELAY_SPARK_PIN, LOW);   // sparks off
   digitalWrite(RELAY_STROBE_PIN, LOW);  // strobe off
+  patterns.begin();
+  relays.begin(patterns);
+
+  PLAYER_SERIAL.begin(9600);
+#ifdef MULTI_PLAYER
+  monsterSerial.begin(9600);
+  crowdSerial.begin(9600);
+#endif
+#ifdef DFPLAYER_ON_UART0
+  Serial.swap();        // UART0 to D7/D8, away from the USB serial chip
+#endif
+  LOG_SERIAL.begin(115200);
+#ifdef DMX_OUTPUT
+  dmx.begin(DMX_SERIAL, DMX_LOOK_CHANNELS);   // only the channels in use, shorter frames
+#endif
+#ifdef SHOW_SYNC_FOLLOWER
+  WiFi.mode(WIFI_STA);
+  WiFi.begin(WIFI_AP_SSID, WIFI_AP_PASSWORD);   // the master's access point, joined in the background
+  sync.begin(false);
+#else
+  WiFi.mode(WIFI_AP);
+  WiFi.softAP(WIFI_AP_SSID, WIFI_AP_PASSWORD);
+  sync.begin(true);
+#endif
+
+  console.println();
+  console.println(F("DFRobot DFPlayer Mini Demo"));
+  console.println(F("Starting DFPlayer in the background, lights only until it is online"));
+
+  startPlayer(myDFPlayer, PLAYER_SERIAL, player, "machine");
+#ifdef MULTI_PLAYER
+  startPlayer(monsterDFPlayer, monsterSerial, monsterPlayer, "monster");
+  startPlayer(crowdDFPlayer, crowdSerial, crowdPlayer, "crowd");
+#endif
 
-  
-  mySoftwareSerial.begin(9600);
-  Serial.begin(115200);
-  WiFi.mode(WIFI_OFF);  // turn wifi off
+  bool mounted = LittleFS.begin();
+  if (mounted && showFile.open(LittleFS, SHOW_FILE_PATH, OUTPUT_SPARK | OUTPUT_STROBE)) {
+    timeline.begin(&showFile);
+    console.print(F("Show loaded from " SHOW_FILE_PATH ", cues: "));
+    console.println(showFile.count());
+  } else {
+    timeline.begin(&builtinShow);
+    console.println(F("No valid " SHOW_FILE_PATH ", using built-in show"));
+  }
 
-  Serial.println();
-  Serial.println(F("DFRobot DFPlayer Mini Demo"));
-  Serial.println(F("Initializing DFPlayer ... (May take 3~5 seconds)"));
+  catalog.begin(mounted ? &LittleFS : nullptr);   // checked against the card once it is online
 
-  if (!myDFPlayer.begin(mySoftwareSerial)) {  // Use softwareSerial to communicate with mp3.
-    Serial.println(F("Unable to begin:"));
-    Serial.println(F("1.Please recheck the connection!"));
-    Serial.println(F("2.Please insert the SD card!"));
-    while(true);
+  if (mounted) {
+    control.begin(LittleFS);
+    console.println(F("Web controller on WiFi " WIFI_AP_SSID));
   }
-  Serial.println(F("DFPlayer Mini online."));
+#ifdef SHOW_SYNC_FOLLOWER
+  console.println(F("Following the show master on WiFi " WIFI_AP_SSID));
+#endif
 
-  myDFPlayer.volume(5);  //Set volume value. From 0 to 30
+  // the show and its outputs first, player I/O and sync next, then the rest
+  startTaskId = scheduler.once("start", startTask, TASK_HIGH, START_DEADLINE_US);
+  scheduler.every("show", showTask, TASK_EVERY_PASS, TASK_HIGH);
+#ifdef DMX_OUTPUT
+  scheduler.every("dmx", dmxTask, TASK_EVERY_PASS, TASK_HIGH);
+#endif
+  scheduler.every("switches", switchesTask, SWITCHES_PERIOD_US, TASK_NORMAL, SWITCHES_DEADLINE_US);
+  scheduler.every("player", playerTask, TASK_EVERY_PASS, TASK_NORMAL);
+  scheduler.every("sync", syncTask, TASK_EVERY_PASS, TASK_NORMAL);
+  scheduler.every("control", controlTask, TASK_EVERY_PASS, TASK_LOW);
+  scheduler.every("console", consoleTask, TASK_EVERY_PASS, TASK_LOW);
+#ifdef PROFILER
+  scheduler.every("profile", profileTask, PROFILE_PERIOD_US, TASK_LOW);
+#endif
 }
 
 void loop() {
-  
+  PROFILE_SCOPE(PROFILE_LOOP);
+  unsigned long now = micros();
+  if (now - lastLoopAt > maxLoopGap) {
+    maxLoopGap = now - lastLoopAt;
+  }
+  if (now - lastLoopAt > windowMaxGap) {
+    windowMaxGap = now - lastLoopAt;
+  }
+  windowLoops++;
+  lastLoopAt = now;
+
+  scheduler.run();    // every task that is due, highest priority first
+}
+
+// hand buffered log text to the UART, never blocks; the show end tables
+// go out a line at a time as the LogBuffer makes room
+void consoleTask(unsigned long, unsigned long) {
+  PROFILE_SCOPE(PROFILE_CONSOLE);
+  if (reportLine != REPORT_DONE && console.availableForWrite() >= REPORT_LINE_ROOM) {
+    printReportLine();
+  }
+  console.update();
+}
+
+// sample switches, never blocks
+void switchesTask(unsigned long, unsigned long nowMs) {
+  PROFILE_SCOPE(PROFILE_SWITCHES);
+  switches.update(nowMs);
+}
+
+#ifdef DMX_OUTPUT
+// next DMX slots into the UART FIFO, never blocks
+void dmxTask(unsigned long now, unsigned long) {
+  dmx.update(now);
+}
+#endif
+
+// a DFPlayer on its own link, reset in the background, and its bus channel
+void startPlayer(DFRobotDFPlayerMini& driver, Stream& stream, PlayerState& state, const char* name) {
+  driver.begin(stream, true, false);  // no reset here, it would wait for the card
+  driver.enableQueue();               // commands return right away, the bus sends them
+  state.begin();                      // resets the player, playerTask() sees it come online
+  players.add(name, driver, state);
+}
+
+// player events in, then the next queued command out once its link is free
+void playerTask(unsigned long, unsigned long nowMs) {
+  {
+    PROFILE_SCOPE(PROFILE_PLAYER_EVENTS);
+    players.receive(nowMs);       // every channel, never blocks
+  }
+  for (uint8_t channel = 0; channel < players.channels(); channel++) {
+    uint16_t finished = players.finished(channel);
+    if (finished) {
+      console.printf("Sound %u finished on the %s after %lu ms\n", finished, players.name(channel),
+                     players.player(channel).playback().length());
+    }
+    if (players.linkChanged(channel)) {
+      playerLinkChanged(channel, nowMs);
+    }
+    unsigned long dropped = players.newlyDropped(channel);
+    if (dropped) {
+      console.printf("DFPlayer on the %s: queue full, dropped %lu; play, volume and EQ go again\n",
+                     players.name(channel), dropped);
+    }
+  }
+  audio.update(nowMs);      // effects end and queued ones start
+  catalog.update(nowMs);
+  if (catalog.state() != catalogShown || catalog.verifying() != catalogChecking) {
+    catalogShown = catalog.state();
+    catalogChecking = catalog.verifying();
+    catalogChanged();
+  }
+  PROFILE_SCOPE(PROFILE_PLAYER_SEND);
+  players.transmit();       // a frame per pass, the channels taking turns
+}
+
+// the startup handshake went one way or the other
+void playerLinkChanged(uint8_t channel, unsigned long now) {
+  PlayerState& changed = players.player(channel);
+  if (changed.link() == PLAYER_READY) {
+    console.printf("DFPlayer Mini on the %s online, %lu ms after boot\n", players.name(channel),
+                   changed.readyAt());
+    if (state == IDLING) {
+      state = STOPPED;    // hum and volume again
+    } else if (state == PERFORMING || state == STARTING) {
+      changed.restore();  // the show's volume and EQ, the reset dropped them; the sound
+                          // that was playing is lost, the next sound cues play
+    }
+  } else if (changed.link() == PLAYER_OFFLINE) {
+    console.printf("DFPlayer on the %s not online, retrying in %lu ms. Check the connection and the SD card\n",
+                   players.name(channel), changed.retryIn(now));
+  }
+}
+
+void catalogChanged() {
+  if (catalogShown == CATALOG_SCANNING) {
+    console.println(F("Sound catalog: new SD card, counting the files in its folders"));
+  } else if (catalogShown == CATALOG_READY) {
+    console.printf("Sound catalog: %u folders", catalog.folders());
+    for (uint8_t folder = 1; folder <= catalog.folders(); folder++) {
+      console.printf("%s%u", folder == 1 ? " of " : "/", catalog.files(folder));
+    }
+    if (catalogChecking) {
+      console.println(F(" files, from " CATALOG_FILE ", checking them against the card"));
+    } else if (catalog.fromCache()) {
+      console.printf(" files, from " CATALOG_FILE ", checked in %lu ms\n", catalog.scanMs());
+    } else {
+      console.printf(" files, scanned in %lu ms\n", catalog.scanMs());
+    }
+  }
+}
+
+// show sync beacons out or in, never blocks
+void syncTask(unsigned long, unsigned long nowMs) {
+  switch (sync.update(nowMs)) {
+    case SYNC_START:
+      scheduleShow(sync.startAt(), sync.scene());
+      following = true;
+      break;
+    case SYNC_STOP:
+      if (state == PERFORMING && following && timeline.finished()) {
+        endShow();
+      } else {
+        abortShow();
+      }
+      break;
+  }
+}
+
+// web controller commands and telemetry, requests themselves are served by
+// the network stack
+void controlTask(unsigned long now, unsigned long nowMs) {
+  control.update(nowMs);
+  ControlCommand command;
+  while (control.read(command)) {
+    controlCommand(command);
+  }
+  if (telemetry.due(nowMs)) {
+    pushTelemetry(now, nowMs);
+  }
+}
+
+#ifdef PROFILER
+void profileTask(unsigned long, unsigned long) {
+  profileRequests();
+}
+#endif
+
+// the synchronized show start, woken by scheduleShow()
+void startTask(unsigned long, unsigned long) {
+  if (state == STARTING) {
+    beginShow();
+  }
+}
+
+// the show state machine and the cue engine
+void showTask(unsigned long now, unsigned long) {
   switch (state) {
     case IDLING:
-      digitalWrite(RELAY_SPARK_PIN, LOW);   // sparks off
-      digitalWrite(RELAY_STROBE_PIN, LOW);  // strobe off
-      if (switchPosition(MAIN_SWITCH_PIN, HIGH)) {
-        state = PERFORMING;
-        myDFPlayer.stop();
-        performanceState = ACT1_START;
+      if (switches.read(MAIN_SWITCH_PIN) == LOW) {
+        switchHeld = false;
+      } else if (!switchHeld) {
+        startShow(0);
+        break;
+      }
+      if (catalog.unsaved()) {
+        catalog.save();   // flash writes with the cache off, only between shows
       }
       break;
-    case PERFORMING:
-      performSequence();
+    case STARTING:
+      break;    // startTask() begins the show
+    case PERFORMING: {
+      if (following) {
+        followMaster(now);
+      }
+      int cue;
+      {
+        PROFILE_SCOPE(PROFILE_TIMELINE);
+        cue = timeline.update(now);
+      }
+      if (cue >= 0) {
+        lastCue = cue;
+        console.print(F("Cue "));
+        console.println(cue);
+      }
+      // a followed show ends with the master's
+      if (timeline.finished() && switches.read(MAIN_SWITCH_PIN) == LOW && !following) {
+        if (sync.master()) {
+          sync.abort();
+        }
+        endShow();
+      }
       break;
+    }
     case STOPPED:
-      digitalWrite(RELAY_SPARK_PIN, LOW);   // sparks off
-      digitalWrite(RELAY_STROBE_PIN, LOW);  // strobe off
-      myDFPlayer.stop();
-      myDFPlayer.volume(5);  //Set volume value. From 0 to 30
-      myDFPlayer.loop(SOUND_MACHINE_HUM);
+      timeline.writeOutputs(0);   // sparks and strobe off
+      showLook(LOOK_DARK);
+      audio.clearEffects();
+      for (uint8_t channel = 0; channel < players.channels(); channel++) {
+        players.player(channel).volume(5);  //Set volume value. From 0 to 30, not sent if unchanged
+      }
+      for (uint8_t channel = 1; channel < players.channels(); channel++) {
+        players.player(channel).stop();     // only the machine hums
+      }
+      audio.loop(SOUND_MACHINE_HUM);  // not sent if the show ended on the hum
       state = IDLING;
       break;
   }
 }
 
-void performSequence() {
-  switch (performanceState) {
-    case ACT1_START:          // machine charging
-      sceneTimer = millis();  // start scene timer
-      myDFPlayer.volume(20);  // set volume value. From 0 to 30
-      // myDFPlayer.play(SOUND_THUD);
-      // delay(1500);
-      myDFPlayer.play(SOUND_CHARGING);
-      digitalWrite(RELAY_SPARK_PIN, LOW);   // sparks off
-      digitalWrite(RELAY_STROBE_PIN, LOW);  // strobe off
-      Serial.println(F("Act 1: charging..."));
-      performanceState = ACT1_SCENE;
+// a show started here, the master starts the followers with it
+void startShow(uint8_t scene) {
+  scheduleShow(sync.master() ? sync.trigger(scene) : micros(), scene);
+  following = false;
+}
+
+void scheduleShow(unsigned long at, uint8_t scene) {
+  state = STARTING;
+  showStartAt = at;
+  showScene = scene;
+  scheduler.wake(startTaskId, at);
+  audio.stop();     // the hum stops while the followers get ready
+  for (uint8_t channel = 1; channel < players.channels(); channel++) {
+    players.player(channel).stop();
+  }
+}
+
+void beginShow() {
+  state = PERFORMING;
+  relays.resetJitter();
+  scheduler.resetStats();
+  players.resetStats();
+  reportLine = REPORT_DONE;   // what is left of the last show's report would mix the two
+  maxLoopGap = 0;
+  soundChannels = CHANNEL_MACHINE;
+#ifdef DMX_OUTPUT
+  dmx.resetStats();
+#endif
+  timeline.start(showStartAt, showScene);
+  followedStart = showStartAt;
+  lastCue = -1;
+  console.printf("Show started at scene %u%s\n", showScene, following ? ", following" : "");
+}
+
+// outputs off first, the report follows through the LogBuffer without
+// holding up loop()
+void endShow() {
+  timeline.writeOutputs(0);
+  showLook(LOOK_DARK);
+  state = STOPPED;
+  scheduler.holdStats();
+  players.holdStats();
+  reportLine = 0;
+  relays.reportJitter(console);
+  console.printf("Player link: frames %lu, timeouts %lu, bad frames %lu, dropped %lu (retried %lu), ack %lu us (max %lu us), skipped %lu, ramp steps %lu\n",
+                 myDFPlayer.framesSent(), myDFPlayer.timeOutCount(), myDFPlayer.wrongStackCount(),
+                 myDFPlayer.queueDropped(), player.retried(), myDFPlayer.ackLatency(), myDFPlayer.maxAckLatency(),
+                 player.skipped(), player.rampSteps());
+  if (player.readyAt()) {
+    console.printf("Player boot: online %lu ms after boot, %lu failed resets\n", player.readyAt(),
+                   player.bootFailures());
+  } else {
+    console.printf("Player boot: not online, %lu failed resets\n", player.bootFailures());
+  }
+  console.printf("Audio effects: %lu played, %lu cut off, %lu dropped\n", audio.effects(), audio.preempted(),
+                 audio.dropped());
+  console.printf("Player sends: %lu, mean %lu us, max %lu us; loop gap max %lu us\n",
+                 players.sends(), (unsigned long)players.meanSendUs(), (unsigned long)players.maxSendUs(), maxLoopGap);
+#ifdef DMX_OUTPUT
+  console.printf("DMX: frames %lu, period %lu us (max %lu us)\n", dmx.frames(), dmx.period(), dmx.maxPeriod());
+#endif
+  if (following) {
+    console.printf("Sync: beacons %lu, offset %ld us, drift %ld ppb, rejected %lu\n",
+                   sync.clock().beacons(), sync.clock().offset(), sync.clock().drift(), sync.rejected());
+  }
+}
+
+// the players (with more than one) and the task table, too big for the
+// LogBuffer at once
+void printReportLine() {
+  uint8_t line = reportLine++;
+  if (players.channels() > 1) {
+    if (line == 0) {
+      console.println(F("Players:"));
+      return;
+    }
+    if (line <= players.reportLines()) {
+      players.reportLine(console, line - 1);
+      return;
+    }
+    line -= players.reportLines() + 1;
+  }
+  if (line < scheduler.reportLines()) {
+    scheduler.reportLine(console, line);
+    return;
+  }
+  reportLine = REPORT_DONE;
+#ifdef PROFILER
+  profileDump(false);   // the UART build has no console to ask for it, outputs are off by now
+#endif
+}
+
+void abortShow() {
+  if (state != PERFORMING && state != STARTING) {
+    return;
+  }
+  if (sync.master()) {
+    sync.abort();
+  }
+  scheduler.cancel(startTaskId);
+  switchHeld = switches.read(MAIN_SWITCH_PIN) == HIGH;
+  state = STOPPED;
+  console.println(F("Show aborted"));
+}
+
+// keep a followed show running at the master's pace, whatever the crystals
+void followMaster(unsigned long now) {
+  if (!sync.clock().locked(now)) {
+    return;   // master gone, run on
+  }
+  long slew = (long)(now - followedStart) - sync.elapsed(now);    // ahead of the master
+  if (slew >= SYNC_SLEW_US || slew <= -SYNC_SLEW_US) {
+    timeline.shift(slew);
+    followedStart += slew;
+  }
+}
+
+// show state for the web controller, sent only to clients that can take it
+void pushTelemetry(unsigned long now, unsigned long nowMs) {
+  static unsigned long windowStart = 0;
+  TelemetryState current;
+  current.state = state;
+  current.cue = lastCue;
+  current.scene = state == PERFORMING ? timeline.scene() : 0;
+  current.sceneElapsed = state == PERFORMING ? timeline.sceneElapsed(now) : 0;
+  current.outputs = timeline.outputs();
+  current.track = player.playback().track();
+  current.playing = player.playback().playing();
+  current.volume = player.volume();
+  current.playerTimeouts = myDFPlayer.timeOutCount();
+  current.playerBadFrames = myDFPlayer.wrongStackCount();
+  current.playerDropped = myDFPlayer.queueDropped();
+  unsigned long loopRate = nowMs > windowStart ? windowLoops * 1000 / (nowMs - windowStart) : 0;
+  current.loopRate = loopRate > 0xFFFF ? 0xFFFF : loopRate;   // an idle loop() on the ESP8266 can pass that
+  current.loopGapMax = windowMaxGap;
+  current.sequence = control.sequence();
+  current.clients = control.clients();
+  windowStart = nowMs;
+  windowLoops = windowMaxGap = 0;
+  control.push(telemetry, telemetry.update(current, nowMs));
+}
+
+// commands from the web controller
+void controlCommand(const ControlCommand& command) {
+  switch (command.type) {
+    case CONTROL_TRIGGER:
+    case CONTROL_SCENE:
+      startShow(command.type == CONTROL_SCENE ? (command.argument > 0xFF ? 0xFF : command.argument) : 0);
+      break;
+    case CONTROL_ABORT:
+      abortShow();
+      break;
+    case CONTROL_VOLUME:
+      player.volume(command.argument);
+      break;
+    // the controller page's joystick has nothing to drive on this prop
+  }
+}
+
+// sound and light actions requested by show cues, effects and random
+// sounds play on the machine, the rest on the channels the last
+// CUE_SOUND_CHANNELS cue picked
+void playSound(uint8_t sound, uint16_t argument) {
+  switch (sound) {
+    case CUE_SOUND_EFFECT:
+      playEffect(argument);
       break;
-    case ACT1_SCENE:
-      digitalWrite(RELAY_SPARK_PIN, LOW);   // sparks off
-      digitalWrite(RELAY_STROBE_PIN, LOW);  // strobe off
-      if (millis() - sceneTimer > ACT1_SCENE_TIME) {
-        myDFPlayer.stop();
-        performanceState = ACT2_START;
-      }
+    case CUE_SOUND_RANDOM:
+      playRandom(argument);
       break;
-    case ACT2_START:          // monster thrashing (sparks and strobe 3 sec)
-      sceneTimer = millis();  // start scene timer
-      digitalWrite(RELAY_SPARK_PIN, HIGH);
-      digitalWrite(RELAY_STROBE_PIN, HIGH);
-      Serial.println(F("Act 2: Spark and strobe"));
-      performanceState = ACT2_SCENE;
-      break;
-    case ACT2_SCENE:
-      digitalWrite(RELAY_SPARK_PIN, HIGH);   // sparks on
-      digitalWrite(RELAY_STROBE_PIN, HIGH);
-      if (millis() - sceneTimer > ACT2_SCENE_TIME) {
-        performanceState = ACT3_START;
+    case CUE_LIGHT_LOOK:
+      showLook(argument);
+      break;
+    case CUE_SOUND_CHANNELS:
+      soundChannels = argument & ((1 << players.channels()) - 1);
+      if (!soundChannels) {
+        soundChannels = CHANNEL_MACHINE;    // a show for more players than this prop has
       }
       break;
-    case ACT3_START:          // quiet for 2 sec
-      sceneTimer = millis();  // start scene timer
-      digitalWrite(RELAY_SPARK_PIN, LOW);   // sparks off
-      digitalWrite(RELAY_STROBE_PIN, LOW);  // strobe off
-      Serial.println(F("Act 3: Pause"));
-      performanceState = ACT3_SCENE;
-      break;
-    case ACT3_SCENE:
-      digitalWrite(RELAY_SPARK_PIN, LOW);   // sparks off
-      digitalWrite(RELAY_STROBE_PIN, LOW);  // strobe off
-      if (millis() - sceneTimer > ACT3_SCENE_TIME) {
-        performanceState = ACT4_START;
+    default:
+      if (soundChannels & (soundChannels - 1)) {
+        players.hold(soundChannels);    // several channels, they start together
+      }
+      for (uint8_t channel = 0; channel < players.channels(); channel++) {
+        if (soundChannels & (1 << channel)) {
+          channelSound(channel, sound, argument);
+        }
       }
       break;
-    case ACT4_START:          // monster thrashing (sparks and strobe 3 sec)
-      sceneTimer = millis();  // start scene timer
-      digitalWrite(RELAY_SPARK_PIN, HIGH);   // sparks on
-      digitalWrite(RELAY_STROBE_PIN, HIGH);
-      Serial.println(F("Act 4: Spark and strobe"));
-      performanceState = ACT4_SCENE;
-      break;
-    case ACT4_SCENE:          
-      digitalWrite(RELAY_SPARK_PIN, HIGH);   // sparks on
-      digitalWrite(RELAY_STROBE_PIN, HIGH);
-      if (millis() - sceneTimer > ACT4_SCENE_TIME) {
-        performanceState = ACT5_START;
+  }
+}
+
+// the machine's bed goes through its effect layer
+void channelSound(uint8_t channel, uint8_t sound, uint16_t argument) {
+  PlayerState& target = players.player(channel);
+  switch (sound) {
+    case CUE_SOUND_PLAY:
+      if (channel) {
+        target.play(argument);
+      } else {
+        audio.play(argument);
       }
       break;
-    case ACT5_START:          // quiet for 2 sec
-      sceneTimer = millis();  // start scene timer
-      digitalWrite(RELAY_SPARK_PIN, LOW);   // sparks off
-      digitalWrite(RELAY_STROBE_PIN, LOW);  // strobe off
-      Serial.println(F("Act 5: Pause"));
-      performanceState = ACT5_SCENE;
-      break;
-    case ACT5_SCENE:
-      digitalWrite(RELAY_SPARK_PIN, LOW);   // sparks off
-      digitalWrite(RELAY_STROBE_PIN, LOW);  // strobe off
-      if (millis() - sceneTimer > ACT5_SCENE_TIME) {
-        performanceState = ACT6_START;
+    case CUE_SOUND_LOOP:
+      if (channel) {
+        target.loop(argument);
+      } else {
+        audio.loop(argument);
       }
       break;
-    case ACT6_START:          // monster escapes (strobe on)
-      sceneTimer = millis();  // start scene timer
-      digitalWrite(RELAY_SPARK_PIN, LOW);   // sparks off
-      digitalWrite(RELAY_STROBE_PIN, HIGH);
-      Serial.println(F("Act 6: Strobe on, waiting for switch off"));
-      performanceState = ACT6_SCENE;
-      break;
-    case ACT6_SCENE:
-      digitalWrite(RELAY_SPARK_PIN, LOW);
-      digitalWrite(RELAY_STROBE_PIN, HIGH);
-      if (millis() - sceneTimer > ACT6_SCENE_TIME) {
-        if(switchPosition(MAIN_SWITCH_PIN, LOW)) {
-          digitalWrite(RELAY_STROBE_PIN, LOW);  // strobe off
-          state = STOPPED;
-        }
+    case CUE_SOUND_STOP:
+      if (channel) {
+        target.stop();
+      } else {
+        audio.stop();
       }
       break;
+    case CUE_SOUND_VOLUME:
+      target.volume(argument);
+      break;
+    case CUE_SOUND_RAMP:
+      target.ramp(argument & 0xFF, (argument >> 8) * CUE_RAMP_STEP_MS);
+      break;
   }
 }
 
-// checks if switch is at correct state during debounce period of time
-bool switchPosition(int pin, bool state) {
-  bool debounceState = true;
-  unsigned long debounceTimer = millis();
+// fade the DMX lights to a look, all channels in the same frame
+void showLook(uint16_t look) {
+#ifdef DMX_OUTPUT
+  if (look >= DMX_LOOK_COUNT) {
+    return;
+  }
+  DmxLook entry;
+  memcpy_P(&entry, &dmxLooks[look], sizeof(entry));
+  for (uint8_t i = 0; i < DMX_LOOK_CHANNELS; i++) {
+    dmx.fade(i + 1, entry.levels[i], entry.fadeMs, entry.curve);   // a fade of 0 ms is a set()
+  }
+  dmx.commit();
+#else
+  (void)look;
+#endif
+}
+
+// insert a sound effect over the bed, it may be queued or dropped
+void playEffect(uint16_t effect) {
+  if (effect >= SOUND_EFFECT_COUNT) {
+    return;
+  }
+  SoundEffect entry;
+  memcpy_P(&entry, &soundEffects[effect], sizeof(entry));
+  audio.effect(entry.file, entry.ms, entry.priority, entry.maxWaitMs);
+}
+
+// one of the folder's variations, none until the catalog has its count
+void playRandom(uint16_t folder) {
+  uint16_t file = folder <= CATALOG_FOLDERS ? catalog.pick(folder) : 0;
+  if (file) {
+    audio.playFolder(folder, file);
+    console.printf("Random sound %u of folder %u\n", file, folder);
+  }
+}
 
-  // keep checking that switch is at correct state
-  while(millis() - debounceTimer < DEBOUNCE_TIME_MS) {
-    if (digitalRead(pin) != state) {
-      debounceState = false;
+// lets CUE_SOUND_AWAIT cues fire as soon as their sound is over, on any of
+// the channels sound cues go to
+bool soundFinished(uint16_t track) {
+  for (uint8_t channel = 0; channel < players.channels(); channel++) {
+    if ((soundChannels & (1 << channel)) && players.player(channel).playback().finished(track)) {
+      return true;
     }
   }
-  return debounceState;
-}
\ No newline at end of file
+  return false;
+}
+
+#ifdef PROFILER
+void profileRequests() {
+#ifndef DFPLAYER_ON_UART0
+  while (Serial.available()) {
+    switch (Serial.read()) {
+      case 'c':
+        profileDump(false);
+        break;
+      case 'b':
+        profileDump(true);
+        break;
+      case 'r':
+        profiler.reset();
+        break;
+    }
+  }
+#endif
+}
+
+// the dump goes straight to the UART after the log, it is too big for the
+// LogBuffer and only happens on request
+void profileDump(bool binary) {
+  PROFILE_SET(PROFILE_PLAYER_TIMEOUTS, myDFPlayer.timeOutCount());
+  PROFILE_SET(PROFILE_PLAYER_WRONG_STACK, myDFPlayer.wrongStackCount());
+  PROFILE_SET(PROFILE_LOG_DROPPED, console.dropped());
+  console.flush();
+  if (binary) {
+    profiler.dumpBinary(LOG_SERIAL);
+  } else {
+    profiler.dumpCsv(LOG_SERIAL);
+  }
+}
+#endif
+
+#endif  // UNIT_TEST
@@ -0,0 +1,158 @@
+/*
+ * test_main.cpp
+ * Debouncer on NativeHal's virtual clock.
+ *
+ * A switch is scripted as level changes at ms offsets, contact bounce
+ * included, and update() is called once per simulated ms as the switches
+ * task does. The debounced edges must come exactly DEBOUNCE_MS after the
+ * last bounce, once per press, and polling must cost one pin read per
+ * input per ms without ever moving the clock.
+ */
+
+#include <unity.h>
+#include <vector>
+#include "NativeHal.h"
+#include "Debouncer.h"
+
+#define SWITCH_PIN D5
+#define DEBOUNCE_MS 20
+#define LONG_PRESS_MS 500
+#define START_MS 5
+
+struct Change {
+  unsigned long at;     // ms from the start of the script
+  uint8_t level;
+};
+
+struct Event {
+  unsigned long at;     // ms from the start of the script
+  uint8_t events;
+};
+
+static std::vector<Event> seen;
+
+// runs the script for ms, one update() per ms, and records the events
+static void drive(Debouncer& switches, const Change* changes, size_t count, unsigned long ms) {
+  unsigned long start = millis();
+  size_t next = 0;
+  for (unsigned long at = 0; at < ms; at++) {
+    while (next < count && changes[next].at <= at) {
+      hal::setInput(SWITCH_PIN, changes[next++].level);
+    }
+    switches.update(millis());
+    uint8_t events = switches.events(SWITCH_PIN);
+    if (events) {
+      seen.push_back({millis() - start, events});
+    }
+    hal::advance(1000);
+  }
+}
+
+void setUp() {
+  hal::reset();
+  pinMode(SWITCH_PIN, INPUT);
+  hal::advance(START_MS * 1000ULL);
+  seen.clear();
+}
+
+void tearDown() {
+}
+
+// press with 7 ms of bounce, release with 6 ms of bounce
+static const Change bouncingPress[] = {
+  {0, HIGH}, {1, LOW}, {3, HIGH}, {4, LOW}, {7, HIGH},
+  {200, LOW}, {202, HIGH}, {203, LOW}, {204, HIGH}, {206, LOW}
+};
+
+static void test_bouncing_press_gives_one_edge_each_way() {
+  Debouncer switches;
+  switches.attach(SWITCH_PIN, DEBOUNCE_MS);
+  drive(switches, bouncingPress, sizeof(bouncingPress) / sizeof(bouncingPress[0]), 400);
+
+  TEST_ASSERT_EQUAL(2, seen.size());
+  TEST_ASSERT_EQUAL_UINT32(7 + DEBOUNCE_MS, seen[0].at);
+  TEST_ASSERT_EQUAL_HEX8(DEBOUNCE_RISING, seen[0].events);
+  TEST_ASSERT_EQUAL_UINT32(206 + DEBOUNCE_MS, seen[1].at);
+  TEST_ASSERT_EQUAL_HEX8(DEBOUNCE_FALLING, seen[1].events);
+  TEST_ASSERT_EQUAL_UINT8(LOW, switches.read(SWITCH_PIN));
+}
+
+// pulses shorter than the debounce time never get through
+static const Change glitches[] = {
+  {10, HIGH}, {11, LOW}, {50, HIGH}, {50 + DEBOUNCE_MS - 1, LOW}, {100, HIGH}, {105, LOW}
+};
+
+static void test_glitches_give_no_edge() {
+  Debouncer switches;
+  switches.attach(SWITCH_PIN, DEBOUNCE_MS);
+  drive(switches, glitches, sizeof(glitches) / sizeof(glitches[0]), 200);
+
+  TEST_ASSERT_EQUAL(0, seen.size());
+  TEST_ASSERT_EQUAL_UINT8(LOW, switches.read(SWITCH_PIN));
+}
+
+static const Change longPress[] = {
+  {0, HIGH}, {2, LOW}, {3, HIGH}, {1000, LOW}
+};
+
+static void test_long_press_once() {
+  Debouncer switches;
+  switches.attach(SWITCH_PIN, DEBOUNCE_MS, LONG_PRESS_MS);
+  drive(switches, longPress, sizeof(longPress) / sizeof(longPress[0]), 1100);
+
+  TEST_ASSERT_EQUAL(3, seen.size());
+  TEST_ASSERT_EQUAL_UINT32(3 + DEBOUNCE_MS, seen[0].at);
+  TEST_ASSERT_EQUAL_HEX8(DEBOUNCE_RISING, seen[0].events);
+  TEST_ASSERT_EQUAL_UINT32(3 + DEBOUNCE_MS + LONG_PRESS_MS, seen[1].at);
+  TEST_ASSERT_EQUAL_HEX8(DEBOUNCE_LONG_PRESS, seen[1].events);
+  TEST_ASSERT_EQUAL_UINT32(1000 + DEBOUNCE_MS, seen[2].at);
+  TEST_ASSERT_EQUAL_HEX8(DEBOUNCE_FALLING, seen[2].events);
+}
+
+// a switch already on at boot is the stable state, not a press
+static void test_held_at_boot() {
+  hal::setInput(SWITCH_PIN, HIGH);
+  Debouncer switches;
+  switches.attach(SWITCH_PIN, DEBOUNCE_MS, LONG_PRESS_MS);
+  drive(switches, nullptr, 0, 2000);
+
+  TEST_ASSERT_EQUAL(0, seen.size());
+  TEST_ASSERT_EQUAL_UINT8(HIGH, switches.read(SWITCH_PIN));
+}
+
+// one pin read per input per ms however often update() is called, and
+// update() never waits
+static void test_poll_cost() {
+  static const uint8_t pins[] = {D1, D2, SWITCH_PIN};
+  Debouncer switches;
+  for (uint8_t pin : pins) {
+    pinMode(pin, INPUT);
+    switches.attach(pin, DEBOUNCE_MS);
+  }
+  uint32_t readsBefore = hal::pinReads();
+  unsigned long polls = 0;
+  for (unsigned long us = 0; us < 1000000UL; us += 100) {
+    if (us % 3000 == 0) {   // keep the pins bouncing
+      hal::setInput(SWITCH_PIN, !hal::pinLevel(SWITCH_PIN));
+    }
+    uint64_t before = hal::now();
+    switches.update(millis());
+    TEST_ASSERT_EQUAL_UINT64(before, hal::now());
+    polls++;
+    hal::advance(100);
+  }
+  uint32_t reads = hal::pinReads() - readsBefore;
+
+  TEST_ASSERT_EQUAL(10000, polls);
+  TEST_ASSERT_EQUAL_UINT32(1000 * sizeof(pins), reads);
+}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(test_bouncing_press_gives_one_edge_each_way);
+  RUN_TEST(test_glitches_give_no_edge);
+  RUN_TEST(test_long_press_once);
+  RUN_TEST(test_held_at_boot);
+  RUN_TEST(test_poll_cost);
+  return UNITY_END();
+}
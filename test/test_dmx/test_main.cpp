@@ -0,0 +1,288 @@
+/*
+ * test_main.cpp
+ * The DMX512 byte stream DmxOutput puts on the UART.
+ *
+ * Runs DmxOutput on NativeHal's Serial1 for RUN_MS of virtual time, with a
+ * loop() pass every given us and optionally a 10 ms stall, like a
+ * SoftwareSerial frame to the DFPlayer, every n passes. Captures every
+ * byte with the virtual time its start bit goes out and the baud rate, cuts
+ * the capture into frames and checks:
+ *
+ *   timing    break of 88 us or more, mark after break of 8 us or more,
+ *             slots at 250 kbaud, start code 0, 512 slots, frame rate
+ *             without stalls
+ *   contents  pattern A until a commit at COMMIT_MS, pattern B after it,
+ *             set in two halves with loop() passes between them, never a
+ *             frame that mixes the two
+ *   fade      channel FADE_CHANNEL from 0 to 255 over FADE_MS from FADE_AT_MS,
+ *             never falling and within one level of the straight line
+ *   blocking  update() never moves the clock, so it never waits
+ *
+ * Prints the first failure of each kind of a failing test.
+ */
+
+#include <unity.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string>
+#include <vector>
+#include "NativeHal.h"
+#include "HardwareSerial.h"
+#include "DmxOutput.h"
+
+#define RUN_MS 3000
+#define COMMIT_MS 500
+#define FADE_AT_MS 1000
+#define FADE_MS 1000
+#define FADE_CHANNEL 1
+#define STALL_US 10000
+#define MIN_BREAK_US 88
+#define MIN_MAB_US 8
+#define MIN_FRAME_HZ 40.0
+
+struct Sent {
+  uint8_t value;
+  uint64_t at;
+  unsigned long baud;
+};
+
+struct Frame {
+  uint64_t breakAt;
+  uint64_t breakUs;
+  uint64_t mabUs;
+  uint64_t maxSlotGapUs;    // idle time between slots, beyond their own bit times
+  std::vector<uint8_t> slots;
+  bool slowSlot = false;    // a slot at the wrong baud rate
+};
+
+static int failures;
+static std::vector<std::string> reported;
+
+static void fail(const char* check, const char* format, ...) {
+  failures++;
+  for (const std::string& seen : reported) {
+    if (seen == check) {
+      return;
+    }
+  }
+  reported.push_back(check);
+  va_list args;
+  va_start(args, format);
+  printf("FAIL %-9s ", check);
+  vprintf(format, args);
+  printf("\n");
+  va_end(args);
+}
+
+static uint8_t patternA(uint16_t channel) { return channel * 7; }
+static uint8_t patternB(uint16_t channel) { return 255 - channel * 3; }
+
+// runs the checks for one loop() timing, the clock carries on from the last run
+static void run(unsigned long passUs, unsigned long stallEvery) {
+  Serial1.flush();    // the last run's bytes are out
+  std::vector<Sent> sent;
+  Serial1.onTransmit([&](uint8_t value, uint64_t at, unsigned long baud) {
+    sent.push_back({value, at, baud});
+  });
+
+  uint64_t base = hal::now();
+  DmxOutput dmx;
+  dmx.begin(Serial1);
+  for (uint16_t channel = 1; channel <= DMX_CHANNELS; channel++) {
+    dmx.set(channel, patternA(channel));
+  }
+  dmx.set(FADE_CHANNEL, 0);
+  dmx.commit();
+
+  // when each pattern was committed and the fade started, virtual us
+  uint64_t commitB = 0;
+  uint64_t fadeAt = 0;
+  bool halfB = false;
+  uint64_t moved = 0;
+  for (unsigned long pass = 0; hal::now() - base < RUN_MS * 1000ULL; pass++) {
+    uint64_t before = hal::now();
+    dmx.update();
+    if (hal::now() != before) {
+      moved = hal::now() - before;
+    }
+
+    uint64_t elapsed = hal::now() - base;
+    if (!halfB && elapsed >= COMMIT_MS * 1000ULL - 5000) {   // a first half well ahead of the commit
+      for (uint16_t channel = 2; channel <= DMX_CHANNELS / 2; channel++) {
+        dmx.set(channel, patternB(channel));
+      }
+      halfB = true;
+    } else if (!commitB && elapsed >= COMMIT_MS * 1000ULL) {
+      for (uint16_t channel = DMX_CHANNELS / 2 + 1; channel <= DMX_CHANNELS; channel++) {
+        dmx.set(channel, patternB(channel));
+      }
+      dmx.commit();
+      commitB = hal::now();
+    }
+    if (!fadeAt && elapsed >= FADE_AT_MS * 1000ULL) {
+      dmx.fade(FADE_CHANNEL, 255, FADE_MS);
+      fadeAt = hal::now();
+    }
+
+    hal::advance(stallEvery && pass % stallEvery == stallEvery - 1 ? STALL_US : passUs);
+  }
+  Serial1.onTransmit(nullptr);
+  if (moved) {
+    fail("blocking", "update() moved the clock by %llu us", (unsigned long long)moved);
+  }
+
+  // cut the capture into frames at the break bytes
+  std::vector<Frame> frames;
+  for (size_t i = 0; i < sent.size(); i++) {
+    const Sent& byte = sent[i];
+    if (byte.baud == DMX_BREAK_BAUD) {
+      if (byte.value != 0) {
+        fail("timing", "break byte %02x at %llu us", byte.value, (unsigned long long)byte.at);
+      }
+      Frame frame;
+      frame.breakAt = byte.at;
+      frame.breakUs = 9 * 1000000ULL / byte.baud;                 // start and data bits are low
+      uint64_t lineHigh = byte.at + frame.breakUs;
+      frame.mabUs = i + 1 < sent.size() ? sent[i + 1].at - lineHigh : 0;
+      frame.maxSlotGapUs = 0;
+      frames.push_back(frame);
+      continue;
+    }
+    if (frames.empty()) {
+      fail("timing", "slot before the first break");
+      continue;
+    }
+    Frame& frame = frames.back();
+    if (byte.baud != DMX_BAUD) {
+      frame.slowSlot = true;
+    }
+    if (!frame.slots.empty()) {
+      uint64_t gap = byte.at - sent[i - 1].at - DMX_BYTE_US;
+      if (gap > frame.maxSlotGapUs) {
+        frame.maxSlotGapUs = gap;
+      }
+    }
+    frame.slots.push_back(byte.value);
+  }
+  if (frames.size() > 1) {
+    frames.pop_back();    // cut off by the end of the run
+  }
+
+  uint64_t minBreak = ~0ULL, minMab = ~0ULL, maxMab = 0, maxGap = 0;
+  unsigned long framesA = 0, framesB = 0, fadeFrames = 0;
+  int lastFade = -1;
+  int worstFadeError = 0;
+  for (const Frame& frame : frames) {
+    minBreak = frame.breakUs < minBreak ? frame.breakUs : minBreak;
+    minMab = frame.mabUs < minMab ? frame.mabUs : minMab;
+    maxMab = frame.mabUs > maxMab ? frame.mabUs : maxMab;
+    maxGap = frame.maxSlotGapUs > maxGap ? frame.maxSlotGapUs : maxGap;
+    if (frame.breakUs < MIN_BREAK_US) {
+      fail("timing", "break of %llu us", (unsigned long long)frame.breakUs);
+    }
+    if (frame.mabUs < MIN_MAB_US) {
+      fail("timing", "mark after break of %llu us", (unsigned long long)frame.mabUs);
+    }
+    if (frame.slowSlot) {
+      fail("timing", "slot not at %d baud in the frame at %llu us", DMX_BAUD, (unsigned long long)frame.breakAt);
+    }
+    if (frame.slots.size() != DMX_CHANNELS + 1 || frame.slots[0] != 0) {
+      fail("timing", "frame at %llu us: %zu slots, start code %02x", (unsigned long long)frame.breakAt,
+           frame.slots.size(), frame.slots.empty() ? 0 : frame.slots[0]);
+      continue;
+    }
+
+    // every channel but the fading one is all A or all B
+    unsigned a = 0, b = 0;
+    for (uint16_t channel = 2; channel <= DMX_CHANNELS; channel++) {
+      a += frame.slots[channel] == patternA(channel);
+      b += frame.slots[channel] == patternB(channel);
+    }
+    if (a == DMX_CHANNELS - 1 && b < DMX_CHANNELS - 1) {
+      framesA++;
+      if (commitB && frame.breakAt > commitB + 2 * 25000) {
+        fail("contents", "frame at %llu us still has pattern A", (unsigned long long)frame.breakAt);
+      }
+    } else if (b == DMX_CHANNELS - 1) {
+      framesB++;
+      if (frame.breakAt < commitB) {
+        fail("contents", "pattern B before the commit, frame at %llu us", (unsigned long long)frame.breakAt);
+      }
+    } else {
+      fail("contents", "frame at %llu us mixes patterns, %u A and %u B channels",
+           (unsigned long long)frame.breakAt, a, b);
+    }
+
+    // the fade, against the line from the fade's start to the frame's
+    int level = frame.slots[FADE_CHANNEL];
+    if (fadeAt && frame.breakAt > fadeAt) {
+      fadeFrames++;
+      double progress = (double)(frame.breakAt - fadeAt) / (FADE_MS * 1000.0);
+      int expected = progress >= 1 ? 255 : (int)(progress * 255 + 0.5);
+      // the frame's levels are set when its break has gone, up to a break and a wait later
+      double slack = (DMX_BREAK_BYTE_US * 2 + passUs + STALL_US * (stallEvery ? 1 : 0)) / (FADE_MS * 1000.0) * 255;
+      int error = level - expected;
+      if (error > 1 + (int)slack || error < -1) {
+        fail("fade", "level %d at %.3f of the fade, expected %d", level, progress, expected);
+      }
+      worstFadeError = abs(error) > abs(worstFadeError) ? error : worstFadeError;
+      if (level < lastFade) {
+        fail("fade", "level fell from %d to %d", lastFade, level);
+      }
+      lastFade = level;
+    } else if (level != 0) {
+      fail("fade", "channel %d at %d before the fade", FADE_CHANNEL, level);
+    }
+  }
+  if (lastFade != 255) {
+    fail("fade", "ended at %d, not 255", lastFade);
+  }
+
+  double seconds = frames.size() > 1 ? (frames.back().breakAt - frames.front().breakAt) / 1e6 : 0;
+  double hz = seconds > 0 ? (frames.size() - 1) / seconds : 0;
+  if (hz < MIN_FRAME_HZ && !stallEvery) {   // stalls longer than a FIFO of slots lower the rate
+    fail("timing", "%.1f frames per second", hz);
+  }
+
+  printf("%zu frames in %.3f s, %.2f Hz, loop pass %lu us", frames.size(), seconds, hz, passUs);
+  if (stallEvery) {
+    printf(", %d us stall every %lu passes", STALL_US, stallEvery);
+  }
+  printf("\nbreak min %llu us, mark after break %llu-%llu us, longest gap between slots %llu us\n",
+         (unsigned long long)minBreak, (unsigned long long)minMab, (unsigned long long)maxMab,
+         (unsigned long long)maxGap);
+  printf("pattern A %lu frames, pattern B %lu frames, fade %lu frames, worst fade error %d levels\n",
+         framesA, framesB, fadeFrames, worstFadeError);
+}
+
+void setUp() {
+  failures = 0;
+  reported.clear();
+}
+
+void tearDown() {
+}
+
+static void test_loop_every_100us() {
+  run(100, 0);
+  TEST_ASSERT_EQUAL(0, failures);
+}
+
+static void test_loop_every_ms() {
+  run(1000, 0);
+  TEST_ASSERT_EQUAL(0, failures);
+}
+
+static void test_loop_with_stalls() {
+  run(100, 100);
+  TEST_ASSERT_EQUAL(0, failures);
+}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(test_loop_every_100us);
+  RUN_TEST(test_loop_every_ms);
+  RUN_TEST(test_loop_with_stalls);
+  return UNITY_END();
+}
@@ -0,0 +1,160 @@
+/*
+ * test_main.cpp
+ * The DFPlayer frames built at compile time are the ones the driver builds
+ * at run time.
+ *
+ * Runs the driver on a Stream that only records what is written to it and
+ * compares, byte for byte:
+ *
+ *   tables    every frame of include/PlayerFrames.h with the frame of the
+ *             driver call PlayerState would otherwise make, and with the
+ *             frame sendFrame() puts on the line
+ *   builder   dfPlayerFrame() with the driver's sendStack() for every command
+ *             0x01 to 0x4F and a spread of parameters, with and without ACK
+ *
+ * Prints the first few differences of a failing test.
+ */
+
+#include <unity.h>
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+#include "NativeHal.h"
+#include "DFRobotDFPlayerMini.h"
+#include "PlayerFrames.h"
+
+#define MAX_REPORTED 8
+
+// a serial line that keeps what the driver writes and never answers
+class Capture : public Stream {
+  public:
+  std::vector<uint8_t> bytes;
+
+  size_t write(uint8_t value) override {
+    bytes.push_back(value);
+    return 1;
+  }
+  size_t write(const uint8_t* buffer, size_t size) override {
+    bytes.insert(bytes.end(), buffer, buffer + size);
+    return size;
+  }
+  int available() override { return 0; }
+  int read() override { return -1; }
+  int peek() override { return -1; }
+};
+
+static Capture line;
+static DFRobotDFPlayerMini player;
+static bool acked;
+static unsigned long checked;
+static unsigned long failures;
+
+static void begin(bool ack) {
+  acked = ack;
+  player.begin(line, ack, false);
+  player.setTimeOut(0);   // nothing answers, the wait for an ACK ends on the next poll()
+  if (ack) {
+    player.enableQueue();
+  } else {
+    player.disableQueue();  // blocking sends, each followed by the frame gap
+  }
+}
+
+// the frame the driver puts on the line for what send() asks for
+template <typename Send>
+static std::vector<uint8_t> sent(Send send) {
+  line.bytes.clear();
+  send();
+  if (acked) {
+    delay(DFPLAYER_FRAME_GAP);
+    player.poll();
+  }
+  return line.bytes;
+}
+
+static void compare(const char* what, unsigned value, const std::vector<uint8_t>& got, const DFPlayerFrame& expected) {
+  checked++;
+  if (got.size() == DFPLAYER_SEND_LENGTH && memcmp(got.data(), expected.bytes, DFPLAYER_SEND_LENGTH) == 0) {
+    return;
+  }
+  if (failures++ < MAX_REPORTED) {
+    printf("%s 0x%X:\n  driver  ", what, value);
+    for (uint8_t byte : got) {
+      printf(" %02X", byte);
+    }
+    printf("\n  built   ");
+    for (uint8_t byte : expected.bytes) {
+      printf(" %02X", byte);
+    }
+    printf("\n");
+  }
+}
+
+// a PROGMEM frame as the driver sends it, and the driver call it stands for
+static void checkTable(const char* what, unsigned value, const DFPlayerFrame* frame, void (*call)(unsigned)) {
+  DFPlayerFrame copy;
+  memcpy_P(&copy, frame, sizeof(copy));
+  compare(what, value, sent([&] { call(value); }), copy);
+  compare(what, value, sent([&] { player.sendFrame(frame); }), copy);
+}
+
+static void checkBuilder() {
+  for (unsigned command = 0x01; command <= 0x4F; command++) {
+    for (unsigned parameter = 0; parameter <= 0xFFFF; parameter += parameter < 0x200 ? 1 : 0xFF) {
+      compare(acked ? "command with ACK" : "command without ACK", command << 16 | parameter,
+              sent([&] { player.query(command, parameter); }), dfPlayerFrame(command, parameter, acked));
+    }
+  }
+}
+
+void setUp() {
+  checked = 0;
+  failures = 0;
+}
+
+void tearDown() {
+}
+
+static void test_tables() {
+  begin(true);
+  checkTable("stop", 0, &stopFrame, [](unsigned) { player.stop(); });
+  checkTable("stopAdvertise", 0, &stopAdvertiseFrame, [](unsigned) { player.stopAdvertise(); });
+  checkTable("reset", 0, &resetFrame, [](unsigned) { player.reset(); });
+  for (unsigned track = 1; track <= PLAYER_FRAME_TRACKS; track++) {
+    checkTable("play", track, &playFrames[track - 1], [](unsigned value) { player.play(value); });
+    checkTable("loop", track, &loopFrames[track - 1], [](unsigned value) { player.loop(value); });
+    checkTable("advertise", track, &advertiseFrames[track - 1], [](unsigned value) { player.advertise(value); });
+  }
+  for (unsigned volume = 0; volume < PLAYER_FRAME_VOLUMES; volume++) {
+    checkTable("volume", volume, &volumeFrames[volume], [](unsigned value) { player.volume(value); });
+  }
+  static const uint8_t queries[] = {0x42, 0x43, 0x44, 0x48};
+  static_assert(sizeof(queries) == sizeof(queryFrames) / sizeof(queryFrames[0]), "a query frame is not checked");
+  for (unsigned i = 0; i < sizeof(queries); i++) {
+    checkTable("query", queries[i], &queryFrames[i], [](unsigned value) { player.query(value); });
+  }
+  TEST_ASSERT_GREATER_THAN(0, checked);
+  TEST_ASSERT_EQUAL_UINT32(0, failures);
+}
+
+static void test_builder_with_ack() {
+  begin(true);
+  checkBuilder();
+  TEST_ASSERT_GREATER_THAN(0, checked);
+  TEST_ASSERT_EQUAL_UINT32(0, failures);
+}
+
+static void test_builder_without_ack() {
+  begin(false);
+  checkBuilder();
+  TEST_ASSERT_GREATER_THAN(0, checked);
+  TEST_ASSERT_EQUAL_UINT32(0, failures);
+}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(test_tables);
+  RUN_TEST(test_builder_with_ack);
+  RUN_TEST(test_builder_without_ack);
+  return UNITY_END();
+}
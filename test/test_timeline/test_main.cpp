@@ -0,0 +1,225 @@
+/*
+ * test_main.cpp
+ * Timeline and RelayScheduler on NativeHal's virtual clock.
+ *
+ * Each show runs with a loop() pass every LOOP_PASS_US and, every
+ * STALL_EVERY passes, a pass stuck for STALL_US as behind a slow task.
+ * Every relay pin change is recorded with its virtual time. The timer sets
+ * the pins, not loop(), so edges must land on their cue times to the
+ * microsecond whatever the passes do.
+ */
+
+#include <unity.h>
+#include <vector>
+#include "NativeHal.h"
+#include "RelayScheduler.h"
+#include "StrobePatterns.h"
+#include "Timeline.h"
+
+#define LOOP_PASS_US 1000
+#define STALL_US 30000
+#define STALL_EVERY 7
+#define START_US 12345          // shows start off the ms grid
+
+#define OUTPUT_SPARK 0x01
+#define OUTPUT_STROBE 0x02
+#define SPARK_PIN D1
+#define STROBE_PIN D6
+
+struct PinEdge {
+  uint8_t pin;
+  uint8_t level;
+  uint64_t at;
+};
+
+static const uint8_t relayPins[] = {SPARK_PIN, STROBE_PIN};
+static StrobePatterns patterns;
+static RelayScheduler relays(relayPins, sizeof(relayPins));
+static std::vector<PinEdge> edges;
+static uint64_t trackEndsAt;    // virtual us the awaited track finishes
+
+static void record(uint8_t pin, uint8_t level, uint64_t at) {
+  edges.push_back({pin, level, at});
+}
+
+static bool soundFinished(uint16_t) {
+  return hal::now() >= trackEndsAt;
+}
+
+// loop() passes for ms of virtual time, returns when cue was applied
+static uint64_t run(Timeline& timeline, unsigned long ms, int cue = -1) {
+  uint64_t end = hal::now() + ms * 1000ULL;
+  uint64_t appliedAt = 0;
+  for (unsigned long pass = 0; hal::now() < end; pass++) {
+    int applied = timeline.update(micros());
+    if (!appliedAt && cue >= 0 && applied >= cue) {
+      appliedAt = hal::now();
+    }
+    hal::advance(pass % STALL_EVERY == STALL_EVERY - 1 ? STALL_US : LOOP_PASS_US);
+  }
+  return appliedAt;
+}
+
+static void assertEdge(size_t index, uint8_t pin, uint8_t level, uint64_t at) {
+  TEST_ASSERT_GREATER_THAN(index, edges.size());
+  TEST_ASSERT_EQUAL_UINT8_MESSAGE(pin, edges[index].pin, "pin");
+  TEST_ASSERT_EQUAL_UINT8_MESSAGE(level, edges[index].level, "level");
+  TEST_ASSERT_EQUAL_UINT64_MESSAGE(at, edges[index].at, "time");
+}
+
+void setUp() {
+  hal::reset();
+  pinMode(SPARK_PIN, OUTPUT);
+  pinMode(STROBE_PIN, OUTPUT);
+  patterns.begin();
+  relays.begin(patterns);
+  hal::onPinChange(record);
+  hal::advance(START_US);
+  edges.clear();
+  trackEndsAt = ~0ULL;
+}
+
+void tearDown() {
+  relays.cancel();
+  relays.write(0);
+  hal::onPinChange(nullptr);
+}
+
+// more cues than the lookahead, further apart than the horizon and closer
+// together than a stall
+static constexpr Cue steadyShow[] PROGMEM = {
+  {0,    0,                            PATTERN_STEADY, CUE_SOUND_NONE, 0},
+  {500,  OUTPUT_SPARK,                 PATTERN_STEADY, CUE_SOUND_NONE, 0},
+  {1500, OUTPUT_SPARK | OUTPUT_STROBE, PATTERN_STEADY, CUE_SOUND_NONE, 0},
+  {1750, OUTPUT_STROBE,                PATTERN_STEADY, CUE_SOUND_NONE, 0},
+  {3000, 0,                            PATTERN_STEADY, CUE_SOUND_NONE, 0},
+  {3010, OUTPUT_SPARK,                 PATTERN_STEADY, CUE_SOUND_NONE, 0},
+  {4000, 0,                            PATTERN_STEADY, CUE_SOUND_NONE, 0}
+};
+
+static void test_edges_on_cue_times() {
+  ProgmemCues cues(steadyShow, sizeof(steadyShow) / sizeof(steadyShow[0]));
+  Timeline timeline(relays, nullptr);
+  timeline.begin(&cues);
+  uint64_t start = hal::now();
+  timeline.start(start);
+  run(timeline, 4500);
+
+  TEST_ASSERT_TRUE(timeline.finished());
+  TEST_ASSERT_EQUAL(6, edges.size());
+  assertEdge(0, SPARK_PIN, HIGH, start + 500000);
+  assertEdge(1, STROBE_PIN, HIGH, start + 1500000);
+  assertEdge(2, SPARK_PIN, LOW, start + 1750000);
+  assertEdge(3, STROBE_PIN, LOW, start + 3000000);
+  assertEdge(4, SPARK_PIN, HIGH, start + 3010000);
+  assertEdge(5, SPARK_PIN, LOW, start + 4000000);
+}
+
+static constexpr Cue awaitShow[] PROGMEM = {
+  {0,    OUTPUT_SPARK,  PATTERN_STEADY, CUE_SOUND_PLAY,  1},
+  {2000, OUTPUT_SPARK,  PATTERN_STEADY, CUE_SOUND_AWAIT, 1},
+  {2500, OUTPUT_STROBE, PATTERN_STEADY, CUE_SOUND_NONE,  0},
+  {3000, 0,             PATTERN_STEADY, CUE_SOUND_NONE,  0}
+};
+
+// the track ends early, the cues after the await move up with it
+static void test_await_moves_later_edges() {
+  ProgmemCues cues(awaitShow, sizeof(awaitShow) / sizeof(awaitShow[0]));
+  Timeline timeline(relays, nullptr, soundFinished);
+  timeline.begin(&cues);
+  uint64_t start = hal::now();
+  trackEndsAt = start + 1200000;
+  timeline.start(start);
+  uint64_t firedAt = run(timeline, 3000, 1);
+
+  TEST_ASSERT_GREATER_OR_EQUAL(trackEndsAt, firedAt);
+  TEST_ASSERT_LESS_OR_EQUAL(trackEndsAt + STALL_US, firedAt);
+  TEST_ASSERT_EQUAL(4, edges.size());
+  assertEdge(0, SPARK_PIN, HIGH, start);
+  assertEdge(1, SPARK_PIN, LOW, firedAt + 500000);
+  assertEdge(2, STROBE_PIN, HIGH, firedAt + 500000);
+  assertEdge(3, STROBE_PIN, LOW, firedAt + 1000000);
+}
+
+// the track runs over, the await times out and nothing moves
+static void test_await_timeout_keeps_edges() {
+  ProgmemCues cues(awaitShow, sizeof(awaitShow) / sizeof(awaitShow[0]));
+  Timeline timeline(relays, nullptr, soundFinished);
+  timeline.begin(&cues);
+  uint64_t start = hal::now();
+  timeline.start(start);
+  run(timeline, 3500);
+
+  TEST_ASSERT_EQUAL(4, edges.size());
+  assertEdge(1, SPARK_PIN, LOW, start + 2500000);
+  assertEdge(2, STROBE_PIN, HIGH, start + 2500000);
+  assertEdge(3, STROBE_PIN, LOW, start + 3000000);
+}
+
+// each distinct cue time starts a scene, an await that fires early starts
+// its scene early; start() at a scene counts from there
+static void test_scene_time() {
+  ProgmemCues cues(awaitShow, sizeof(awaitShow) / sizeof(awaitShow[0]));
+  Timeline timeline(relays, nullptr, soundFinished);
+  timeline.begin(&cues);
+  uint64_t start = hal::now();
+  trackEndsAt = start + 1200000;
+  timeline.start(start);
+  run(timeline, 500);
+  TEST_ASSERT_EQUAL_UINT8(0, timeline.scene());
+  TEST_ASSERT_EQUAL_UINT32((hal::now() - start) / 1000, timeline.sceneElapsed(micros()));
+
+  uint64_t firedAt = run(timeline, 1000, 1);
+  TEST_ASSERT_EQUAL_UINT8(1, timeline.scene());
+  TEST_ASSERT_EQUAL_UINT32((hal::now() - firedAt) / 1000, timeline.sceneElapsed(micros()));
+
+  uint64_t restart = hal::now();
+  timeline.start(restart, 2);
+  run(timeline, 200);
+  TEST_ASSERT_EQUAL_UINT8(2, timeline.scene());
+  TEST_ASSERT_EQUAL_UINT32((hal::now() - restart) / 1000, timeline.sceneElapsed(micros()));
+}
+
+static constexpr Cue flashShow[] PROGMEM = {
+  {0,    OUTPUT_SPARK, PATTERN_FLASH_SLOW, CUE_SOUND_NONE, 0},
+  {1000, 0,            PATTERN_STEADY,     CUE_SOUND_NONE, 0}
+};
+
+// PATTERN_FLASH_SLOW is 250 ms on, 250 ms off, clocked by the timer
+static void test_pattern_edges() {
+  ProgmemCues cues(flashShow, sizeof(flashShow) / sizeof(flashShow[0]));
+  Timeline timeline(relays, nullptr);
+  timeline.begin(&cues);
+  uint64_t start = hal::now();
+  timeline.start(start);
+  run(timeline, 1500);
+
+  TEST_ASSERT_EQUAL(4, edges.size());
+  assertEdge(0, SPARK_PIN, HIGH, start);
+  assertEdge(1, SPARK_PIN, LOW, start + 250000);
+  assertEdge(2, SPARK_PIN, HIGH, start + 500000);
+  assertEdge(3, SPARK_PIN, LOW, start + 750000);
+}
+
+// an edge due while a bit-banged byte holds interrupts off fires as soon
+// as they are back on
+static void test_masked_edge_fires_late() {
+  uint64_t start = hal::now();
+  relays.schedule(start + 500, OUTPUT_STROBE);
+  hal::advance(400);
+  hal::advanceMasked(1040);
+
+  TEST_ASSERT_EQUAL(1, edges.size());
+  assertEdge(0, STROBE_PIN, HIGH, start + 1440);
+}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(test_edges_on_cue_times);
+  RUN_TEST(test_await_moves_later_edges);
+  RUN_TEST(test_await_timeout_keeps_edges);
+  RUN_TEST(test_scene_time);
+  RUN_TEST(test_pattern_edges);
+  RUN_TEST(test_masked_edge_fires_late);
+  return UNITY_END();
+}
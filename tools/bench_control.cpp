@@ -0,0 +1,197 @@
+/*
+ * bench_control.cpp
+ * Host benchmark of the controller's command forms, text against binary.
+ *
+ * build: g++ -O2 -std=gnu++11 -Iinclude -Ilib/NativeHal/src
+ *          tools/bench_control.cpp src/ControlProtocol.cpp -o bench_control
+ * run:   ./bench_control [seconds of joystick drag, default 10]
+ *
+ * Replays a joystick drag with input events at EVENT_HZ and ui.js frames at
+ * FRAME_HZ and encodes it both ways:
+ *
+ *   text    the old controller.js form, two key=value messages per event
+ *           ("leftMotorSpeed=...", "rightMotorSpeed=..."), joined per frame
+ *           with ";", decoded the way such messages usually are on the
+ *           ESP8266, with String indexOf()/substring()/toInt(). HeapString
+ *           stands in for Arduino's String, which allocates for every copy.
+ *   binary  8 byte records, the latest joystick value per frame, decoded by
+ *           BinaryControlParser.
+ *
+ * Prints WebSocket messages, commands and bytes per second of drag, decode
+ * time per frame on this host and heap allocations per frame.
+ */
+
+#include <chrono>
+#include <new>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string>
+#include <vector>
+#include "ControlProtocol.h"
+
+#define EVENT_HZ 120
+#define FRAME_HZ 30     // FRAME_RATE in ui.js
+#define DECODE_ROUNDS 200
+
+static unsigned long allocations = 0;
+
+void* operator new(size_t size) {
+  allocations++;
+  void* block = malloc(size ? size : 1);
+  if (!block) {
+    throw std::bad_alloc();
+  }
+  return block;
+}
+
+void operator delete(void* block) noexcept {
+  free(block);
+}
+
+void operator delete(void* block, size_t) noexcept {
+  free(block);
+}
+
+// allocates on every copy, like Arduino's String
+class HeapString {
+  char* _text;
+  size_t _length;
+
+  public:
+  HeapString(const char* text, size_t length) : _text(new char[length + 1]), _length(length) {
+    memcpy(_text, text, length);
+    _text[length] = '\0';
+  }
+  HeapString(const HeapString& other) : HeapString(other._text, other._length) {}
+  ~HeapString() { delete[] _text; }
+  HeapString& operator=(const HeapString&) = delete;
+
+  int indexOf(char c, size_t from = 0) const {
+    const char* found = from < _length ? (const char*)memchr(_text + from, c, _length - from) : nullptr;
+    return found ? (int)(found - _text) : -1;
+  }
+  HeapString substring(size_t from, size_t to) const { return HeapString(_text + from, to - from); }
+  HeapString substring(size_t from) const { return substring(from, _length); }
+  long toInt() const { return atol(_text); }
+  bool operator==(const char* text) const { return strcmp(_text, text) == 0; }
+  size_t length() const { return _length; }
+};
+
+struct Sample {
+  int16_t x;
+  int16_t y;
+};
+
+struct Result {
+  unsigned long messages = 0;
+  unsigned long commands = 0;
+  unsigned long bytes = 0;
+  double decodeNs = 0;        // per frame
+  double allocations = 0;     // per frame
+};
+
+static long checksum = 0;     // keeps the decoders from being optimized away
+
+static void decodeText(const std::string& frame) {
+  HeapString message(frame.data(), frame.size());
+  size_t start = 0;
+  int end;
+  while ((end = message.indexOf(';', start)) >= 0) {
+    HeapString command = message.substring(start, end);
+    int equals = command.indexOf('=');
+    if (equals > 0) {
+      HeapString key = command.substring(0, equals);
+      HeapString value = command.substring(equals + 1);
+      if (key == "leftMotorSpeed" || key == "rightMotorSpeed") {
+        checksum += value.toInt();
+      }
+    }
+    start = end + 1;
+  }
+}
+
+static void decodeBinary(const std::vector<uint8_t>& frame) {
+  BinaryControlParser parser(frame.data(), frame.size());
+  ControlCommand command;
+  while (parser.next(command)) {
+    checksum += command.x + command.y;
+  }
+}
+
+template <class Frame, class Decode>
+static void measure(const std::vector<Frame>& frames, Decode decode, Result& result) {
+  unsigned long before = allocations;
+  auto start = std::chrono::steady_clock::now();
+  for (int round = 0; round < DECODE_ROUNDS; round++) {
+    for (const Frame& frame : frames) {
+      decode(frame);
+    }
+  }
+  double ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+  double decoded = (double)DECODE_ROUNDS * frames.size();
+  result.decodeNs = ns / decoded;
+  result.allocations = (allocations - before) / decoded;
+}
+
+static void report(const char* form, const Result& result, unsigned seconds) {
+  printf("%-7s %10.1f %10.1f %10.1f %12.1f %12.2f\n", form,
+         (double)result.messages / seconds, (double)result.commands / seconds,
+         (double)result.bytes / seconds, result.decodeNs, result.allocations);
+}
+
+int main(int argc, char** argv) {
+  unsigned seconds = argc > 1 ? strtoul(argv[1], nullptr, 10) : 10;
+  if (!seconds) {
+    fprintf(stderr, "usage: %s [seconds]\n", argv[0]);
+    return 2;
+  }
+
+  // a joystick moved in circles, as ui.js sees it
+  std::vector<std::vector<Sample>> samples(seconds * FRAME_HZ);
+  for (unsigned i = 0; i < seconds * EVENT_HZ; i++) {
+    double angle = i * 0.05;
+    Sample sample = {(int16_t)(cos(angle) * CONTROL_JOYSTICK_MAX), (int16_t)(sin(angle) * CONTROL_JOYSTICK_MAX)};
+    samples[i * FRAME_HZ / EVENT_HZ].push_back(sample);
+  }
+
+  std::vector<std::string> textFrames;
+  std::vector<std::vector<uint8_t>> binaryFrames;
+  Result text;
+  Result binary;
+  uint16_t sequence = 0;
+  for (const std::vector<Sample>& frame : samples) {
+    if (frame.empty()) {
+      continue;
+    }
+    std::string joined;
+    for (const Sample& sample : frame) {
+      char message[64];
+      snprintf(message, sizeof(message), "leftMotorSpeed=%d;rightMotorSpeed=%d;", sample.x * 2, sample.y * 2);
+      joined += message;
+      text.commands += 2;
+    }
+    textFrames.push_back(joined);
+    text.messages++;
+    text.bytes += joined.size();
+
+    const Sample& latest = frame.back();   // coalesced to one record per frame
+    sequence = sequence % 0xFFFF + 1;
+    uint8_t record[CONTROL_RECORD_SIZE] = {
+      CONTROL_JOYSTICK, 0, (uint8_t)sequence, (uint8_t)(sequence >> 8),
+      (uint8_t)latest.x, (uint8_t)(latest.x >> 8), (uint8_t)latest.y, (uint8_t)(latest.y >> 8)
+    };
+    binaryFrames.push_back(std::vector<uint8_t>(record, record + sizeof(record)));
+    binary.messages++;
+    binary.commands++;
+    binary.bytes += sizeof(record);
+  }
+
+  measure(textFrames, decodeText, text);
+  measure(binaryFrames, decodeBinary, binary);
+
+  printf("%u s joystick drag, %d Hz events, %d Hz frames\n", seconds, EVENT_HZ, FRAME_HZ);
+  printf("%-7s %10s %10s %10s %12s %12s\n", "form", "msgs/s", "cmds/s", "bytes/s", "ns/frame", "allocs/frame");
+  report("text", text, seconds);
+  report("binary", binary, seconds);
+  return checksum == 0x7FFFFFFF;   // never, but the compiler cannot know
+}
@@ -0,0 +1,106 @@
+/*
+ * bench_envelope.cpp
+ * Host benchmark and accuracy check of the fixed-point Envelope curves.
+ *
+ * build: g++ -O2 -std=gnu++11 -Iinclude -Ilib/NativeHal/src
+ *          tools/bench_envelope.cpp src/Envelope.cpp -o bench_envelope
+ * run:   ./bench_envelope [ramp ms, default 2000]
+ *
+ * For each curve, runs a 0 to 255 ramp (a DMX fade) and a 5 to 30 ramp (a
+ * DFPlayer volume ramp) sampled every 100 us and compares every value with
+ * the curve worked out in floating point from the same time. Then times
+ * value() on DMX_FADES envelopes at once, what DmxOutput does per frame.
+ *
+ * Prints, per curve, the worst error in levels of each ramp, whether it
+ * ever went backwards, and ns per value() on this host. On the ESP8266 the
+ * same work shows up in the profiler's fades and ramps sections.
+ */
+
+#include <chrono>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "Envelope.h"
+
+#define SAMPLE_US 100
+#define BENCH_ROUNDS 200000
+#define DMX_FADES 16      // DmxOutput.h
+
+static const char* curveNames[CURVE_COUNT] = {"linear", "exponential", "ease"};
+
+static double shape(uint8_t curve, double x) {
+  switch (curve) {
+    case CURVE_EXPONENTIAL:
+      return (pow(2, 6 * x) - 1) / 63;
+    case CURVE_EASE_IN_OUT:
+      return x * x * (3 - 2 * x);
+    default:
+      return x;
+  }
+}
+
+struct Accuracy {
+  double worst = 0;     // levels
+  bool backwards = false;
+};
+
+static Accuracy check(uint8_t curve, int16_t from, int16_t to, unsigned long ms) {
+  Accuracy result;
+  Envelope envelope;
+  envelope.start(from, to, ms, curve, 0);
+  int16_t last = from;
+  for (unsigned long now = 0; now <= ms * 1000 + SAMPLE_US; now += SAMPLE_US) {
+    int16_t level = envelope.value(now);
+    // the envelope counts whole ticks, compare at the tick it used
+    double ticks = (double)(now >> ENVELOPE_TICK_SHIFT) / ((ms * 1000) >> ENVELOPE_TICK_SHIFT);
+    double expected = ticks >= 1 ? to : from + (to - from) * shape(curve, ticks);
+    result.worst = fmax(result.worst, fabs(level - expected));
+    if ((to > from && level < last) || (to < from && level > last)) {
+      result.backwards = true;
+    }
+    last = level;
+  }
+  if (last != to) {
+    result.backwards = true;
+  }
+  return result;
+}
+
+int main(int argc, char** argv) {
+  unsigned long ms = argc > 1 ? strtoul(argv[1], nullptr, 10) : 2000;
+  if (!ms) {
+    fprintf(stderr, "usage: %s [ramp ms]\n", argv[0]);
+    return 2;
+  }
+
+  printf("%lu ms ramps sampled every %d us, %d envelopes timed together\n", ms, SAMPLE_US, DMX_FADES);
+  printf("%-12s %12s %12s %10s %10s\n", "curve", "dmx error", "volume error", "monotonic", "ns/value");
+  long checksum = 0;    // keeps the timed loop from being optimized away
+  bool failed = false;
+  for (uint8_t curve = 0; curve < CURVE_COUNT; curve++) {
+    Accuracy dmx = check(curve, 0, 255, ms);
+    Accuracy volume = check(curve, 5, 30, ms);
+
+    Envelope envelopes[DMX_FADES];
+    auto start = std::chrono::steady_clock::now();
+    for (unsigned long round = 0; round < BENCH_ROUNDS; round++) {
+      unsigned long now = round * 7 % (ms * 1000);
+      if (round % 1000 == 0) {
+        for (int i = 0; i < DMX_FADES; i++) {
+          envelopes[i].start(i, 255 - i, ms, curve, 0);
+        }
+      }
+      for (int i = 0; i < DMX_FADES; i++) {
+        checksum += envelopes[i].value(now);
+      }
+    }
+    double ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+
+    bool monotonic = !dmx.backwards && !volume.backwards;
+    failed |= !monotonic || dmx.worst > 1 || volume.worst > 1;
+    printf("%-12s %12.2f %12.2f %10s %10.1f\n", curveNames[curve], dmx.worst, volume.worst,
+           monotonic ? "yes" : "NO", ns / ((double)BENCH_ROUNDS * DMX_FADES));
+  }
+  printf(failed ? "an envelope is off by more than a level or went backwards\n" : "all envelopes within a level\n");
+  return failed || checksum == 0x7FFFFFFF ? 1 : 0;
+}
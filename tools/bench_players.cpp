@@ -0,0 +1,180 @@
+/*
+ * bench_players.cpp
+ * Host benchmark of PlayerBus: several DFPlayers on SoftwareSerial links,
+ * each answered by NativeHal's DFPlayer emulator.
+ *
+ * build: g++ -O2 -std=gnu++11 -DUNIT_TEST -Iinclude -Ilib/NativeHal/src -Ilib/DFRobotDFPlayerMini-1.0.3
+ *          tools/bench_players.cpp src/PlayerBus.cpp src/PlayerState.cpp src/PlaybackTracker.cpp
+ *          src/Envelope.cpp lib/DFRobotDFPlayerMini-1.0.3/DFRobotDFPlayerMini.cpp
+ *          lib/NativeHal/src/NativeHal.cpp lib/NativeHal/src/SimStream.cpp lib/NativeHal/src/Print.cpp
+ *          lib/NativeHal/src/DFPlayerEmulator.cpp -o bench_players
+ * run:   ./bench_players [channels 1 to 3, default 3] [run ms, default 20000]
+ *
+ * Brings every player online, then for the run time, on a loop() pass
+ * every LOOP_US of virtual time:
+ *
+ *   load    keeps every channel's queue busy with volume changes, the
+ *           worst case for sharing the CPU between the links
+ *   groups  every GROUP_MS starts a track on all channels at once with
+ *           hold(), on top of the load; every other group one channel gets
+ *           a volume it already has instead, which PlayerState skips, so
+ *           the others must start without it
+ *
+ * Prints frames per second per channel and in total, how evenly the
+ * channels shared the link time, the longest pass, and the skew of the
+ * group starts both as the bus measured it and as the emulators saw the
+ * tracks start, against the bus's skewBoundUs().
+ * Exits 1 if a group start was skewed by more than the bound.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "NativeHal.h"
+#include "SoftwareSerial.h"
+#include "DFPlayerEmulator.h"
+#include "PlayerBus.h"
+
+#define LOOP_US 100
+#define BOOT_MS 2000
+#define GROUP_MS 500
+#define LOAD_QUEUED 2       // volume frames kept waiting per channel
+
+SoftwareSerial links[PLAYER_BUS_CHANNELS] = {{1, 2}, {3, 4}, {5, 6}};
+DFPlayerEmulator emulators[PLAYER_BUS_CHANNELS];
+DFRobotDFPlayerMini drivers[PLAYER_BUS_CHANNELS];
+PlayerState players[PLAYER_BUS_CHANNELS] = {{drivers[0]}, {drivers[1]}, {drivers[2]}};
+PlayerBus bus;
+static const char* names[PLAYER_BUS_CHANNELS] = {"machine", "monster", "crowd"};
+
+int main(int argc, char** argv) {
+  uint8_t channels = argc > 1 ? atoi(argv[1]) : PLAYER_BUS_CHANNELS;
+  unsigned long runMs = argc > 2 ? strtoul(argv[2], nullptr, 10) : 20000;
+  if (channels < 1 || channels > PLAYER_BUS_CHANNELS || !runMs) {
+    fprintf(stderr, "usage: %s [channels 1 to %d] [run ms]\n", argv[0], PLAYER_BUS_CHANNELS);
+    return 2;
+  }
+
+  DFPlayerEmulator::Settings settings;
+  for (uint8_t i = 0; i < channels; i++) {
+    links[i].begin(9600);
+    settings.seed = i + 1;
+    emulators[i].attach(links[i], settings);
+    drivers[i].begin(links[i], true, false);
+    drivers[i].enableQueue();
+    players[i].begin();
+    bus.add(names[i], drivers[i], players[i]);
+  }
+
+  uint64_t runUs = (BOOT_MS + runMs) * 1000ULL;
+  uint64_t measureAt = BOOT_MS * 1000ULL;
+  uint64_t nextGroupAt = measureAt;
+  uint64_t maxPassUs = 0;
+  uint64_t startedAt[PLAYER_BUS_CHANNELS] = {0};
+  uint16_t lastTrack[PLAYER_BUS_CHANNELS] = {0};
+  uint8_t waiting = 0;      // bit n = channel n has not started the group's track yet
+  uint8_t members = 0;
+  unsigned long groupsStarted = 0;
+  uint16_t track = 1;
+  uint8_t volume[PLAYER_BUS_CHANNELS] = {0};
+  unsigned long groups = 0;
+  uint64_t maxSkewUs = 0;
+  unsigned long framesAtStart[PLAYER_BUS_CHANNELS] = {0};
+  bool measuring = false;
+
+  while (hal::now() < runUs) {
+    uint64_t passAt = hal::now();
+    if (!measuring && passAt >= measureAt) {
+      measuring = true;
+      bus.resetStats();
+      for (uint8_t i = 0; i < channels; i++) {
+        framesAtStart[i] = drivers[i].framesSent();
+        if (!players[i].ready()) {
+          fprintf(stderr, "%s player not online after %d ms\n", names[i], BOOT_MS);
+          return 1;
+        }
+      }
+    }
+    if (measuring) {
+      for (uint8_t i = 0; i < channels; i++) {
+        while (drivers[i].queued() < LOAD_QUEUED) {
+          volume[i] = volume[i] == 10 ? 11 : 10;
+          players[i].volume(volume[i]);
+        }
+      }
+      if (passAt >= nextGroupAt && !waiting) {
+        nextGroupAt += GROUP_MS * 1000ULL;
+        track = track % 3 + 1;
+        uint8_t skipped = channels > 1 && groupsStarted % 2 ? groupsStarted / 2 % channels : PLAYER_BUS_NONE;
+        groupsStarted++;
+        bus.hold((1 << channels) - 1);
+        for (uint8_t i = 0; i < channels; i++) {
+          if (i == skipped) {
+            players[i].volume(players[i].volume());   // not sent, the channel stays out of the group
+          } else {
+            players[i].play(track);
+            waiting |= 1 << i;
+          }
+        }
+        members = channels - (skipped != PLAYER_BUS_NONE);
+      }
+    }
+
+    bus.receive(millis());
+    bus.transmit();
+    for (uint8_t i = 0; i < channels; i++) {
+      emulators[i].update();
+      if (emulators[i].track() != lastTrack[i]) {
+        lastTrack[i] = emulators[i].track();
+        if ((waiting & (1 << i)) && lastTrack[i] == track) {
+          startedAt[i] = emulators[i].stats().lastFrameAt;    // the play frame, the only one of the pass
+          waiting &= ~(1 << i);
+          if (!waiting && members > 1) {
+            uint64_t first = ~0ULL;
+            uint64_t last = 0;
+            for (uint8_t j = 0; j < channels; j++) {
+              if (startedAt[j]) {
+                first = startedAt[j] < first ? startedAt[j] : first;
+                last = startedAt[j] > last ? startedAt[j] : last;
+              }
+              startedAt[j] = 0;
+            }
+            maxSkewUs = last - first > maxSkewUs ? last - first : maxSkewUs;
+            groups++;
+          }
+        }
+      }
+    }
+    if (measuring && hal::now() - passAt > maxPassUs) {
+      maxPassUs = hal::now() - passAt;
+    }
+    hal::advance(LOOP_US);
+  }
+
+  printf("%u channels, %lu ms, a pass every %d us, %d volume frames kept queued per channel\n", channels, runMs,
+         LOOP_US, LOAD_QUEUED);
+  unsigned long total = 0;
+  unsigned long fewest = ~0UL;
+  unsigned long most = 0;
+  for (uint8_t i = 0; i < channels; i++) {
+    unsigned long frames = drivers[i].framesSent() - framesAtStart[i];
+    total += frames;
+    fewest = frames < fewest ? frames : fewest;
+    most = frames > most ? frames : most;
+    printf("  %-8s %6lu frames %6.1f frames/s, ack %lu us, timeouts %lu\n", names[i], frames, frames * 1000.0 / runMs,
+           drivers[i].ackLatency(), drivers[i].timeOutCount());
+  }
+  uint32_t bound = bus.skewBoundUs();
+  printf("  total    %6lu frames %6.1f frames/s, share %.2f (fewest / most), longest pass %lu us\n", total,
+         total * 1000.0 / runMs, most ? (double)fewest / most : 0.0, (unsigned long)maxPassUs);
+  printf("  groups %lu of %lu started, skew at the bus max %lu us, at the players max %lu us, bound %lu us\n",
+         groups, groupsStarted, (unsigned long)bus.maxSkewUs(), (unsigned long)maxSkewUs, (unsigned long)bound);
+  // every group but the last may still be under way, and with 2 channels the
+  // ones with a channel skipped are no group
+  unsigned long expected = channels == 2 ? (groupsStarted + 1) / 2 : channels > 2 ? groupsStarted : 0;
+  bool stalled = groupsStarted < runMs / GROUP_MS;   // a group never started on all its channels
+  bool failed = bus.maxSkewUs() > bound || maxSkewUs > bound || groups + 1 < expected || bus.groups() != groups ||
+                stalled;
+  printf(stalled ? "a group stalled\n" : failed ? "a group start was skewed past the bound or lost\n"
+                                              : "all group starts within the bound\n");
+  return failed ? 1 : 0;
+}
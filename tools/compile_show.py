@@ -0,0 +1,241 @@
+#!/usr/bin/env python3
+"""
+Compiles a text show script into the binary cue file read by ShowFile.
+
+usage: python tools/compile_show.py shows/default.show data/show.bin
+
+Stage data/ with tools/gzip_data.py, then upload with "pio run -t uploadfs".
+The firmware falls back to its built-in show if the file is missing or
+fails validation.
+
+Script format, one cue per line, "#" starts a comment:
+
+    <time> <relays>[@<pattern>] [<sound> [<argument>]]
+
+    time      ms from the start of the show, "+" prefix for relative to the
+              previous cue, "s" suffix for seconds (6000, +2s, 1.5s)
+    relays    comma separated relays that are on, "-" for all off
+    pattern   flash pattern for the relays that are on, default steady
+    sound     none | play <track> | loop <track> | stop | volume <0-30>
+              | ramp <0-30> <time>, moves the volume there over the time,
+              up to 25.5s in 0.1s steps (1500, 2s)
+              | await <track>, waits for the track to finish; the cue's time
+              is the timeout and later cues move up if the track ends early
+              | look <n>, fades the DMX lights to look n of dmxLooks in
+              src/main.cpp (DMX_OUTPUT builds)
+              | effect <n>, inserts effect n of soundEffects in src/main.cpp
+              over the playing track
+              | random <folder>, plays a file of SD card folder 1 to 15 at
+              random, a different one each time until all have played
+              | channels <names>, comma separated DFPlayers the sound
+              actions of later cues go to (MULTI_PLAYER builds); several
+              start their sounds together
+
+Binary format (little endian), must match include/ShowFile.h:
+
+    header    uint32 magic "FSHW", uint8 version, uint8 cue size,
+              uint16 cue count, uint32 CRC-32 of the cue records
+    cue       uint16 at (ms), uint8 outputs, uint8 pattern, uint8 sound,
+              uint16 argument
+"""
+
+import struct
+import sys
+import zlib
+
+SHOW_FILE_MAGIC = 0x57485346
+SHOW_FILE_VERSION = 2
+HEADER_FORMAT = '<IBBHI'
+CUE_FORMAT = '<HBBBH'
+
+# bit n drives relayPins[n] in src/main.cpp
+RELAYS = {
+    'spark': 0x01,
+    'strobe': 0x02,
+}
+
+# strobePattern in include/StrobePatterns.h
+PATTERNS = {
+    'steady': 0,
+    'flash_slow': 1,
+    'flash_fast': 2,
+    'thrash': 3,
+    'ramp': 4,
+}
+
+# cueSound in include/Timeline.h, with the argument each action needs
+SOUNDS = {
+    'none': (0, None),
+    'play': (1, (1, 0xFFFF)),
+    'loop': (2, (1, 0xFFFF)),
+    'stop': (3, None),
+    'volume': (4, (0, 30)),
+    'await': (5, (1, 0xFFFF)),
+    'look': (6, (0, 0xFF)),
+    'ramp': (7, (0, 30)),
+    'effect': (8, (0, 0xFF)),
+    'random': (9, (1, 15)),
+    'channels': (10, (1, 0x07)),
+}
+
+# bit n is DFPlayer channel n, CHANNEL_* in src/main.cpp
+CHANNELS = {
+    'machine': 0x01,
+    'monster': 0x02,
+    'crowd': 0x04,
+}
+
+RAMP_STEP_MS = 100    # CUE_RAMP_STEP_MS in include/Timeline.h
+
+# sound actions that queue a DFPlayer frame, cueFrames() in include/Timeline.h,
+# and how many of them one time may hold, PLAYER_CUE_FRAMES in
+# include/PlayerState.h
+FRAME_SOUNDS = (1, 2, 3, 4, 7, 8, 9)
+CUE_FRAMES = 6
+
+
+class ShowError(Exception):
+    pass
+
+
+def parse_time(token, previous):
+    relative = token.startswith('+')
+    if relative:
+        token = token[1:]
+    try:
+        if token.endswith('s'):
+            ms = round(float(token[:-1]) * 1000)
+        else:
+            ms = int(token)
+    except ValueError:
+        raise ShowError('bad time "%s"' % token)
+    at = previous + ms if relative else ms
+    if at < previous:
+        raise ShowError('cue at %d ms is before the previous cue at %d ms' % (at, previous))
+    if at > 0xFFFF:
+        raise ShowError('cue at %d ms is past the 65535 ms limit' % at)
+    return at
+
+
+def parse_relays(token):
+    token, _, pattern = token.partition('@')
+    pattern = pattern or 'steady'
+    if pattern not in PATTERNS:
+        raise ShowError('unknown pattern "%s"' % pattern)
+    if token == '-':
+        return 0, PATTERNS[pattern]
+    outputs = 0
+    for name in token.split(','):
+        if name not in RELAYS:
+            raise ShowError('unknown relay "%s"' % name)
+        outputs |= RELAYS[name]
+    return outputs, PATTERNS[pattern]
+
+
+def parse_sound(tokens):
+    if not tokens:
+        return 0, 0
+    name = tokens[0]
+    if name not in SOUNDS:
+        raise ShowError('unknown sound action "%s"' % name)
+    sound, limits = SOUNDS[name]
+    if limits is None:
+        if len(tokens) > 1:
+            raise ShowError('"%s" takes no argument' % name)
+        return sound, 0
+    if name == 'ramp':
+        return parse_ramp(sound, limits, tokens)
+    if name == 'channels':
+        return parse_channels(sound, tokens)
+    if len(tokens) != 2:
+        raise ShowError('"%s" needs one argument' % name)
+    try:
+        argument = int(tokens[1])
+    except ValueError:
+        raise ShowError('bad argument "%s"' % tokens[1])
+    if not limits[0] <= argument <= limits[1]:
+        raise ShowError('"%s" argument must be %d to %d' % (name, limits[0], limits[1]))
+    return sound, argument
+
+
+def parse_ramp(sound, limits, tokens):
+    if len(tokens) != 3:
+        raise ShowError('"ramp" needs a volume and a time')
+    try:
+        volume = int(tokens[1])
+    except ValueError:
+        raise ShowError('bad volume "%s"' % tokens[1])
+    if not limits[0] <= volume <= limits[1]:
+        raise ShowError('"ramp" volume must be %d to %d' % limits)
+    if tokens[2].startswith('+'):
+        raise ShowError('bad ramp time "%s"' % tokens[2])
+    steps = round(parse_time(tokens[2], 0) / RAMP_STEP_MS)
+    if steps > 0xFF:
+        raise ShowError('ramp time must be 25.5s at most')
+    return sound, volume | steps << 8
+
+
+def parse_channels(sound, tokens):
+    if len(tokens) != 2:
+        raise ShowError('"channels" needs channel names')
+    channels = 0
+    for name in tokens[1].split(','):
+        if name not in CHANNELS:
+            raise ShowError('unknown channel "%s"' % name)
+        channels |= CHANNELS[name]
+    return sound, channels
+
+
+def compile_show(lines):
+    cues = []
+    at = 0
+    burst_at, burst = None, 0
+    for number, line in enumerate(lines, 1):
+        tokens = line.split('#', 1)[0].split()
+        if not tokens:
+            continue
+        try:
+            if len(tokens) < 2:
+                raise ShowError('expected "<time> <relays>[@<pattern>] [<sound> [<argument>]]"')
+            at = parse_time(tokens[0], at)
+            outputs, pattern = parse_relays(tokens[1])
+            sound, argument = parse_sound(tokens[2:])
+            if at != burst_at:
+                burst_at, burst = at, 0
+            burst += sound in FRAME_SOUNDS
+            if burst > CUE_FRAMES:
+                raise ShowError('more than %d sound actions at %d ms, the DFPlayer queue holds no more'
+                                % (CUE_FRAMES, at))
+        except ShowError as error:
+            raise ShowError('line %d: %s' % (number, error))
+        cues.append(struct.pack(CUE_FORMAT, at, outputs, pattern, sound, argument))
+
+    if not cues:
+        raise ShowError('show has no cues')
+    if len(cues) > 0xFFFF:
+        raise ShowError('show has more than 65535 cues')
+
+    body = b''.join(cues)
+    header = struct.pack(HEADER_FORMAT, SHOW_FILE_MAGIC, SHOW_FILE_VERSION,
+                         struct.calcsize(CUE_FORMAT), len(cues), zlib.crc32(body))
+    return header + body, len(cues)
+
+
+def main(argv):
+    if len(argv) != 3:
+        sys.stderr.write('usage: %s <script.show> <show.bin>\n' % argv[0])
+        return 2
+    try:
+        with open(argv[1]) as script:
+            data, count = compile_show(script)
+    except (OSError, ShowError) as error:
+        sys.stderr.write('%s: %s\n' % (argv[1], error))
+        return 1
+    with open(argv[2], 'wb') as output:
+        output.write(data)
+    print('%s: %d cues, %d bytes' % (argv[2], count, len(data)))
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main(sys.argv))
@@ -0,0 +1,69 @@
+#!/usr/bin/env python3
+"""
+Stages the LittleFS image: copies data/ to the directory uploadfs reads
+(data_dir in platformio.ini), with the web UI files gzipped.
+
+usage: python tools/gzip_data.py data .pio/data
+
+Web files are stored only as <name>.gz. The firmware's web server
+(ESPAsyncWebServer) looks for <name> first and falls back to <name>.gz,
+which it sends with Content-Encoding: gzip, so a plain copy next to the .gz
+would be served instead. Other files, such as show.bin, are copied as they
+are, except caches the firmware writes for itself (SKIP_FILES), which only
+describe the board that wrote them. Files in the target that are no longer
+in the source are removed.
+"""
+
+import gzip
+import os
+import sys
+
+GZIP_EXTENSIONS = ('.html', '.htm', '.js', '.css', '.ico', '.svg', '.json')
+SKIP_FILES = ('catalog.bin',)   # SoundCatalog's counts of the SD card
+
+
+def stage(source, target):
+    staged = set()
+    total_in = total_out = 0
+    for root, _, files in os.walk(source):
+        relative = os.path.relpath(root, source)
+        os.makedirs(os.path.join(target, relative), exist_ok=True)
+        for name in sorted(files):
+            if name in SKIP_FILES:
+                continue
+            path = os.path.join(root, name)
+            with open(path, 'rb') as source_file:
+                data = source_file.read()
+            if name.lower().endswith(GZIP_EXTENSIONS):
+                name += '.gz'
+                # mtime 0 so unchanged files give the same image
+                data = gzip.compress(data, compresslevel=9, mtime=0)
+            out = os.path.normpath(os.path.join(target, relative, name))
+            with open(out, 'wb') as target_file:
+                target_file.write(data)
+            staged.add(out)
+            total_in += os.path.getsize(path)
+            total_out += len(data)
+
+    for root, _, files in os.walk(target):
+        for name in files:
+            path = os.path.normpath(os.path.join(root, name))
+            if path not in staged:
+                os.remove(path)
+    return len(staged), total_in, total_out
+
+
+def main(argv):
+    if len(argv) != 3:
+        sys.stderr.write('usage: %s <data dir> <staging dir>\n' % argv[0])
+        return 2
+    if not os.path.isdir(argv[1]):
+        sys.stderr.write('%s: not a directory\n' % argv[1])
+        return 1
+    count, total_in, total_out = stage(argv[1], argv[2])
+    print('%s: %d files, %d bytes (%d before gzip)' % (argv[2], count, total_out, total_in))
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main(sys.argv))
@@ -0,0 +1,166 @@
+/*
+ * sim_sync.cpp
+ * Host simulation of a master prop and its followers sharing a show clock.
+ *
+ * build: g++ -O2 -std=gnu++11 -Iinclude -Ilib/NativeHal/src
+ *          tools/sim_sync.cpp src/ClockSync.cpp -o sim_sync
+ * run:   ./sim_sync [followers, default 8] [loss percent, default 10] [seed, default 1]
+ *
+ * Every prop gets a random micros() origin and a crystal within +-50 ppm.
+ * The master sends a SyncPacket beacon every SYNC_BEACON_MS, each copy
+ * reaches each follower after 1 ms plus an exponential jitter of mean 2 ms,
+ * one in 20 stuck behind a retransmission for 20 ms more, or not at all.
+ * After SETTLE_S the master triggers the show with SYNC_REPEATS copies and
+ * runs it for SHOW_S, the followers follow the way main.cpp does.
+ *
+ * Prints, per follower, the crystal and the estimated drift in ppm, and how
+ * far its show runs from the master's at the start and at the end, against
+ * starting on arrival of the trigger and against not following the
+ * master's clock once the show runs, all in us, positive when the follower
+ * is late. Then the spread of start and end across the followers.
+ */
+
+#include <algorithm>
+#include <math.h>
+#include <random>
+#include <stdio.h>
+#include <stdlib.h>
+#include <vector>
+#include "ClockSync.h"
+#include "ShowSync.h"
+
+#define SETTLE_S 60
+#define SHOW_S 30
+#define CRYSTAL_PPM 50
+#define DELAY_US 1000
+#define JITTER_US 2000.0
+#define RETRY_PERCENT 5
+#define RETRY_US 20000
+#define SLEW_US 500       // SYNC_SLEW_US in main.cpp
+
+struct Clock {
+  uint32_t origin;
+  double rate;            // local us per real us
+
+  uint32_t at(double t) { return (uint32_t)(origin + (uint64_t)(t * rate)); }
+  // real time of a local reading, the one within 2^31 us of near
+  double real(uint32_t local, double near) {
+    return near + (double)(int32_t)(local - at(near)) / rate;
+  }
+};
+
+struct Follower {
+  Clock clock;
+  ClockSync sync;
+  bool started = false;
+  uint32_t startAt = 0;         // local micros() the show started at, as followed
+  uint32_t firstStartAt = 0;    // as first scheduled, never moved
+  double triggerArrived = 0;    // real us
+};
+
+int main(int argc, char** argv) {
+  int followers = argc > 1 ? atoi(argv[1]) : 8;
+  int lossPercent = argc > 2 ? atoi(argv[2]) : 10;
+  unsigned seed = argc > 3 ? strtoul(argv[3], nullptr, 10) : 1;
+  if (followers <= 0 || lossPercent < 0 || lossPercent >= 100) {
+    fprintf(stderr, "usage: %s [followers] [loss percent] [seed]\n", argv[0]);
+    return 2;
+  }
+
+  std::mt19937 random(seed);
+  std::uniform_real_distribution<double> unit(0, 1);
+  auto crystal = [&]() {
+    return Clock{(uint32_t)random(), 1 + (unit(random) * 2 - 1) * CRYSTAL_PPM * 1e-6};
+  };
+  auto delay = [&]() -> double {   // negative when lost
+    if (unit(random) * 100 < lossPercent) {
+      return -1;
+    }
+    double us = DELAY_US - JITTER_US * log(1 - unit(random));
+    return unit(random) * 100 < RETRY_PERCENT ? us + RETRY_US : us;
+  };
+
+  Clock master = crystal();
+  std::vector<Follower> props(followers);
+  for (Follower& prop : props) {
+    prop.clock = crystal();
+  }
+
+  // master micros() of the show start, and the real time it happens
+  double triggerAt = SETTLE_S * 1e6;
+  uint32_t masterStart = master.at(triggerAt) + SYNC_LEAD_MS * 1000UL;
+  double showStart = master.real(masterStart, triggerAt);
+  double showEnd = showStart + SHOW_S * 1e6;
+
+  // packets in send order, what each follower makes of them in arrival order
+  struct Arrival {
+    double at;
+    SyncPacket packet;
+  };
+  for (Follower& prop : props) {
+    std::vector<Arrival> arrivals;
+    for (double t = 0; t < showEnd; t += SYNC_BEACON_MS * 1000.0) {
+      SyncPacket beacon = {SYNC_MAGIC, SYNC_BEACON, 0, 0, master.at(t), 0};
+      double d = delay();
+      if (d >= 0) {
+        arrivals.push_back({t + d, beacon});
+      }
+    }
+    for (int copy = 0; copy < SYNC_REPEATS; copy++) {
+      double t = triggerAt + copy * SYNC_REPEAT_MS * 1000.0;
+      SyncPacket trigger = {SYNC_MAGIC, SYNC_TRIGGER, 0, 1, master.at(t), masterStart};
+      double d = delay();
+      if (d >= 0) {
+        arrivals.push_back({t + d, trigger});
+      }
+    }
+    std::stable_sort(arrivals.begin(), arrivals.end(),
+      [](const Arrival& a, const Arrival& b) { return a.at < b.at; });
+
+    for (const Arrival& arrival : arrivals) {
+      uint32_t local = prop.clock.at(arrival.at);
+      prop.sync.beacon(arrival.packet.sentAt, local);
+      if (arrival.packet.type == SYNC_TRIGGER && !prop.started) {
+        prop.started = true;
+        prop.triggerArrived = arrival.at;
+        prop.startAt = prop.firstStartAt = prop.sync.toLocal(arrival.packet.startAt);
+      } else if (prop.started) {    // followMaster() in main.cpp
+        long slew = (int32_t)(local - prop.startAt) - (int32_t)(prop.sync.toMaster(local) - masterStart);
+        if (slew >= SLEW_US || slew <= -SLEW_US) {
+          prop.startAt += slew;
+        }
+      }
+    }
+  }
+
+  printf("%d followers, +-%d ppm crystals, %d%% loss, %d s settle, %d s show\n",
+         followers, CRYSTAL_PPM, lossPercent, SETTLE_S, SHOW_S);
+  printf("%-4s %10s %10s %10s %10s %10s %10s\n", "prop", "ppm", "drift", "start", "end",
+         "on arrival", "unfollowed");
+  double earliest[2] = {1e30, 1e30};    // start, end
+  double latest[2] = {-1e30, -1e30};
+  double masterElapsed = (double)(int32_t)(master.at(showEnd) - masterStart);
+  for (size_t i = 0; i < props.size(); i++) {
+    Follower& prop = props[i];
+    if (!prop.started) {
+      printf("%-4zu trigger lost\n", i);
+      continue;
+    }
+    double ppm = (prop.clock.rate / master.rate - 1) * 1e6;
+    // follower show time at the master's show end, against the master's
+    double start = prop.clock.real(prop.firstStartAt, showStart) - showStart;
+    double end = masterElapsed - (double)(int32_t)(prop.clock.at(showEnd) - prop.startAt);
+    double unfollowed = masterElapsed - (double)(int32_t)(prop.clock.at(showEnd) - prop.firstStartAt);
+    double arrival = prop.triggerArrived - showStart + SYNC_LEAD_MS * 1000.0;
+    printf("%-4zu %10.1f %10.1f %10.0f %10.0f %10.0f %10.0f\n", i, ppm, prop.sync.drift() / 1000.0,
+           start, end, arrival, unfollowed);
+    earliest[0] = fmin(earliest[0], start);
+    latest[0] = fmax(latest[0], start);
+    earliest[1] = fmin(earliest[1], end);
+    latest[1] = fmax(latest[1], end);
+  }
+  // the common lag is the shortest delay, what matters is the spread
+  printf("spread between followers: start %.0f us, end %.0f us\n",
+         latest[0] - earliest[0], latest[1] - earliest[1]);
+  return 0;
+}